@@ -0,0 +1,49 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#include "Analysis.hpp"
+#include "CodeUtils.hpp"
+#include "bison-flex/analysiscontext.hh"
+
+namespace c3ms {
+
+namespace {
+
+// Pool of contexts that never write diagnostics to the console
+ContextPool& libraryPool() {
+    static ContextPool pool(nullptr);
+    return pool;
+}
+
+// Scans one unit of code into stats and computes its metrics
+UnitMetrics measure(AnalysisContext& context, CodeStatistics& stats, std::string_view code, std::string_view name) {
+    stats.reset(); // Drop the tokens of the previous unit; the arena keeps its memory for this one
+    int errors = context.parse_buffer(code, stats);
+    MetricsCalculator metrics(stats, countLines(code));
+    return {std::string(name), metrics.getMetrics(), errors};
+}
+
+} // namespace
+
+// Analyzes a buffer of source code and returns its metrics
+AnalysisResult analyzeBuffer(std::string_view code, const AnalysisOptions& options, std::string_view name) {
+    auto context = libraryPool().acquire(); // Scanner and parser owned by this call only
+    CodeStatistics stats;
+    AnalysisResult result;
+
+    result.file = measure(*context, stats, code, name);
+
+    if (options.functionMetrics) {
+        // Read the buffer in place to extract its functions
+        ViewStreamBuf buffer;
+        buffer.reset(code);
+        std::istream input(&buffer);
+
+        for (const auto& func : extractFunctions(input)) {
+            result.functions.push_back(measure(*context, stats, func.code, func.name));
+        }
+    }
+
+    return result;
+}
+
+} // namespace c3ms
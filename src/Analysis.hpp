@@ -0,0 +1,69 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#ifndef ANALYSIS_HPP
+#define ANALYSIS_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "CodeMetrics.hpp"
+
+namespace c3ms {
+
+/**
+ * @struct UnitMetrics
+ *
+ * @brief Metrics of one analyzed unit, either a whole buffer or one of its functions.
+ *
+ * @member name The name given to the buffer, or the function name.
+ * @member metrics The Halstead and complexity metrics of the unit.
+ * @member errors The number of unexpected tokens found by the scanner.
+ */
+struct UnitMetrics {
+    std::string name;
+    HalsteadMetrics metrics;
+    int errors;
+};
+
+/**
+ * @struct AnalysisOptions
+ *
+ * @brief Options of an in-memory analysis.
+ *
+ * @member functionMetrics Also extract every function of the buffer and analyze it on its own.
+ */
+struct AnalysisOptions {
+    bool functionMetrics = true;
+};
+
+/**
+ * @struct AnalysisResult
+ *
+ * @brief Result of an in-memory analysis.
+ *
+ * @member file Metrics of the whole buffer.
+ * @member functions Metrics of each function, in source order. Empty unless requested.
+ */
+struct AnalysisResult {
+    UnitMetrics file;
+    std::vector<UnitMetrics> functions;
+};
+
+/**
+ * @brief Analyzes a buffer of source code and returns its metrics.
+ *
+ * @param code The source code to be analyzed. It is not copied.
+ * @param options The analysis options.
+ * @param name The name reported for the whole buffer.
+ * @return AnalysisResult The metrics of the buffer and, optionally, of its functions.
+ *
+ * @details This function is reentrant and may be called from several threads at once.
+ * Each call leases its own scanner and parser from a pool that never writes diagnostics,
+ * so nothing is printed to the console.
+ */
+AnalysisResult analyzeBuffer(std::string_view code, const AnalysisOptions& options = {}, std::string_view name = "");
+
+} // namespace c3ms
+
+#endif // ANALYSIS_HPP
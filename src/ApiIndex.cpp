@@ -0,0 +1,312 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#include "ApiIndex.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+
+#include "bison-flex/analysiscontext.hh"
+#include "bison-flex/varint.hh"
+#include "ResultStore.hpp"
+
+namespace {
+
+using c3ms::getVarint;
+using c3ms::putVarint;
+
+constexpr char Magic[4] = {'C', '3', 'A', 'I'};
+constexpr std::uint64_t Version = 1;
+constexpr std::uint32_t NoFile = std::numeric_limits<std::uint32_t>::max();
+
+void putString(std::string& out, std::string_view text) {
+    putVarint(out, text.size());
+    out.append(text);
+}
+
+bool getString(std::string_view& data, std::string_view& text) {
+    std::uint64_t size = 0;
+    if (!getVarint(data, size) || size > data.size()) {
+        return false;
+    }
+    text = data.substr(0, size);
+    data.remove_prefix(size);
+    return true;
+}
+
+// Backtracks to the last '*' on a mismatch, so the match takes linear time for a single '*'
+bool globMatch(std::string_view pattern, std::string_view text) {
+    std::size_t p = 0, t = 0, star = std::string_view::npos, resume = 0;
+    while (t < text.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t])) {
+            ++p;
+            ++t;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            star = p++;
+            resume = t;
+        } else if (star != std::string_view::npos) {
+            p = star + 1;
+            t = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') {
+        ++p;
+    }
+    return p == pattern.size();
+}
+
+} // namespace
+
+std::vector<std::pair<std::string, std::uint32_t>> collectApiTokens(const c3ms::CodeStatistics& stats) {
+    std::vector<std::pair<std::string, std::uint32_t>> tokens;
+    auto add = [&tokens](std::string_view token, c3ms::CodeStatistics::StatSize occurrences) {
+        tokens.emplace_back(std::string(token), static_cast<std::uint32_t>(occurrences));
+    };
+    stats.forEachToken(c3ms::CodeStatistics::StatsCategory::APIKEYWORD, add);
+    stats.forEachToken(c3ms::CodeStatistics::StatsCategory::APILLKEYWORD, add);
+    std::sort(tokens.begin(), tokens.end());
+    return tokens;
+}
+
+ApiIndexBuilder::ApiIndexBuilder(const std::vector<std::filesystem::path>& inputs)
+    : inputs_(inputs), fileOfUnit_(inputs.size(), NoFile) {}
+
+// Only files and functions with API tokens become targets
+void ApiIndexBuilder::add(const ReportRecord& record) {
+    if (record.title.empty() || record.unit >= inputs_.size() || record.apis.empty()) {
+        return;
+    }
+    std::uint32_t& file = fileOfUnit_[record.unit];
+    if (file == NoFile) {
+        file = static_cast<std::uint32_t>(paths_.size());
+        paths_.push_back(inputs_[record.unit].lexically_normal().string());
+    }
+    auto target = static_cast<std::uint32_t>(targets_.size());
+    auto colon = record.title.find(": ");
+    std::string name = record.last || colon == std::string::npos ? std::string() : record.title.substr(colon + 2);
+    targets_.push_back({file, !record.last, std::move(name), record.metrics.effort});
+
+    for (const auto& [token, occurrences] : record.apis) {
+        Postings& postings = tokens_[token];
+        putVarint(postings.gaps, target - postings.lastTarget);
+        putVarint(postings.gaps, occurrences);
+        postings.lastTarget = target;
+        if (record.last) {
+            ++postings.files;
+            postings.fileOccurrences += occurrences;
+        } else {
+            ++postings.functions;
+            postings.functionOccurrences += occurrences;
+        }
+    }
+}
+
+// Paths, then targets, then the tokens in name order; written next to its place and renamed there
+bool ApiIndexBuilder::save(const std::filesystem::path& path, std::string& error) const {
+    std::string data(Magic, sizeof(Magic));
+    putVarint(data, Version);
+    putVarint(data, paths_.size());
+    for (const auto& file : paths_) {
+        putString(data, file);
+    }
+    putVarint(data, targets_.size());
+    for (const auto& target : targets_) {
+        putVarint(data, target.file);
+        data.push_back(target.function ? 1 : 0);
+        putString(data, target.name);
+        char effort[sizeof(double)];
+        std::memcpy(effort, &target.effort, sizeof(effort));
+        data.append(effort, sizeof(effort));
+    }
+
+    std::vector<const std::pair<const std::string, Postings>*> sorted;
+    sorted.reserve(tokens_.size());
+    for (const auto& entry : tokens_) {
+        sorted.push_back(&entry);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
+    putVarint(data, sorted.size());
+    for (const auto* entry : sorted) {
+        const Postings& postings = entry->second;
+        putString(data, entry->first);
+        putVarint(data, postings.files);
+        putVarint(data, postings.functions);
+        // The files of -f are made of their functions, so both kinds give the same total when there are both
+        putVarint(data, std::max(postings.fileOccurrences, postings.functionOccurrences));
+        putString(data, postings.gaps);
+    }
+
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    out.close();
+    if (!out) {
+        error = std::strerror(errno);
+        return false;
+    }
+    std::error_code renameError;
+    std::filesystem::rename(temporary, path, renameError);
+    if (renameError) {
+        error = renameError.message();
+        return false;
+    }
+    return true;
+}
+
+// Checks every count against what is left of the data, so a damaged file cannot make it allocate wildly
+bool ApiIndex::load(const std::filesystem::path& path, std::string& error) {
+    if (!c3ms::read_file_into(path.string(), data_)) {
+        error = std::strerror(errno);
+        return false;
+    }
+    error = "not an API index";
+    std::string_view data = data_;
+    std::uint64_t version = 0, count = 0;
+    if (data.compare(0, sizeof(Magic), std::string_view(Magic, sizeof(Magic))) != 0) {
+        return false;
+    }
+    data.remove_prefix(sizeof(Magic));
+    if (!getVarint(data, version) || version != Version || !getVarint(data, count) || count > data.size()) {
+        return false;
+    }
+    paths_.resize(count);
+    for (auto& file : paths_) {
+        if (!getString(data, file)) {
+            return false;
+        }
+    }
+
+    if (!getVarint(data, count) || count > data.size()) {
+        return false;
+    }
+    targets_.resize(count);
+    for (auto& target : targets_) {
+        std::uint64_t file = 0;
+        if (!getVarint(data, file) || file >= paths_.size() || data.empty()) {
+            return false;
+        }
+        target.file = static_cast<std::uint32_t>(file);
+        target.function = data.front() != 0;
+        data.remove_prefix(1);
+        if (!getString(data, target.name) || data.size() < sizeof(double)) {
+            return false;
+        }
+        std::memcpy(&target.effort, data.data(), sizeof(double));
+        data.remove_prefix(sizeof(double));
+    }
+
+    if (!getVarint(data, count) || count > data.size()) {
+        return false;
+    }
+    tokens_.resize(count);
+    for (auto& token : tokens_) {
+        if (!getString(data, token.name) || !getVarint(data, token.files) || !getVarint(data, token.functions)
+            || !getVarint(data, token.occurrences) || !getString(data, token.postings)) {
+            return false;
+        }
+    }
+    if (!data.empty() || !std::is_sorted(tokens_.begin(), tokens_.end(), [](const Token& a, const Token& b) { return a.name < b.name; })) {
+        return false;
+    }
+    error.clear();
+    return true;
+}
+
+std::vector<const ApiIndex::Token*> ApiIndex::match(std::string_view pattern) const {
+    std::string_view prefix = pattern.substr(0, pattern.find_first_of("*?"));
+    auto first = std::lower_bound(tokens_.begin(), tokens_.end(), prefix,
+                                  [](const Token& token, std::string_view text) { return token.name < text; });
+    std::vector<const Token*> matches;
+    for (auto it = first; it != tokens_.end() && it->name.compare(0, prefix.size(), prefix) == 0; ++it) {
+        if (globMatch(pattern, it->name)) {
+            matches.push_back(&*it);
+        }
+    }
+    return matches;
+}
+
+bool ApiIndex::forEachPosting(const Token& token, const std::function<void(std::uint32_t, std::uint64_t)>& visit) const {
+    std::string_view data = token.postings;
+    std::uint64_t target = 0;
+    while (!data.empty()) {
+        std::uint64_t gap = 0, occurrences = 0;
+        if (!getVarint(data, gap) || !getVarint(data, occurrences) || gap >= targets_.size() - target) {
+            return false;
+        }
+        target += gap;
+        visit(static_cast<std::uint32_t>(target), occurrences);
+    }
+    return true;
+}
+
+// Gathers the tokens matching any pattern, each once and in name order, then writes their postings
+int runApiQuery(const ProgramOptions& options, std::ostream& out) {
+    ApiIndex index;
+    std::string error;
+    if (!index.load(options.apiQuery, error)) {
+        std::cerr << "Error: " << options.apiQuery << ": " << error << "\n";
+        return EXIT_FAILURE;
+    }
+    const std::string& kind = options.queryKind;
+    if (!kind.empty() && kind != "file" && kind != "function") {
+        std::cerr << "Error: --kind takes file or function\n";
+        return EXIT_FAILURE;
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::size_t limit = options.queryLimit > 0 ? options.queryLimit : std::numeric_limits<std::size_t>::max();
+    std::size_t rows = 0;
+
+    if (options.apiTokens.empty()) {
+        out << "token,files,functions,occurrences\n";
+        for (const auto& token : index.tokens()) {
+            if (rows++ == limit) {
+                break;
+            }
+            writeCsvField(out, token.name);
+            out << "," << token.files << "," << token.functions << "," << token.occurrences << "\n";
+        }
+        std::clog << "API query: " << index.tokens().size() << " tokens in "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms\n";
+        return EXIT_SUCCESS;
+    }
+
+    std::vector<const ApiIndex::Token*> matches;
+    for (const auto& pattern : options.apiTokens) {
+        auto found = index.match(pattern);
+        matches.insert(matches.end(), found.begin(), found.end());
+    }
+    std::sort(matches.begin(), matches.end());
+    matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+
+    out << std::fixed << std::setprecision(2);
+    out << "token,kind,file,function,occurrences,effort\n";
+    for (const ApiIndex::Token* token : matches) {
+        bool valid = index.forEachPosting(*token, [&](std::uint32_t number, std::uint64_t occurrences) {
+            const auto& target = index.target(number);
+            if (rows == limit || (!kind.empty() && target.function != (kind == "function"))
+                || !pathWithin(index.path(target.file), options.queryWithin)) {
+                return;
+            }
+            ++rows;
+            writeCsvField(out, token->name);
+            out << (target.function ? ",function," : ",file,");
+            writeCsvField(out, index.path(target.file));
+            out << ",";
+            writeCsvField(out, target.name);
+            out << "," << occurrences << "," << target.effort << "\n";
+        });
+        if (!valid) {
+            std::cerr << "Error: " << options.apiQuery << ": not an API index\n";
+            return EXIT_FAILURE;
+        }
+    }
+    std::clog << "API query: " << matches.size() << " of " << index.tokens().size() << " tokens matched, " << rows << " rows in "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms\n";
+    return EXIT_SUCCESS;
+}
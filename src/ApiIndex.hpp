@@ -0,0 +1,157 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#ifndef API_INDEX_HPP
+#define API_INDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "bison-flex/codestatistics.hh"
+#include "CodeUtils.hpp"
+#include "ReportWriter.hpp"
+
+/**
+ * @brief The API and low-level API tokens of some statistics, with their occurrences, as kept in ReportRecord::apis.
+ *
+ * @param stats The statistics of a file or function.
+ * @return The tokens, sorted.
+ */
+std::vector<std::pair<std::string, std::uint32_t>> collectApiTokens(const c3ms::CodeStatistics& stats);
+
+/**
+ * @class ApiIndexBuilder
+ *
+ * @brief Collects, for every API token, the files and functions it occurs in.
+ *
+ * @details Fed with the reports as they are written, like the result store, so the tokens come
+ * from the same scan as the metrics. Each file or function with API tokens becomes a target,
+ * numbered in input order; each token keeps its targets as a posting list of varint gaps
+ * between target numbers, each followed by the occurrences in that target. Tokens are interned
+ * once, however many targets they occur in.
+ */
+class ApiIndexBuilder {
+public:
+    /// @param inputs The input files, to find the path of each report from its unit.
+    explicit ApiIndexBuilder(const std::vector<std::filesystem::path>& inputs);
+
+    /// Adds the tokens of a report; called in input order
+    void add(const ReportRecord& record);
+
+    /**
+     * @brief Writes the index.
+     *
+     * @param path The file to write; it is replaced only once complete.
+     * @param error Set to the reason when the index cannot be written.
+     * @return bool Whether the index was written.
+     */
+    bool save(const std::filesystem::path& path, std::string& error) const;
+
+private:
+    struct Target {
+        std::uint32_t file;
+        bool function;
+        std::string name;
+        double effort;
+    };
+    struct Postings {
+        std::string gaps;              // Varint gap to each target, then its occurrences
+        std::uint32_t lastTarget = 0;
+        std::uint64_t files = 0;
+        std::uint64_t functions = 0;
+        std::uint64_t fileOccurrences = 0;
+        std::uint64_t functionOccurrences = 0;
+    };
+
+    const std::vector<std::filesystem::path>& inputs_;
+    std::vector<std::uint32_t> fileOfUnit_; // Index file of each input, once it has a target
+    std::vector<std::string> paths_;
+    std::vector<Target> targets_;
+    std::unordered_map<std::string, Postings> tokens_;
+};
+
+/**
+ * @class ApiIndex
+ *
+ * @brief An API index written by ApiIndexBuilder, read back whole.
+ *
+ * @details Paths, targets and the token table are read on load; posting lists stay encoded
+ * until a token is looked up.
+ */
+class ApiIndex {
+public:
+    /// A file or function some API token occurs in
+    struct Target {
+        std::uint32_t file;
+        bool function;
+        std::string_view name;
+        double effort;
+    };
+    /// A token with the totals of its posting list
+    struct Token {
+        std::string_view name;
+        std::uint64_t files;
+        std::uint64_t functions;
+        std::uint64_t occurrences; ///< Each counted once, though a file and its functions both list it
+        std::string_view postings;
+    };
+
+    /**
+     * @brief Reads an index.
+     *
+     * @param path The file of the index.
+     * @param error Set to the reason when the file cannot be read or is not an index.
+     * @return bool Whether the index was read.
+     */
+    bool load(const std::filesystem::path& path, std::string& error);
+
+    /// Tokens sorted by name
+    const std::vector<Token>& tokens() const { return tokens_; }
+    const Target& target(std::uint32_t target) const { return targets_[target]; }
+    std::string_view path(std::uint32_t file) const { return paths_[file]; }
+
+    /**
+     * @brief Tokens matching a pattern, where '*' stands for any text and '?' for one character.
+     *
+     * @details Only the tokens starting with the text before the first wildcard are tried, found by binary search.
+     */
+    std::vector<const Token*> match(std::string_view pattern) const;
+
+    /**
+     * @brief Decodes the posting list of a token.
+     *
+     * @param token A token of this index.
+     * @param visit Called with each target, in input order, and the occurrences of the token in it.
+     * @return bool Whether the list is well formed.
+     */
+    bool forEachPosting(const Token& token, const std::function<void(std::uint32_t, std::uint64_t)>& visit) const;
+
+private:
+    std::string data_;
+    std::vector<std::string_view> paths_;
+    std::vector<Target> targets_;
+    std::vector<Token> tokens_;
+};
+
+/**
+ * @brief Looks up the API tokens given with --token in the index given with --api-query.
+ *
+ * @param options The settings; apiTokens, queryWithin, queryKind and queryLimit shape the lookup.
+ * @param out The stream the CSV result is written to.
+ * @return int EXIT_SUCCESS, or EXIT_FAILURE when the index cannot be read or the lookup is malformed.
+ *
+ * @details Writes one line per file or function a matching token occurs in, with its
+ * occurrences and the effort of the file or function. Without --token, writes one line per
+ * token of the index with its totals instead. A line on the log gives the tokens matched and
+ * the time taken.
+ */
+int runApiQuery(const ProgramOptions& options, std::ostream& out = std::cout);
+
+#endif // API_INDEX_HPP
@@ -0,0 +1,138 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#include "BatchMetrics.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Units per block: 8 doubles per unit of scratch stay well inside L1
+constexpr std::size_t BlockSize = 256;
+
+// The stages of a block. The arithmetic ones have no calls and no branches, the clamps being
+// selects, and take their columns as restrict parameters, which is where GCC honours it, so
+// they vectorize without runtime alias checks. log, log2 and cbrt stay libm calls, gathered in
+// loops of their own, since their vector forms do not give the same results, and so does trunc,
+// which GCC only vectorizes without -ftrapping-math.
+
+// Vocabulary, clamped to 1 so an empty unit has a volume of 0
+void vocabulary(std::size_t count, const double* __restrict n1, const double* __restrict n2, double* __restrict n) {
+    for (std::size_t i = 0; i < count; ++i) {
+        double sum = n1[i] + n2[i];
+        n[i] = sum < 1.0 ? 1.0 : sum;
+    }
+}
+
+// Volume, difficulty (0 without operands), effort, time and cyclomatic complexity, and the
+// operands of the maintainability logarithms, clamped so they never go negative
+void halstead(std::size_t count, const double* __restrict n1, const double* __restrict n2, const double* __restrict N1,
+              const double* __restrict N2, const double* __restrict conditions, const double* __restrict linesOfCode,
+              const double* __restrict log2n, double* __restrict volume, double* __restrict difficulty, double* __restrict effort,
+              double* __restrict timeRequired, double* __restrict cyclomaticComplexity, double* __restrict volumeFloor,
+              double* __restrict linesFloor) {
+    for (std::size_t i = 0; i < count; ++i) {
+        double operands = n2[i] < 1.0 ? 1.0 : n2[i];
+        volume[i] = (N1[i] + N2[i]) * log2n[i];
+        difficulty[i] = (n1[i] / 2.0) * (N2[i] / operands);
+        effort[i] = volume[i] * difficulty[i];
+        timeRequired[i] = effort[i] / 18.0;
+        cyclomaticComplexity[i] = conditions[i] + 1.0;
+        volumeFloor[i] = volume[i] < 1.0 ? 1.0 : volume[i];
+        linesFloor[i] = linesOfCode[i] < 1.0 ? 1.0 : linesOfCode[i];
+    }
+}
+
+// Bugs: effort^(2/3) / 3000, with cbrt instead of pow, and the maintainability index before it is truncated
+void maintainability(std::size_t count, const double* __restrict root, const double* __restrict logVolume,
+                     const double* __restrict logLines, const double* __restrict cyclomaticComplexity,
+                     double* __restrict numberOfBugs, double* __restrict maintainabilityIndex) {
+    for (std::size_t i = 0; i < count; ++i) {
+        numberOfBugs[i] = root[i] * root[i] / 3000.0;
+        maintainabilityIndex[i] = 171 - 5.2 * logVolume[i] - 0.23 * cyclomaticComplexity[i] - 16.2 * logLines[i];
+    }
+}
+
+// Computes the metrics of at most BlockSize units
+void computeBlock(std::size_t count, const MetricInputColumns& in, const MetricOutputColumns& out) {
+    double log2n[BlockSize];
+    double root[BlockSize];
+    double logVolume[BlockSize];
+    double logLines[BlockSize];
+
+    vocabulary(count, in.n1, in.n2, log2n);
+    for (std::size_t i = 0; i < count; ++i) {
+        log2n[i] = std::log2(log2n[i]);
+    }
+    halstead(count, in.n1, in.n2, in.N1, in.N2, in.conditions, in.linesOfCode, log2n, out.volume, out.difficulty, out.effort,
+             out.timeRequired, out.cyclomaticComplexity, logVolume, logLines);
+    for (std::size_t i = 0; i < count; ++i) {
+        root[i] = std::cbrt(out.effort[i]);
+        logVolume[i] = std::log(logVolume[i]);
+        logLines[i] = std::log(logLines[i]);
+    }
+    maintainability(count, root, logVolume, logLines, out.cyclomaticComplexity, out.numberOfBugs, out.maintainabilityIndex);
+    for (std::size_t i = 0; i < count; ++i) {
+        out.maintainabilityIndex[i] = std::trunc(out.maintainabilityIndex[i]);
+    }
+}
+
+} // namespace
+
+// Computes the metrics block by block
+void computeMetrics(std::size_t count, const MetricInputColumns& in, const MetricOutputColumns& out) {
+    for (std::size_t begin = 0; begin < count; begin += BlockSize) {
+        std::size_t size = std::min(BlockSize, count - begin);
+        MetricInputColumns blockIn{in.n1 + begin, in.n2 + begin, in.N1 + begin, in.N2 + begin,
+                                   in.conditions + begin, in.linesOfCode + begin};
+        MetricOutputColumns blockOut{out.volume + begin, out.difficulty + begin, out.effort + begin,
+                                     out.timeRequired + begin, out.numberOfBugs + begin,
+                                     out.cyclomaticComplexity + begin, out.maintainabilityIndex + begin};
+        computeBlock(size, blockIn, blockOut);
+    }
+}
+
+// Reserves room in every column
+void MetricBatch::reserve(std::size_t capacity) {
+    for (auto* column : {&n1, &n2, &N1, &N2, &conditions, &linesOfCode}) {
+        column->reserve(capacity);
+    }
+}
+
+// Appends a unit from its token counts
+void MetricBatch::add(double un1, double un2, double tN1, double tN2, double conds, double lines) {
+    n1.push_back(un1);
+    n2.push_back(un2);
+    N1.push_back(tN1);
+    N2.push_back(tN2);
+    conditions.push_back(conds);
+    linesOfCode.push_back(lines);
+}
+
+// Appends a unit from its code statistics
+void MetricBatch::add(const c3ms::CodeStatistics& cs, int lines) {
+    add(static_cast<double>(cs.getUniqueOperators()), static_cast<double>(cs.getUniqueOperands()),
+        static_cast<double>(cs.getOperators()), static_cast<double>(cs.getOperands()),
+        static_cast<double>(cs.getCounterValue(c3ms::CodeStatistics::StatsCategory::CONDITION)),
+        static_cast<double>(lines));
+}
+
+// Sizes the output columns and runs the kernels
+void MetricBatch::compute() {
+    const std::size_t count = size();
+    for (auto* column : {&volume, &difficulty, &effort, &timeRequired, &numberOfBugs, &cyclomaticComplexity, &maintainabilityIndex}) {
+        column->resize(count);
+    }
+    computeMetrics(count,
+                   {n1.data(), n2.data(), N1.data(), N2.data(), conditions.data(), linesOfCode.data()},
+                   {volume.data(), difficulty.data(), effort.data(), timeRequired.data(),
+                    numberOfBugs.data(), cyclomaticComplexity.data(), maintainabilityIndex.data()});
+}
+
+// Removes every unit, keeping the allocated columns
+void MetricBatch::clear() {
+    for (auto* column : {&n1, &n2, &N1, &N2, &conditions, &linesOfCode,
+                         &volume, &difficulty, &effort, &timeRequired, &numberOfBugs, &cyclomaticComplexity, &maintainabilityIndex}) {
+        column->clear();
+    }
+}
@@ -0,0 +1,146 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <chrono>
+
+/**
+ * @class BoundedQueue
+ *
+ * @brief A bounded lock-free multi-producer multi-consumer queue.
+ *
+ * @details Array-based queue where every cell carries a sequence number that tells producers
+ * and consumers whether the cell is free or holds a value (D. Vyukov's design). Pushing to a
+ * full queue and popping from an empty one fail instead of blocking. The capacity is rounded
+ * up to a power of two.
+ *
+ * @tparam T The type of the elements. It must be default constructible and movable.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+    /**
+     * @brief Constructs a queue able to hold at least the given number of elements.
+     *
+     * @param capacity The minimum capacity of the queue.
+     */
+    explicit BoundedQueue(std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask_ = size - 1;
+        cells_ = std::make_unique<Cell[]>(size);
+        for (std::size_t i = 0; i < size; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    /**
+     * @brief Tries to append an element. The element is only moved from on success.
+     *
+     * @param value The element to append.
+     * @return true if the element was queued, false if the queue is full.
+     */
+    bool tryPush(T&& value) {
+        Cell* cell;
+        std::size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+            auto dif = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if (dif == 0) {
+                if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (dif < 0) {
+                return false; // The queue is full
+            } else {
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Tries to remove the oldest element.
+     *
+     * @param value Receives the element on success.
+     * @return true if an element was removed, false if the queue is empty.
+     */
+    bool tryPop(T& value) {
+        Cell* cell;
+        std::size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+            auto dif = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+            if (dif == 0) {
+                if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (dif < 0) {
+                return false; // The queue is empty
+            } else {
+                pos = dequeuePos_.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(cell->value);
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    std::size_t mask_;
+    alignas(64) std::atomic<std::size_t> enqueuePos_{0};
+    alignas(64) std::atomic<std::size_t> dequeuePos_{0};
+};
+
+/**
+ * @class Backoff
+ *
+ * @brief Escalating wait used while a lock-free queue is full or empty.
+ *
+ * @details Spins first, then yields the processor, and finally sleeps for short periods,
+ * so an idle thread does not burn a core.
+ */
+class Backoff {
+public:
+    void pause() {
+        if (step_ < 64) {
+            ++step_;
+        } else if (step_ < 128) {
+            ++step_;
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+    void reset() { step_ = 0; }
+
+    /// Whether the wait has escalated to sleeping
+    bool sleeping() const { return step_ >= 128; }
+
+private:
+    int step_ = 0;
+};
+
+#endif // BOUNDED_QUEUE_HPP
@@ -0,0 +1,80 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#include "c3ms.h"
+#include "Analysis.hpp"
+
+#include <memory>
+
+struct c3ms_result {
+    c3ms_metrics file;
+    std::vector<c3ms_metrics> functions;
+    std::vector<std::string> names;
+};
+
+namespace {
+
+// Copies the metrics of a unit into the C layout
+c3ms_metrics toC(const c3ms::UnitMetrics& unit) {
+    const HalsteadMetrics& m = unit.metrics;
+    return {m.n1, m.n2, m.N1, m.N2, m.volume, m.difficulty, m.effort, m.timeRequired, m.numberOfBugs,
+            m.conditions, m.cyclomaticComplexity, m.linesOfCode, m.maintainabilityIndex, unit.errors};
+}
+
+} // namespace
+
+extern "C" {
+
+int c3ms_analyze(const char* data, size_t size, unsigned int flags, c3ms_result** result) {
+    if (result == nullptr || (data == nullptr && size != 0)) {
+        return C3MS_ERROR_ARGUMENT;
+    }
+    *result = nullptr;
+
+    // No exception may cross the C boundary
+    try {
+        c3ms::AnalysisOptions options;
+        options.functionMetrics = (flags & C3MS_FUNCTION_METRICS) != 0;
+        auto analysis = c3ms::analyzeBuffer(std::string_view(data, size), options);
+
+        auto out = std::make_unique<c3ms_result>();
+        out->file = toC(analysis.file);
+        out->functions.reserve(analysis.functions.size());
+        out->names.reserve(analysis.functions.size());
+        for (auto& func : analysis.functions) {
+            out->functions.push_back(toC(func));
+            out->names.push_back(std::move(func.name));
+        }
+        *result = out.release();
+        return C3MS_OK;
+    } catch (...) {
+        return C3MS_ERROR_INTERNAL;
+    }
+}
+
+const c3ms_metrics* c3ms_result_file(const c3ms_result* result) {
+    return result ? &result->file : nullptr;
+}
+
+size_t c3ms_result_function_count(const c3ms_result* result) {
+    return result ? result->functions.size() : 0;
+}
+
+const char* c3ms_result_function_name(const c3ms_result* result, size_t index) {
+    if (result == nullptr || index >= result->names.size()) {
+        return nullptr;
+    }
+    return result->names[index].c_str();
+}
+
+const c3ms_metrics* c3ms_result_function_metrics(const c3ms_result* result, size_t index) {
+    if (result == nullptr || index >= result->functions.size()) {
+        return nullptr;
+    }
+    return &result->functions[index];
+}
+
+void c3ms_result_free(c3ms_result* result) {
+    delete result;
+}
+
+} // extern "C"
@@ -0,0 +1,241 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#include "Checkpoint.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <utility>
+
+#include "bison-flex/varint.hh"
+#include "CodeUtils.hpp"
+
+using namespace c3ms;
+
+namespace {
+
+constexpr char Magic[] = {'C', '3', 'C', 'P', 3};
+
+// Files are known by their canonical path, so a.cpp and ./a.cpp are the same file on resume
+std::string fileKey(const std::filesystem::path& file) {
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(file, error);
+    return error ? file.lexically_normal().string() : canonical.string();
+}
+
+void putString(std::string& out, std::string_view text) {
+    putVarint(out, text.size());
+    out.append(text);
+}
+
+// Reads the fields of a snapshot; any read past the end leaves it failed
+class Reader {
+public:
+    explicit Reader(std::string_view data) : data_(data) {}
+
+    std::uint64_t varint() {
+        std::string_view rest = data_.substr(pos_);
+        std::uint64_t value = 0;
+        if (!getVarint(rest, value)) {
+            failed_ = true;
+            value = 0;
+        }
+        pos_ = data_.size() - rest.size();
+        return value;
+    }
+
+    std::string_view string() {
+        std::uint64_t size = varint();
+        if (size > data_.size() - pos_) {
+            failed_ = true;
+            return {};
+        }
+        std::string_view text = data_.substr(pos_, size);
+        pos_ += size;
+        return text;
+    }
+
+    bool failed() const { return failed_; }
+    bool atEnd() const { return pos_ == data_.size(); }
+
+private:
+    std::string_view data_;
+    std::size_t pos_ = 0;
+    bool failed_ = false;
+};
+
+} // namespace
+
+// Options that change the statistics of a file
+std::string checkpointSignature(const ProgramOptions& options) {
+    std::string signature = options.functionMetrics ? "f" : "a";
+    signature += options.preprocess ? " P" : "";
+    for (const auto& definition : options.defines) {
+        signature += " D" + definition;
+    }
+    for (const auto& name : options.undefines) {
+        signature += " U" + name;
+    }
+    signature += " max-size=" + std::to_string(options.limits.maxBytes);
+    signature += options.limits.sniff ? " sniff" : "";
+    return signature;
+}
+
+// The first snapshot is due one interval after the run starts
+Checkpoint::Checkpoint(std::filesystem::path path, std::string signature, double intervalSeconds)
+    : path_(std::move(path)), signature_(std::move(signature)),
+      interval_(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(intervalSeconds))),
+      last_(std::chrono::steady_clock::now()) {}
+
+// Reads the last snapshot back into the global results
+bool Checkpoint::load(CodeStatistics& globalStats, int& globalLinesOfCode, ScanReport& skipped, std::string& error) {
+    std::ifstream in(path_, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    error = path_.string() + " is not a checkpoint";
+    if (data.size() < sizeof(Magic) || std::memcmp(data.data(), Magic, sizeof(Magic)) != 0) {
+        return false;
+    }
+    Reader reader(std::string_view(data).substr(sizeof(Magic)));
+    std::string_view signature = reader.string();
+    if (signature != signature_) {
+        error = path_.string() + " was written with other options (" + std::string(signature) + ")";
+        return false;
+    }
+
+    int linesOfCode = static_cast<int>(reader.varint());
+    ScanReport report;
+    report.skippedBytes = reader.varint();
+    report.skippedRegions = reader.varint();
+    CodeStatistics stats;
+    if (!stats.deserialize(reader.string()) || reader.failed()) {
+        return false;
+    }
+
+    std::unordered_map<std::string, std::size_t> files;
+    for (std::uint64_t count = reader.varint(); count > 0 && !reader.failed(); --count) {
+        std::string_view file = reader.string();
+        std::uint64_t times = reader.varint();
+        if (times == 0) {
+            return false;
+        }
+        files[std::string(file)] += times;
+    }
+    if (reader.failed() || !reader.atEnd()) {
+        return false;
+    }
+
+    error.clear();
+    globalStats = std::move(stats);
+    globalLinesOfCode = linesOfCode;
+    skipped = report;
+    files_ = files;
+    restored_ = std::move(files);
+    return true;
+}
+
+// Takes one occurrence of the path off the restored ones
+bool Checkpoint::completed(const std::filesystem::path& file) {
+    auto it = restored_.find(fileKey(file));
+    if (it == restored_.end()) {
+        return false;
+    }
+    if (--it->second == 0) {
+        restored_.erase(it);
+    }
+    return true;
+}
+
+// Records a file, and takes a snapshot once the interval has passed
+void Checkpoint::done(const std::filesystem::path& file, const CodeStatistics& globalStats, int globalLinesOfCode, const ScanReport& skipped) {
+    ++files_[fileKey(file)];
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_ < interval_) {
+        return;
+    }
+
+    std::string error;
+    if (!save(globalStats, globalLinesOfCode, skipped, error)) {
+        std::cerr << "Warning: cannot write checkpoint " << path_ << ": " << error << "\n";
+    }
+    last_ = std::chrono::steady_clock::now(); // A slow snapshot must not make the next one due at once
+}
+
+// Writes a snapshot next to the checkpoint, then renames it over it
+bool Checkpoint::save(const CodeStatistics& globalStats, int globalLinesOfCode, const ScanReport& skipped, std::string& error) {
+    std::string data(Magic, sizeof(Magic));
+    putString(data, signature_);
+    putVarint(data, static_cast<std::uint64_t>(globalLinesOfCode));
+    putVarint(data, skipped.skippedBytes);
+    putVarint(data, skipped.skippedRegions);
+    std::string stats;
+    globalStats.serialize(stats);
+    putString(data, stats);
+
+    putVarint(data, files_.size());
+    for (const auto& [file, times] : files_) {
+        putString(data, file);
+        putVarint(data, times);
+    }
+
+    std::filesystem::path temporary = path_;
+    temporary += ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        out.close();
+        if (!out) {
+            error = std::strerror(errno);
+            return false;
+        }
+    }
+
+    // The contents must reach the disk before the rename can, or a crash may leave an empty file
+    int fd = ::open(temporary.c_str(), O_RDONLY);
+    if (fd < 0 || ::fsync(fd) != 0) {
+        error = std::strerror(errno);
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return false;
+    }
+    ::close(fd);
+
+    std::error_code renameError;
+    std::filesystem::rename(temporary, path_, renameError);
+    if (renameError) {
+        error = renameError.message();
+        return false;
+    }
+
+    // The rename only changes the directory, which must reach the disk as well, or a crash may undo it
+    std::filesystem::path directory = path_.has_parent_path() ? path_.parent_path() : std::filesystem::path(".");
+    int directoryFd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (directoryFd < 0 || ::fsync(directoryFd) != 0) {
+        error = std::strerror(errno);
+        if (directoryFd >= 0) {
+            ::close(directoryFd);
+        }
+        return false;
+    }
+    ::close(directoryFd);
+    return true;
+}
+
+// Nothing is left to resume; a snapshot cut short by a crash may be left too
+void Checkpoint::remove() {
+    std::error_code error;
+    std::filesystem::remove(path_, error);
+    std::filesystem::path temporary = path_;
+    temporary += ".tmp";
+    std::filesystem::remove(temporary, error);
+}
@@ -0,0 +1,82 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+
+#include "bison-flex/analysiscontext.hh"
+#include "bison-flex/codestatistics.hh"
+
+struct ProgramOptions;
+
+/**
+ * @brief Settings a checkpoint is only valid for, as text.
+ *
+ * @details Those that change the statistics of a file: function metrics, the preprocessor
+ * and its macros, and the size and sniffing limits. The timeout is left out, since whether a
+ * file runs out of time depends on the machine anyway.
+ */
+std::string checkpointSignature(const ProgramOptions& options);
+
+/**
+ * @class Checkpoint
+ *
+ * @brief Periodic snapshots of the global results of a run, to resume it after a crash.
+ *
+ * @details A snapshot holds the global statistics, token by token with their counters, the
+ * lines of code, the bytes skipped by the preprocessor and the files done so far. It is
+ * written to a temporary file that is synced and renamed over the checkpoint, and the
+ * directory is synced after the rename, so the file on disk is always a complete snapshot,
+ * the last one or the one before.
+ */
+class Checkpoint {
+public:
+    /**
+     * @param path The checkpoint file.
+     * @param signature The settings of the run, from checkpointSignature().
+     * @param intervalSeconds The least time between two snapshots; 0 writes one after every file.
+     */
+    Checkpoint(std::filesystem::path path, std::string signature, double intervalSeconds);
+
+    /**
+     * @brief Restores the results of the last snapshot.
+     *
+     * @param globalStats Filled with the global statistics; expected empty.
+     * @param globalLinesOfCode Set to the global lines of code.
+     * @param skipped Set to the bytes and regions skipped by the preprocessor.
+     * @param error The reason, when the snapshot cannot be used.
+     * @return bool Whether a snapshot was restored; false with an empty error when there is none.
+     */
+    bool load(c3ms::CodeStatistics& globalStats, int& globalLinesOfCode, c3ms::ScanReport& skipped, std::string& error);
+
+    /// Whether a file was done before the restored snapshot, however its path is written; a file given twice is answered for each time
+    bool completed(const std::filesystem::path& file);
+
+    /**
+     * @brief Records a file as done, and writes a snapshot when the interval has passed.
+     *
+     * @details The results given must already include the file. A snapshot that cannot be
+     * written is reported on stderr, and the run carries on.
+     */
+    void done(const std::filesystem::path& file, const c3ms::CodeStatistics& globalStats, int globalLinesOfCode, const c3ms::ScanReport& skipped);
+
+    /// Deletes the checkpoint, once the run it belongs to has finished
+    void remove();
+
+private:
+    bool save(const c3ms::CodeStatistics& globalStats, int globalLinesOfCode, const c3ms::ScanReport& skipped, std::string& error);
+
+    std::filesystem::path path_;
+    std::string signature_;
+    std::chrono::steady_clock::duration interval_;
+    std::chrono::steady_clock::time_point last_;
+    std::unordered_map<std::string, std::size_t> files_;    // Times each file was done, by canonical path
+    std::unordered_map<std::string, std::size_t> restored_; // Those of the restored snapshot not skipped yet
+};
+
+#endif // CHECKPOINT_HPP
@@ -0,0 +1,243 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#include "Clones.hpp"
+
+#include <algorithm>
+#include <iomanip>
+
+#include "bison-flex/analysiscontext.hh"
+#include "bison-flex/preprocessor.hh"
+#include "InputGuard.hpp"
+
+using namespace c3ms;
+
+namespace {
+
+// Final avalanche of MurmurHash3
+inline std::uint64_t fmix(std::uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+// Base of the rolling hash, odd so that it is invertible modulo 2^64
+constexpr std::uint64_t Base = 0x100000001b3ULL;
+
+// Hash of a whole token sequence, for identical copies
+std::uint64_t sequenceHash(const std::vector<std::uint64_t>& tokens) {
+    std::uint64_t hash = fmix(tokens.size());
+    for (std::uint64_t token : tokens) {
+        hash = fmix(hash ^ token) + 0x9e3779b97f4a7c15ULL;
+    }
+    return hash;
+}
+
+} // namespace
+
+// Names and literals collapse to their category
+void TokenFingerprinter::token(CodeStatistics::StatsCategory category, std::string_view text) {
+    std::uint64_t hash = 0xcbf29ce484222325ULL; // FNV-1a
+    if (category != CodeStatistics::StatsCategory::IDENTIFIER && category != CodeStatistics::StatsCategory::CONSTANT) {
+        for (char c : text) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+        }
+    }
+    tokens_.push_back(fmix(hash + static_cast<std::uint64_t>(category)));
+}
+
+// Keeps the rightmost smallest k-gram hash of every window, once per position
+void CloneIndex::winnow(const std::vector<std::uint64_t>& tokens) {
+    kgrams_.clear();
+    fingerprints_.clear();
+    if (tokens.size() < K) {
+        return;
+    }
+
+    std::uint64_t power = 1; // Base^(K-1), the weight of the token leaving the k-gram
+    for (std::size_t i = 1; i < K; ++i) {
+        power *= Base;
+    }
+    std::uint64_t hash = 0;
+    for (std::size_t i = 0; i < tokens.size(); ++i) {
+        if (i >= K) {
+            hash -= tokens[i - K] * power;
+        }
+        hash = hash * Base + tokens[i];
+        if (i + 1 >= K) {
+            kgrams_.push_back(fmix(hash));
+        }
+    }
+
+    // Indices of a monotonic queue: increasing hashes, so the front is the minimum of the window
+    window_.clear();
+    std::size_t head = 0;
+    std::size_t width = std::min(W, kgrams_.size());
+    std::size_t recorded = kgrams_.size(); // None yet
+    for (std::size_t j = 0; j < kgrams_.size(); ++j) {
+        while (window_.size() > head && kgrams_[window_.back()] >= kgrams_[j]) {
+            window_.pop_back();
+        }
+        window_.push_back(j);
+        if (window_[head] + width <= j) {
+            ++head;
+        }
+        if (j + 1 >= width && window_[head] != recorded) {
+            recorded = window_[head];
+            fingerprints_.push_back(kgrams_[recorded]);
+        }
+    }
+    std::sort(fingerprints_.begin(), fingerprints_.end());
+    fingerprints_.erase(std::unique(fingerprints_.begin(), fingerprints_.end()), fingerprints_.end());
+}
+
+// Counts the fingerprints shared with each earlier function through the index, then indexes this one
+std::uint32_t CloneIndex::add(const std::vector<std::uint64_t>& tokens) {
+    auto id = static_cast<std::uint32_t>(sizes_.size());
+    if (tokens.size() < minTokens_ || tokens.size() < K) {
+        sizes_.push_back(0);
+        return id;
+    }
+
+    auto [copy, inserted] = sequences_.try_emplace(sequenceHash(tokens), id);
+    if (!inserted) {
+        pairs_.push_back({copy->second, id, 1.0});
+        sizes_.push_back(0);
+        return id;
+    }
+
+    winnow(tokens);
+    sizes_.push_back(static_cast<std::uint32_t>(fingerprints_.size()));
+    shared_.resize(sizes_.size(), 0);
+    for (std::uint64_t fingerprint : fingerprints_) {
+        auto& functions = index_[fingerprint];
+        if (functions.size() >= MaxPostings) {
+            continue;
+        }
+        for (std::uint32_t other : functions) {
+            if (shared_[other]++ == 0) {
+                touched_.push_back(other);
+            }
+        }
+        functions.push_back(id);
+    }
+
+    double size = static_cast<double>(fingerprints_.size());
+    for (std::uint32_t other : touched_) {
+        double shared = shared_[other];
+        double similarity = shared / (size + sizes_[other] - shared);
+        if (similarity >= similarity_) {
+            pairs_.push_back({other, id, similarity});
+        }
+        shared_[other] = 0;
+    }
+    touched_.clear();
+    return id;
+}
+
+// Most similar first, then in the order found
+std::vector<ClonePair> CloneIndex::pairs() const {
+    std::vector<ClonePair> pairs = pairs_;
+    std::stable_sort(pairs.begin(), pairs.end(), [](const ClonePair& a, const ClonePair& b) {
+        return a.similarity > b.similarity;
+    });
+    return pairs;
+}
+
+// Extracts the functions of every file, indexes their fingerprints and lists the pairs
+int runClones(const std::vector<std::filesystem::path>& files, const ProgramOptions& options, std::ostream& out) {
+    const InputLimits& limits = options.limits;
+
+    Preprocessor preprocessor;
+    for (const auto& definition : options.defines) {
+        preprocessor.define(definition);
+    }
+    for (const auto& name : options.undefines) {
+        preprocessor.undefine(name);
+    }
+
+    // Functions are extracted from the active branches, so the context does not filter again
+    auto context = ContextPool::global().acquire();
+    TokenFingerprinter fingerprinter;
+    context->options().sink = &fingerprinter;
+    Watchdog watchdog;
+    CodeStatistics stats;
+
+    struct Function {
+        std::size_t unit;
+        std::string name;
+    };
+    std::vector<Function> functions; // By id
+    CloneIndex index(options.cloneSimilarity, options.cloneMinTokens);
+    std::size_t skipped = 0;
+
+    ViewStreamBuf codeBuffer;
+    Preprocessor::Result filtered;
+    std::string activeCode;
+    for (std::size_t unit = 0; unit < files.size(); ++unit) {
+        const auto& filePath = files[unit];
+        // A file removed or made unreadable since the run started is reported like a missing one
+        std::error_code error;
+        bool valid = std::filesystem::is_regular_file(filePath, error);
+        std::uintmax_t size = valid ? std::filesystem::file_size(filePath, error) : 0;
+        if (!valid || error) {
+            std::cerr << "Error: " << filePath << " not accessible or invalid\n";
+            continue;
+        }
+        if (limits.maxBytes > 0 && size > limits.maxBytes) {
+            ++skipped;
+            continue;
+        }
+        std::string_view code = context->read_file(filePath.string());
+        if (limits.sniff && !sniffInput(code).empty()) {
+            ++skipped;
+            continue;
+        }
+        if (options.preprocess) {
+            activeCode = preprocessor.strip(code, filtered);
+            code = activeCode;
+        }
+
+        // The budget covers extracting the functions too, since their regular expressions can be the slow part
+        if (limits.timeoutSeconds > 0) {
+            watchdog.arm(*context, limits.timeoutSeconds);
+        }
+        codeBuffer.reset(code);
+        std::istream codeStream(&codeBuffer);
+        auto extracted = extractFunctions(codeStream, &*context);
+        for (const auto& func : extracted) {
+            try {
+                fingerprinter.clear();
+                stats.reset();
+                context->parse_buffer(func.code, stats);
+                if (context->cancelled()) {
+                    break;
+                }
+                index.add(fingerprinter.tokens());
+                functions.push_back({unit, func.name});
+            } catch (const std::exception& e) {
+                std::cerr << "Error processing function " << func.name << ": " << e.what() << std::endl;
+            }
+        }
+        // Functions indexed before the budget ran out are kept
+        if (watchdog.disarm() || context->cancelled()) {
+            ++skipped;
+        }
+    }
+
+    auto pairs = index.pairs();
+    out << "\nClones: " << pairs.size() << " pairs among " << functions.size() << " functions (similarity >= "
+        << std::fixed << std::setprecision(2) << options.cloneSimilarity << ")\n";
+    for (const auto& pair : pairs) {
+        const Function& first = functions[pair.first];
+        const Function& second = functions[pair.second];
+        out << pair.similarity << " " << files[first.unit].string() << ": " << first.name << "\n"
+            << "  ~ " << files[second.unit].string() << ": " << second.name << "\n";
+    }
+    if (skipped > 0) {
+        std::clog << "Clones: skipped " << skipped << " files over the size or time budget or rejected by the sniffer\n";
+    }
+    return EXIT_SUCCESS;
+}
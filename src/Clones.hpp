@@ -0,0 +1,121 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#ifndef CLONES_HPP
+#define CLONES_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "bison-flex/tokenstream.hh"
+#include "CodeUtils.hpp"
+
+/**
+ * @class TokenFingerprinter
+ *
+ * @brief Turns the classified tokens of a function into a sequence of normalized token hashes.
+ *
+ * @details Identifiers and constants are reduced to their category, so renaming variables or
+ * changing literals does not hide a copy. Every other token keeps its text.
+ */
+class TokenFingerprinter : public c3ms::TokenSink {
+public:
+    void token(c3ms::CodeStatistics::StatsCategory category, std::string_view text) override;
+    void condition() override {}
+    void decOperator() override {}
+
+    const std::vector<std::uint64_t>& tokens() const { return tokens_; }
+    void clear() { tokens_.clear(); }
+
+private:
+    std::vector<std::uint64_t> tokens_;
+};
+
+/**
+ * @struct ClonePair
+ *
+ * @brief Two functions found to be near-duplicates.
+ */
+struct ClonePair {
+    std::uint32_t first;  ///< The function added first.
+    std::uint32_t second; ///< The function added later.
+    double similarity;    ///< Jaccard similarity of their fingerprints; 1 for identical token sequences.
+};
+
+/**
+ * @class CloneIndex
+ *
+ * @brief Finds near-duplicate functions without comparing every pair.
+ *
+ * @details Each function is fingerprinted by winnowing: the hashes of its k-grams of
+ * normalized tokens are taken with a rolling hash, and the smallest one of every window of
+ * consecutive k-grams is kept, so any run of at least K + W - 1 tokens shared by two
+ * functions gives them a fingerprint in common. An inverted index maps each fingerprint to
+ * the functions that have it, so a new function is only compared with those it shares a
+ * fingerprint with. Fingerprints held by too many functions are boilerplate rather than
+ * evidence of copying, and stop being indexed, which keeps the work near-linear. Functions
+ * with identical normalized token sequences are matched by a hash of the whole sequence
+ * instead, and only the first of them is indexed.
+ */
+class CloneIndex {
+public:
+    static constexpr std::size_t K = 12;            ///< Tokens per k-gram.
+    static constexpr std::size_t W = 8;             ///< K-grams per winnowing window.
+    static constexpr std::size_t MaxPostings = 256; ///< Functions a fingerprint is indexed for, at most.
+
+    /**
+     * @param similarity The least Jaccard similarity of the fingerprints of a reported pair.
+     * @param minTokens Functions with fewer tokens are left out.
+     */
+    CloneIndex(double similarity, std::size_t minTokens) : similarity_(similarity), minTokens_(minTokens) {}
+
+    /**
+     * @brief Fingerprints a function and pairs it with the earlier functions it resembles.
+     *
+     * @param tokens The normalized token hashes of the function.
+     * @return std::uint32_t The id of the function, counting from 0 in the order they are added.
+     */
+    std::uint32_t add(const std::vector<std::uint64_t>& tokens);
+
+    /// Pairs found so far, most similar first
+    std::vector<ClonePair> pairs() const;
+
+    std::size_t functions() const { return sizes_.size(); }
+
+private:
+    void winnow(const std::vector<std::uint64_t>& tokens);
+
+    double similarity_;
+    std::size_t minTokens_;
+    std::vector<std::uint32_t> sizes_;                                   // Fingerprints of each function, 0 when left out
+    std::unordered_map<std::uint64_t, std::vector<std::uint32_t>> index_; // Functions of each fingerprint
+    std::unordered_map<std::uint64_t, std::uint32_t> sequences_;         // First function of each whole sequence
+    std::vector<ClonePair> pairs_;
+
+    // Scratch reused across functions
+    std::vector<std::uint64_t> kgrams_;
+    std::vector<std::uint64_t> fingerprints_;
+    std::vector<std::size_t> window_;
+    std::vector<std::uint32_t> shared_; // Fingerprints shared with each earlier function
+    std::vector<std::uint32_t> touched_;
+};
+
+/**
+ * @brief Lists the near-duplicate functions of a set of files.
+ *
+ * @param files The files to look in.
+ * @param options The settings; cloneSimilarity and cloneMinTokens tune the search.
+ * @param out The stream the pairs are written to.
+ * @return int EXIT_SUCCESS.
+ *
+ * @details Functions are extracted as with -f, and the size budget, the sniffer, the time
+ * budget and -P apply to each file. Only the pairs are written, no metrics.
+ */
+int runClones(const std::vector<std::filesystem::path>& files, const ProgramOptions& options, std::ostream& out = std::cout);
+
+#endif // CLONES_HPP
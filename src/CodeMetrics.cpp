@@ -1,6 +1,7 @@
 /* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
 
 # include "CodeMetrics.hpp"
+# include "BatchMetrics.hpp"
 
 // Constructor for MetricsCalculator class
 MetricsCalculator::MetricsCalculator(const CodeStatistics& cs, const int lc) 
@@ -16,20 +17,47 @@ MetricsCalculator::MetricsCalculator(const CodeStatistics& cs, const int lc)
     calculateMetrics(); // Calculate all metrics upon initialization
 }
 
+// Constructor for MetricsCalculator class from token counts
+MetricsCalculator::MetricsCalculator(unsigned int un1, unsigned int un2, unsigned int tN1, unsigned int tN2, int conds, int lc)
+    : n1(un1), n2(un2), N1(tN1), N2(tN2), n(un1 + un2), N(tN1 + tN2), conditions(conds), linesOfCode(lc)
+{
+    calculateMetrics(); // Calculate all metrics upon initialization
+}
+
 // Method to calculate various code metrics
 void MetricsCalculator::calculateMetrics() {
-    volume = N * log2(n); // Calculate program volume
-    difficulty = (n1 / 2.0) * (N2 / static_cast<double>(n2)); // Calculate program difficulty
-    effort = volume * difficulty; // Calculate programming effort
-    timeRequired = effort / 18.0; // Calculate time required to develop
-    numberOfBugs = pow(effort, 2.0 / 3.0) / 3000.0; // Estimate number of bugs
-    cyclomaticComplexity = conditions + 1; // Calculate cyclomatic complexity
-    maintainabilityIndex = 171 - 5.2 * log(volume) - 0.23 * cyclomaticComplexity - 16.2 * log(linesOfCode); // Calculate maintainability index
+    // Use the batch kernels on a single unit so both paths share formulas and edge cases
+    const double in[] = {static_cast<double>(n1), static_cast<double>(n2), static_cast<double>(N1),
+                         static_cast<double>(N2), static_cast<double>(conditions), static_cast<double>(linesOfCode)};
+    double cyclomatic = 0, maintainability = 0;
+    computeMetrics(1, {&in[0], &in[1], &in[2], &in[3], &in[4], &in[5]},
+                   {&volume, &difficulty, &effort, &timeRequired, &numberOfBugs, &cyclomatic, &maintainability});
+    cyclomaticComplexity = static_cast<int>(cyclomatic); // Conditions + 1
+    maintainabilityIndex = static_cast<int>(maintainability); // Truncated toward zero
 }
 
 // Method to report the calculated metrics
-void MetricsCalculator::report(int verbosity, const std::string& filePath, int loc, CodeStatistics& cs) const {
-    std::ostringstream reportStream; // Stream to build the report
+void MetricsCalculator::report(int verbosity, const std::string& filePath, int loc, const CodeStatistics& cs, std::ostream& out) const {
+    writeReport(out, verbosity, getMetrics(), summarize(cs));
+}
+
+// Captures the per-category counts needed by the report
+StatisticsSummary summarize(const CodeStatistics& cs) {
+    StatisticsSummary summary;
+    for (std::size_t i = 0; i < CodeStatistics::NumCategories; ++i) {
+        auto category = static_cast<StatsCategory>(i);
+        summary.counts[i] = cs.getCounterValue(category);
+        summary.uniques[i] = cs.getCSSetSize(category);
+    }
+    summary.operators = cs.getOperators();
+    summary.uniqueOperators = cs.getUniqueOperators();
+    summary.operands = cs.getOperands();
+    summary.uniqueOperands = cs.getUniqueOperands();
+    return summary;
+}
+
+// Writes the report of already calculated metrics
+void writeReport(std::ostream& out, int verbosity, const HalsteadMetrics& m, const StatisticsSummary& summary) {
     const int nameWidth = 45; // Column width for metric names
     const int valueWidth = 15; // Column width for metric values
 
@@ -46,40 +74,49 @@ void MetricsCalculator::report(int verbosity, const std::string& filePath, int l
         return ss.str();
     };
 
+    // Lambda to format the occurrences and unique tokens of a category
+    auto formatCategory = [&](const std::string& name, StatsCategory category) {
+        auto i = static_cast<std::size_t>(category);
+        return formatMetric(name, summary.counts[i], std::to_string(summary.uniques[i]) + " unique");
+    };
+
     // Generate report based on verbosity level
     // Default verbosity level is 1
-    reportStream << formatMetric("Effort", effort) << formatMetric("Volume", volume)
-                    << formatMetric("Conditions", conditions) << formatMetric("Cyclomatic Complexity", cyclomaticComplexity)
-                    << formatMetric("Difficulty", difficulty) << formatMetric("Time Required", timeRequired, "seconds")
-                    << formatMetric("Bugs", numberOfBugs, "delivered") << formatMetric("Maintainability", maintainabilityIndex)
-                    << std::string(80, '-') << "\n";
+    out << formatMetric("Effort", m.effort) << formatMetric("Volume", m.volume)
+        << formatMetric("Conditions", m.conditions) << formatMetric("Cyclomatic Complexity", m.cyclomaticComplexity)
+        << formatMetric("Difficulty", m.difficulty) << formatMetric("Time Required", m.timeRequired, "seconds")
+        << formatMetric("Bugs", m.numberOfBugs, "delivered") << formatMetric("Maintainability", m.maintainabilityIndex)
+        << std::string(80, '-') << "\n";
 
     if (verbosity > 2) {
         // Detailed metrics
-        reportStream << "Detailed Metrics:\n" << std::string(80, '-') << "\n"
-                     << formatMetric("n1 (unique operators)", n1) << formatMetric("n2 (unique operands)", n2)
-                     << formatMetric("N1 (total # operators)", N1) << formatMetric("N2 (total # operands)", N2)
-                     << std::string(80, '-') << "\n";
+        out << "Detailed Metrics:\n" << std::string(80, '-') << "\n"
+            << formatMetric("n1 (unique operators)", m.n1) << formatMetric("n2 (unique operands)", m.n2)
+            << formatMetric("N1 (total # operators)", m.N1) << formatMetric("N2 (total # operands)", m.N2)
+            << std::string(80, '-') << "\n";
     }
 
     if (verbosity > 1) {
         // Additional statistics
-        reportStream << "Additional Statistics:\n" << std::string(80, '-') << "\n";
-        reportStream << formatMetric("Types", cs.getCounterValue(StatsCategory::TYPE), std::to_string(cs.getCSSetSize(StatsCategory::TYPE)) + " unique")
-                        << formatMetric("Constants", cs.getCounterValue(StatsCategory::CONSTANT), std::to_string(cs.getCSSetSize(StatsCategory::CONSTANT)) + " unique")
-                        << formatMetric("Identifiers", cs.getCounterValue(StatsCategory::IDENTIFIER), std::to_string(cs.getCSSetSize(StatsCategory::IDENTIFIER)) + " unique")
-                        << formatMetric("Cspecs", cs.getCounterValue(StatsCategory::CSPECIFIER), std::to_string(cs.getCSSetSize(StatsCategory::CSPECIFIER)) + " unique")
-                        << formatMetric("Keywords", cs.getCounterValue(StatsCategory::KEYWORD), std::to_string(cs.getCSSetSize(StatsCategory::KEYWORD)) + " unique")
-                        << formatMetric("Keywords (API)", cs.getCounterValue(StatsCategory::APIKEYWORD), std::to_string(cs.getCSSetSize(StatsCategory::APIKEYWORD)) + " unique")
-                        << formatMetric("Keywords (API Low Level)", cs.getCounterValue(StatsCategory::APILLKEYWORD), std::to_string(cs.getCSSetSize(StatsCategory::APILLKEYWORD)) + " unique")
-                        << formatMetric("Keywords (Dev)", cs.getCounterValue(StatsCategory::CUSTOMKEYWORD), std::to_string(cs.getCSSetSize(StatsCategory::CUSTOMKEYWORD)) + " unique")
-                        << formatMetric("Operators", cs.getOperators(), std::to_string(cs.getUniqueOperators()) + " unique")
-                        << formatMetric("Operands", cs.getOperands(), std::to_string(cs.getUniqueOperands()) + " unique")
-                        << std::string(80, '-') << "\n";
+        out << "Additional Statistics:\n" << std::string(80, '-') << "\n";
+        out << formatCategory("Types", StatsCategory::TYPE)
+            << formatCategory("Constants", StatsCategory::CONSTANT)
+            << formatCategory("Identifiers", StatsCategory::IDENTIFIER)
+            << formatCategory("Cspecs", StatsCategory::CSPECIFIER)
+            << formatCategory("Keywords", StatsCategory::KEYWORD)
+            << formatCategory("Keywords (API)", StatsCategory::APIKEYWORD)
+            << formatCategory("Keywords (API Low Level)", StatsCategory::APILLKEYWORD)
+            << formatCategory("Keywords (Dev)", StatsCategory::CUSTOMKEYWORD)
+            << formatMetric("Operators", summary.operators, std::to_string(summary.uniqueOperators) + " unique")
+            << formatMetric("Operands", summary.operands, std::to_string(summary.uniqueOperands) + " unique")
+            << std::string(80, '-') << "\n";
     }
+}
 
-    // Output the final report
-    std::cout << reportStream.str();
+// Method to return the calculated metrics as plain values
+HalsteadMetrics MetricsCalculator::getMetrics() const {
+    return {n1, n2, N1, N2, volume, difficulty, effort, timeRequired, numberOfBugs,
+            conditions, cyclomaticComplexity, linesOfCode, maintainabilityIndex};
 }
 
 
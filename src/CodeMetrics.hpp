@@ -6,6 +6,7 @@
 #include <string>
 #include <vector>
 #include <filesystem>
+#include <array>
 #include <cmath>
 #include <iostream>
 
@@ -14,6 +15,65 @@
 using namespace c3ms;
 typedef c3ms::CodeStatistics::StatsCategory StatsCategory;
 
+/**
+ * @struct HalsteadMetrics
+ * 
+ * @brief Plain values of the metrics computed by MetricsCalculator.
+ * 
+ * @details This struct carries no references to the code statistics, so it can be copied
+ * out of the library and handed to callers or across the C ABI.
+ */
+struct HalsteadMetrics {
+    unsigned int n1; ///< Number of unique operators.
+    unsigned int n2; ///< Number of unique operands.
+    unsigned int N1; ///< Total number of operators.
+    unsigned int N2; ///< Total number of operands.
+    double volume; ///< Halstead volume.
+    double difficulty; ///< Halstead difficulty.
+    double effort; ///< Halstead effort.
+    double timeRequired; ///< Time required to program.
+    double numberOfBugs; ///< Estimated number of bugs.
+    int conditions; ///< Number of conditions in the code.
+    int cyclomaticComplexity; ///< Cyclomatic complexity.
+    int linesOfCode; ///< Lines of code.
+    int maintainabilityIndex; ///< Maintainability index.
+};
+
+/**
+ * @struct StatisticsSummary
+ * 
+ * @brief Token counts of a CodeStatistics needed to write a report.
+ * 
+ * @details Capturing these counts lets a report be formatted later, on another thread,
+ * after the code statistics have been reset or reused.
+ */
+struct StatisticsSummary {
+    std::array<std::size_t, CodeStatistics::NumCategories> counts; ///< Occurrences per category.
+    std::array<std::size_t, CodeStatistics::NumCategories> uniques; ///< Unique tokens per category.
+    std::size_t operators; ///< Total number of operators.
+    std::size_t uniqueOperators; ///< Number of unique operators.
+    std::size_t operands; ///< Total number of operands.
+    std::size_t uniqueOperands; ///< Number of unique operands.
+};
+
+/**
+ * @brief Captures the counts of the given code statistics needed by a report.
+ * 
+ * @param cs The code statistics.
+ * @return StatisticsSummary The captured counts.
+ */
+StatisticsSummary summarize(const CodeStatistics& cs);
+
+/**
+ * @brief Writes a report of already calculated metrics.
+ * 
+ * @param out The stream the report is written to.
+ * @param verbosity The level of verbosity for the report.
+ * @param metrics The calculated metrics.
+ * @param summary The token counts for the additional statistics.
+ */
+void writeReport(std::ostream& out, int verbosity, const HalsteadMetrics& metrics, const StatisticsSummary& summary);
+
 /**
  * @class MetricsCalculator
  * 
@@ -34,6 +94,18 @@ public:
          */
         MetricsCalculator(const CodeStatistics& cs, int lc);
 
+        /**
+         * @brief Constructor that initializes the metrics from token counts, such as estimated ones.
+         * 
+         * @param un1 The number of unique operators.
+         * @param un2 The number of unique operands.
+         * @param tN1 The total number of operators.
+         * @param tN2 The total number of operands.
+         * @param conds The number of conditions.
+         * @param lc The number of lines of code.
+         */
+        MetricsCalculator(unsigned int un1, unsigned int un2, unsigned int tN1, unsigned int tN2, int conds, int lc);
+
         /**
          * @brief Calculates the metrics.
          */
@@ -46,8 +118,16 @@ public:
          * @param filePath The path of the file for which the metrics are calculated.
          * @param loc The number of lines of code.
          * @param cs The code statistics.
+         * @param out The stream the report is written to.
+         */
+        void report(int verbosity, const std::string& filePath, int loc, const CodeStatistics& cs, std::ostream& out = std::cout) const;
+
+        /**
+         * @brief Returns all calculated metrics as plain values.
+         * 
+         * @return The calculated metrics.
          */
-        void report(int verbosity, const std::string& filePath, int loc, CodeStatistics& cs) const;
+        HalsteadMetrics getMetrics() const;
 
         /**
          * @brief Returns the Halstead volume.
@@ -41,15 +41,20 @@ void deleteTemporaryFile(const std::string& filename) {
 
 // Prints a formatted header for output sections
 void printHeader(const std::string& title, const std::string& color) {
-    std::cout << color; // Set the desired color for the header
-    std::cout << "\n" << std::string(80, '=') << "\n"; // Print a line of '=' characters
-    std::cout << title << "\n"; // Print the title of the header
-    std::cout << std::string(80, '=') << "\n"; // Print another line of '=' characters
-    std::cout << RESET; // Reset the color to default
+    printHeader(std::cout, title, color);
+}
+
+// Prints a formatted header for output sections to the given stream
+void printHeader(std::ostream& out, const std::string& title, const std::string& color) {
+    out << color; // Set the desired color for the header
+    out << "\n" << std::string(80, '=') << "\n"; // Print a line of '=' characters
+    out << title << "\n"; // Print the title of the header
+    out << std::string(80, '=') << "\n"; // Print another line of '=' characters
+    out << RESET; // Reset the color to default
 }
 
 // Parses command-line arguments and returns a vector of file paths
-std::vector<std::filesystem::path> parseArguments(int argc, char* argv[], int& verbosity, bool& functionMetricsFlag, bool& fileMetricsFlag, bool& globalMetricsFlag, bool& printCodeFlag) {
+std::vector<std::filesystem::path> parseArguments(int argc, char* argv[], ProgramOptions& options) {
     std::vector<std::filesystem::path> filepaths; // Vector to store parsed file paths
 
     // Loop through all command-line arguments
@@ -58,15 +63,113 @@ std::vector<std::filesystem::path> parseArguments(int argc, char* argv[], int& v
 
         // Check if the argument is verbosity flag and next argument is available
         if ((arg == "-v" || arg == "--verbosity") && i + 1 < argc) {
-            verbosity = std::stoi(argv[++i]); // Set verbosity level, converting string to integer
+            options.verbosity = std::stoi(argv[++i]); // Set verbosity level, converting string to integer
         } else if (arg == "-f" || arg == "--function-metrics") {
-            functionMetricsFlag = true; // Enable function metrics analysis
+            options.functionMetrics = true; // Enable function metrics analysis
         } else if (arg == "-a" || arg == "--file-metrics") {
-            fileMetricsFlag = true; // Enable file metrics analysis
+            options.fileMetrics = true; // Enable file metrics analysis
         } else if (arg == "-g" || arg == "--global-metrics") {
-            globalMetricsFlag = true; // Enable global metrics analysis
+            options.globalMetrics = true; // Enable global metrics analysis
         } else if (arg == "-p" || arg == "--print-functions") {
-            printCodeFlag = true; // Enable printing of function contents
+            options.printCode = true; // Enable printing of function contents
+        } else if (arg == "--max-size" && i + 1 < argc) {
+            options.limits.maxBytes = std::stoull(argv[++i]); // Per-file byte budget, 0 for none
+        } else if (arg == "--timeout" && i + 1 < argc) {
+            options.limits.timeoutSeconds = std::stod(argv[++i]); // Per-file time budget in seconds, 0 for none
+        } else if (arg == "--sniff") {
+            options.limits.sniff = true; // Skip binary, generated and minified files
+        } else if (arg == "--no-dedup") {
+            options.dedup = false; // Analyse every copy of identical files
+        } else if (arg == "--list-duplicates") {
+            options.listDuplicates = true; // List the groups of identical files
+        } else if (arg == "--dump-tokens" && i + 1 < argc) {
+            options.dumpTokens = argv[++i]; // Write the classified token stream
+        } else if (arg == "--replay" && i + 1 < argc) {
+            options.replayTokens = argv[++i]; // Rebuild the metrics from a token stream
+        } else if (arg == "--history" && i + 1 < argc) {
+            options.history = argv[++i]; // Global metrics for each commit of a range
+        } else if (arg == "--repo" && i + 1 < argc) {
+            options.repository = argv[++i]; // Git working tree for --history
+        } else if (arg == "--top" && i + 1 < argc) {
+            options.top = std::stoull(argv[++i]); // Only the highest ranked files and functions
+        } else if (arg == "--by" && i + 1 < argc) {
+            options.topBy = argv[++i]; // Metric for --top
+        } else if (arg == "--rollup") {
+            options.rollup = true; // Metrics for every directory above the files
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            options.checkpoint = argv[++i]; // Save the partial global results
+        } else if (arg == "--checkpoint-every" && i + 1 < argc) {
+            options.checkpointInterval = std::stod(argv[++i]); // Seconds between checkpoints
+        } else if (arg == "--resume") {
+            options.resume = true; // Carry on from the checkpoint
+        } else if (arg == "--clones") {
+            options.clones = true; // List near-duplicate functions
+        } else if (arg == "--clone-similarity" && i + 1 < argc) {
+            options.cloneSimilarity = std::stod(argv[++i]); // Least similarity of a clone pair
+        } else if (arg == "--clone-min-tokens" && i + 1 < argc) {
+            options.cloneMinTokens = std::stoull(argv[++i]); // Smallest function looked at for clones
+        } else if (arg == "--store" && i + 1 < argc) {
+            options.store = argv[++i]; // Save the file and function metrics as columns
+        } else if (arg == "--query" && i + 1 < argc) {
+            options.query = argv[++i]; // Query a result store
+        } else if (arg == "--where" && i + 1 < argc) {
+            options.queryWhere.emplace_back(argv[++i]); // Condition of a query
+        } else if (arg == "--in" && i + 1 < argc) {
+            options.queryWithin = argv[++i]; // Directory of the rows of a query
+        } else if (arg == "--kind" && i + 1 < argc) {
+            options.queryKind = argv[++i]; // File or function rows of a query
+        } else if (arg == "--sort" && i + 1 < argc) {
+            options.querySort = argv[++i]; // Sort key of a query
+        } else if (arg == "--group" && i + 1 < argc) {
+            options.queryGroup = argv[++i]; // Groups of a query
+        } else if (arg == "--agg" && i + 1 < argc) {
+            options.queryAggregates = argv[++i]; // Aggregates of the groups of a query
+        } else if (arg == "--limit" && i + 1 < argc) {
+            options.queryLimit = std::stoull(argv[++i]); // Rows a query writes at most
+        } else if (arg == "--api-index" && i + 1 < argc) {
+            options.apiIndex = argv[++i]; // Save the files and functions of each API token
+        } else if (arg == "--api-query" && i + 1 < argc) {
+            options.apiQuery = argv[++i]; // Look API tokens up in an index
+        } else if (arg == "--token" && i + 1 < argc) {
+            options.apiTokens.emplace_back(argv[++i]); // API token pattern to look up
+        } else if (arg == "--memory-report") {
+            options.memoryReport = true; // Print the arena usage of the statistics
+        } else if (arg == "--global-budget" && i + 1 < argc) {
+            options.globalBudget = std::stoull(argv[++i]); // Spill the global token tables above this
+        } else if (arg == "--spill-dir" && i + 1 < argc) {
+            options.spillDirectory = argv[++i]; // Directory of the spilled token tables
+        } else if (arg == "--workers" && i + 1 < argc) {
+            options.workers = std::stoull(argv[++i]); // Analyse the files in worker processes
+        } else if (arg == "--schedule" && i + 1 < argc) {
+            options.schedule = argv[++i]; // Order the files are handed to the workers in
+        } else if (arg == "--timings" && i + 1 < argc) {
+            options.timings = argv[++i]; // Per-file times of earlier runs
+        } else if (arg == "--function-cache" && i + 1 < argc) {
+            options.functionCache = argv[++i]; // Statistics of the functions of earlier runs
+        } else if (arg == "--heatmap" && i + 1 < argc) {
+            options.heatmapWindow = std::stoull(argv[++i]); // Lines of the heatmap windows
+        } else if (arg == "--heat-regions" && i + 1 < argc) {
+            options.heatRegions = std::stoull(argv[++i]); // Hottest windows listed per file
+        } else if (arg == "--read-ahead" && i + 1 < argc) {
+            options.readAhead = std::stoull(argv[++i]); // Read files ahead of the scanner
+        } else if (arg == "--io-threads" && i + 1 < argc) {
+            options.ioThreads = std::stoull(argv[++i]); // Threads reading ahead
+        } else if (arg == "--lex-threads" && i + 1 < argc) {
+            options.lexThreads = std::stoull(argv[++i]); // Lex large files in parallel chunks
+        } else if (arg == "--lex-chunk" && i + 1 < argc) {
+            options.lexChunk = std::stoull(argv[++i]); // Smallest chunk of a large file
+        } else if (arg == "--sample" && i + 1 < argc) {
+            options.sampleFraction = std::stod(argv[++i]); // Estimate global metrics from a fraction of the files
+        } else if (arg == "--seed" && i + 1 < argc) {
+            options.seed = std::stoull(argv[++i]); // Seed of the file sample
+        } else if (arg == "-P" || arg == "--preprocess") {
+            options.preprocess = true; // Skip inactive conditional branches
+        } else if ((arg == "-D" || arg == "-U") && i + 1 < argc) {
+            (arg == "-D" ? options.defines : options.undefines).emplace_back(argv[++i]); // Macro in the next argument
+            options.preprocess = true;
+        } else if (arg.size() > 2 && (arg.compare(0, 2, "-D") == 0 || arg.compare(0, 2, "-U") == 0)) {
+            (arg[1] == 'D' ? options.defines : options.undefines).push_back(arg.substr(2)); // Attached macro, as in -DNAME
+            options.preprocess = true;
         } else if (arg == "-h" || arg == "--help") {
             usage(); // Display usage information and exit
         } else {
@@ -80,26 +183,35 @@ std::vector<std::filesystem::path> parseArguments(int argc, char* argv[], int& v
 // Extracts functions from a given file and returns them as a vector
 std::vector<FunctionCode> extractFunctions(const std::string& filePath) {
     std::ifstream file(filePath); // Open the file for reading
-    std::string line; // Variable to hold each line of the file
-    std::vector<FunctionCode> functions; // Vector to store extracted functions
-    std::ostringstream currentFunction; // Stream to build function code
-    bool inFunction = false; // Flag to track if currently parsing a function
-    int braceCount = 0; // Counter for open braces to detect function blocks
 
     // Check if the file is successfully opened
     if (!file.is_open()) {
         std::cerr << "No se pudo abrir el archivo: " << filePath << std::endl;
-        return functions; // Return an empty vector if file can't be opened
+        return {}; // Return an empty vector if file can't be opened
     }
 
-    // Regular expressions to match function signatures and names
-    std::regex functionPattern(
+    return extractFunctions(file);
+}
+
+// Extracts functions from a stream of source code and returns them as a vector
+std::vector<FunctionCode> extractFunctions(std::istream& file, const c3ms::AnalysisContext* context) {
+    std::string line; // Variable to hold each line of the file
+    std::vector<FunctionCode> functions; // Vector to store extracted functions
+    std::ostringstream currentFunction; // Stream to build function code
+    bool inFunction = false; // Flag to track if currently parsing a function
+    int braceCount = 0; // Counter for open braces to detect function blocks
+
+    // Regular expressions to match function signatures and names, compiled once and shared by all callers
+    static const std::regex functionPattern(
         R"(([\w\:\s\*\<\>\&\[\]]+\s+[\w\:\s\*\<\>\&\[\]]+\s*\([^)]*\)\s*(const)?\s*(noexcept)?\s*(override)?\s*)[\s\S]*?)"
     );
-    std::regex namePattern(R"(\b(\w+)\s*\([^)]*\)\s*\{)");
+    static const std::regex namePattern(R"(\b(\w+)\s*\([^)]*\)\s*\{)");
 
-    // Read the file line by line
+    // Read the file line by line, until the watchdog cancels the context
     while (std::getline(file, line)) {
+        if (context && context->cancelled()) {
+            break;
+        }
         if (inFunction) {
             // Count opening and closing braces
             braceCount += std::count(line.begin(), line.end(), '{');
@@ -151,13 +263,23 @@ int countLinesOfCode(const std::string& filePath) {
     return std::count(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>(), '\n');
 }
 
+// Counts and returns the number of lines of code in a buffer
+int countLines(std::string_view code) {
+    return std::count(code.begin(), code.end(), '\n');
+}
+
 // Prints usage information for the application
 void usage() {
     // Header
     std::cout << GREEN << "C++ Code Complexity Measurement System" << RESET << "\n\n";
 
     // Usage
-    std::cout << YELLOW << "Usage:" << RESET << " c3ms [-h] [-f] [-a] [-g] [-p DEBUG] [-v level] <files>\n\n";
+    std::cout << YELLOW << "Usage:" << RESET << " c3ms [-h] [-f] [-a] [-g] [-p DEBUG] [-P] [-D name[=value]] [-U name] [--max-size bytes] [--timeout seconds] [--sniff] [--no-dedup] [--list-duplicates] [--dump-tokens file] [--sample fraction] [--seed n] [--workers n] [--schedule mode] [--timings file] [--function-cache file] [--heatmap lines] [--heat-regions n] [--read-ahead n] [--io-threads n] [--lex-threads n] [--lex-chunk bytes] [--top n] [--by metric] [--rollup] [--checkpoint file] [--checkpoint-every seconds] [--resume] [--store file] [--api-index file] [--global-budget bytes] [--spill-dir dir] [--memory-report] [-v level] <files>\n"
+              << "       c3ms [-P] [-D name[=value]] [-U name] [--clone-similarity fraction] [--clone-min-tokens n] --clones <files>\n"
+              << "       c3ms [-a] [-g] [--top n] [--by metric] [--memory-report] [-v level] --replay file\n"
+              << "       c3ms [-P] [--repo dir] --history range\n"
+              << "       c3ms [--where condition]... [--in dir] [--kind kind] [--sort key] [--group by] [--agg list] [--limit n] --query file\n"
+              << "       c3ms [--token pattern]... [--in dir] [--kind kind] [--limit n] --api-query file\n\n";
 
     // Options
     std::cout << CYAN << "Options:" << RESET << "\n";
@@ -166,6 +288,54 @@ void usage() {
     std::cout << "-a, --file-metrics         " << MAGENTA << "Analyze and report metrics for each file" << RESET << "\n";
     std::cout << "-g, --global-metrics       " << MAGENTA << "Analyze and report global metrics across all files" << RESET << "\n";
     std::cout << "-p, --print-functions      " << MAGENTA << "Print the contents of each function (DEBUG)" << RESET << "\n";
+    std::cout << "-P, --preprocess           " << MAGENTA << "Skip inactive #if/#ifdef branches and report the bytes skipped" << RESET << "\n";
+    std::cout << "-D name[=value]            " << MAGENTA << "Define a macro for conditionals (implies -P)" << RESET << "\n";
+    std::cout << "-U name                    " << MAGENTA << "Undefine a macro for conditionals (implies -P)" << RESET << "\n";
+    std::cout << "--max-size [bytes]         " << MAGENTA << "Skip files larger than this (default 0, no limit)" << RESET << "\n";
+    std::cout << "--timeout [seconds]        " << MAGENTA << "Abandon files that take longer than this (default 0, no limit)" << RESET << "\n";
+    std::cout << "--sniff                    " << MAGENTA << "Skip binary, generated and minified files" << RESET << "\n";
+    std::cout << "--no-dedup                 " << MAGENTA << "Analyse files with identical contents separately" << RESET << "\n";
+    std::cout << "--list-duplicates          " << MAGENTA << "List the groups of files with identical contents" << RESET << "\n";
+    std::cout << "--dump-tokens [file]       " << MAGENTA << "Write the classified tokens of each file to a binary stream" << RESET << "\n";
+    std::cout << "--replay [file]            " << MAGENTA << "Report metrics from a token stream instead of scanning files" << RESET << "\n";
+    std::cout << "--sample [fraction]        " << MAGENTA << "Estimate global metrics with confidence intervals from a sample of the files" << RESET << "\n";
+    std::cout << "--seed [n]                 " << MAGENTA << "Seed of the file sample (default 1)" << RESET << "\n";
+    std::cout << "--workers [n]              " << MAGENTA << "Analyse the files in n worker processes; a file that crashes one is reported as failed" << RESET << "\n";
+    std::cout << "--schedule [mode]          " << MAGENTA << "Hand the files to the workers in input order (input) or largest first with work stealing (cost), and report the idle time" << RESET << "\n";
+    std::cout << "--timings [file]           " << MAGENTA << "Per-file times of earlier runs for --schedule cost, updated after the run" << RESET << "\n";
+    std::cout << "--function-cache [file]    " << MAGENTA << "With -f, lex only the functions changed since an earlier run and reuse the statistics of the others" << RESET << "\n";
+    std::cout << "--heatmap [lines]          " << MAGENTA << "Before each file report, list the ranges of this many lines with the most effort per line" << RESET << "\n";
+    std::cout << "--heat-regions [n]         " << MAGENTA << "Ranges listed by --heatmap for each file (default 5)" << RESET << "\n";
+    std::cout << "--read-ahead [n]           " << MAGENTA << "Read up to n files ahead of the scanner and report the time spent waiting on I/O (default 0, off)" << RESET << "\n";
+    std::cout << "--io-threads [n]           " << MAGENTA << "Threads reading files for --read-ahead (default 2)" << RESET << "\n";
+    std::cout << "--lex-threads [n]          " << MAGENTA << "Lex files of two chunks or more in up to n parallel chunks (default 1, 0 for one per core)" << RESET << "\n";
+    std::cout << "--lex-chunk [bytes]        " << MAGENTA << "Smallest chunk for --lex-threads (default 1 MiB)" << RESET << "\n";
+    std::cout << "--history [range]          " << MAGENTA << "Write a CSV row of global metrics for each commit of a git range" << RESET << "\n";
+    std::cout << "--repo [dir]               " << MAGENTA << "Git working tree for --history (default: current directory)" << RESET << "\n";
+    std::cout << "--top [n]                  " << MAGENTA << "Report only the n highest ranked files and functions, after the others are analysed" << RESET << "\n";
+    std::cout << "--by [metric]              " << MAGENTA << "Rank --top by effort, cyclomatic, volume or bugs (default effort)" << RESET << "\n";
+    std::cout << "--rollup                   " << MAGENTA << "Report metrics for every directory above the files, after the file reports" << RESET << "\n";
+    std::cout << "--checkpoint [file]        " << MAGENTA << "Save the partial global results to this file as the run goes" << RESET << "\n";
+    std::cout << "--checkpoint-every [secs]  " << MAGENTA << "Least time between two checkpoints (default 60, 0 after every file)" << RESET << "\n";
+    std::cout << "--resume                   " << MAGENTA << "Carry on from the --checkpoint file, skipping the files it holds" << RESET << "\n";
+    std::cout << "--clones                   " << MAGENTA << "List pairs of near-duplicate functions instead of reporting metrics" << RESET << "\n";
+    std::cout << "--clone-similarity [f]     " << MAGENTA << "Least similarity of a listed pair, from 0 to 1 (default 0.8)" << RESET << "\n";
+    std::cout << "--clone-min-tokens [n]     " << MAGENTA << "Leave out functions with fewer tokens from --clones (default 50)" << RESET << "\n";
+    std::cout << "--store [file]             " << MAGENTA << "Save the file and function metrics of the run as columns, for --query" << RESET << "\n";
+    std::cout << "--query [file]             " << MAGENTA << "Write the rows of a --store file as CSV instead of analysing files" << RESET << "\n";
+    std::cout << "--where [condition]        " << MAGENTA << "Keep the rows where a metric passes a comparison, such as cyclomatic>15; repeatable" << RESET << "\n";
+    std::cout << "--in [dir]                 " << MAGENTA << "Keep the rows of the files under a directory" << RESET << "\n";
+    std::cout << "--kind [kind]              " << MAGENTA << "Keep only the file or only the function rows" << RESET << "\n";
+    std::cout << "--sort [key]               " << MAGENTA << "Sort by a metric, or an aggregate with --group, highest first; add :asc for lowest first" << RESET << "\n";
+    std::cout << "--group [by]               " << MAGENTA << "Aggregate the rows of each file, dir or kind" << RESET << "\n";
+    std::cout << "--agg [list]               " << MAGENTA << "Aggregates of each group, such as count,sum:effort,max:cyclomatic (default count)" << RESET << "\n";
+    std::cout << "--limit [n]                " << MAGENTA << "Write at most n rows or groups" << RESET << "\n";
+    std::cout << "--api-index [file]         " << MAGENTA << "Save the files and functions each API token occurs in, for --api-query" << RESET << "\n";
+    std::cout << "--api-query [file]         " << MAGENTA << "Write the files and functions of API tokens from an --api-index file as CSV" << RESET << "\n";
+    std::cout << "--token [pattern]          " << MAGENTA << "API token to look up, * and ? as wildcards, such as _mm256_*; repeatable (default: list every token)" << RESET << "\n";
+    std::cout << "--global-budget [bytes]    " << MAGENTA << "Spill the global token tables to disk above this much memory and merge them for exact global metrics (default 0, no limit)" << RESET << "\n";
+    std::cout << "--spill-dir [dir]          " << MAGENTA << "Directory for --global-budget (default: the system temporary directory)" << RESET << "\n";
+    std::cout << "--memory-report            " << MAGENTA << "Print the high-water marks of the token table arenas" << RESET << "\n";
     std::cout << "-v, --verbosity [level]    " << MAGENTA << "Set verbosity level (1-3)" << RESET << "\n\n";
 
     // Verbosity levels
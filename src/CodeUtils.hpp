@@ -4,10 +4,12 @@
 #define CODE_UTILS_HPP
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <filesystem>
 #include <stdexcept>
 #include <iostream>
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
 #include <cerrno>
@@ -15,6 +17,8 @@
 #include <unistd.h>
 #include <regex>
 
+#include "InputGuard.hpp"
+
 // ANSI color codes
 const std::string RED = "\033[31m";
 const std::string GREEN = "\033[32m";
@@ -76,15 +80,80 @@ void deleteTemporaryFile(const std::string& filename);
  */
 void printHeader(const std::string& title, const std::string& color);
 
+/**
+ * @brief Prints a formatted header with a title and color to the given stream.
+ * 
+ * @param out The stream the header is written to.
+ * @param title The title to be printed in the header.
+ * @param color The color to be used for the header text.
+ */
+void printHeader(std::ostream& out, const std::string& title, const std::string& color);
+
+/**
+ * @struct ProgramOptions
+ *
+ * @brief Settings given on the command line.
+ */
+struct ProgramOptions {
+    int verbosity = 1; ///< Verbosity level of the reports.
+    bool functionMetrics = false; ///< Report metrics for each function.
+    bool fileMetrics = false; ///< Report metrics for each file.
+    bool globalMetrics = false; ///< Report metrics across all files.
+    bool printCode = false; ///< Print the contents of each function (DEBUG).
+    bool preprocess = false; ///< Skip inactive conditional branches.
+    std::vector<std::string> defines; ///< Macros given with -D, as NAME or NAME=VALUE.
+    std::vector<std::string> undefines; ///< Macros given with -U.
+    InputLimits limits; ///< Per-file size and time budgets.
+    bool dedup = true; ///< Analyse files with identical contents only once.
+    bool listDuplicates = false; ///< List the groups of identical files.
+    std::string dumpTokens; ///< File the classified token stream is written to.
+    std::string replayTokens; ///< Token stream to rebuild the metrics from, instead of scanning files.
+    double sampleFraction = 0; ///< Fraction of files to analyse for estimated global metrics, 0 for all.
+    std::uint64_t seed = 1; ///< Seed of the file sample.
+    bool memoryReport = false; ///< Print the arena usage of the statistics after the reports.
+    std::size_t globalBudget = 0; ///< Memory the global token tables may hold before they are spilled to disk, in bytes; 0 for no limit.
+    std::string spillDirectory; ///< Directory the spilled token tables are written to; the system temporary directory when empty.
+    bool rollup = false; ///< Report metrics for every directory above the files.
+    std::size_t top = 0; ///< Report only this many files and functions, the highest ranked; 0 for all.
+    std::string topBy = "effort"; ///< Metric the files and functions are ranked by.
+    std::size_t workers = 0; ///< Worker processes analysing the files, 0 to analyse them in this one.
+    std::string schedule; ///< How files are handed to the workers: input or cost; empty to collect them in input order as they go.
+    std::string timings; ///< File of the time each file took in earlier runs, read for --schedule cost and updated after the run.
+    std::string functionCache; ///< File of the statistics of functions analysed in earlier runs, reused for the unchanged ones.
+    std::size_t heatmapWindow = 0; ///< Lines of the ranges the hottest parts of each file are found with; 0 for no heatmap.
+    std::size_t heatRegions = 5; ///< Hottest ranges listed for each file.
+    std::size_t readAhead = 0; ///< Files read ahead of the scanner, 0 to read each file when it is scanned.
+    std::size_t ioThreads = 2; ///< Threads reading files ahead of the scanner.
+    std::size_t lexThreads = 1; ///< Threads lexing the chunks of a large file, 0 for one per core.
+    std::size_t lexChunk = 1 << 20; ///< Smallest chunk a file is split into, in bytes.
+    std::string checkpoint; ///< File the partial global results are saved to, for --resume.
+    double checkpointInterval = 60; ///< Least time between two checkpoints, in seconds.
+    bool resume = false; ///< Carry on from the checkpoint instead of starting over.
+    bool clones = false; ///< List near-duplicate functions instead of reporting metrics.
+    double cloneSimilarity = 0.8; ///< Least similarity of a reported pair of functions.
+    std::size_t cloneMinTokens = 50; ///< Functions with fewer tokens are not looked at for clones.
+    std::string store; ///< File the file and function metrics are saved to as columns, for --query.
+    std::string query; ///< Result store to query, instead of analysing files.
+    std::vector<std::string> queryWhere; ///< Conditions on the metrics of the rows of a query.
+    std::string queryWithin; ///< Directory the files of the rows of a query lie under.
+    std::string queryKind; ///< Only the file or only the function rows of a query.
+    std::string querySort; ///< Metric, or aggregate with --group, the rows of a query are sorted by.
+    std::string queryGroup; ///< What the rows of a query are grouped by: file, dir or kind.
+    std::string queryAggregates = "count"; ///< Aggregates of each group of a query.
+    std::size_t queryLimit = 0; ///< Rows or groups a query writes at most, 0 for all.
+    std::string apiIndex; ///< File the files and functions of each API token are saved to, for --api-query.
+    std::string apiQuery; ///< API index to look tokens up in, instead of analysing files.
+    std::vector<std::string> apiTokens; ///< Patterns of the API tokens to look up.
+    std::string history; ///< Range of commits to write global metrics for, instead of analysing files.
+    std::string repository = "."; ///< Git working tree the history is read from.
+};
+
 /**
  * @brief Parses command-line arguments and returns a vector of file paths.
  * 
  * @param argc The number of command-line arguments.
  * @param argv The array of command-line arguments.
- * @param verbosity The verbosity level to be set based on the arguments.
- * @param functionMetricsFlag A flag to be set if function-level metrics are requested.
- * @param fileMetricsFlag A flag to be set if file-level metrics are requested.
- * @param globalMetricsFlag A flag to be set if global metrics are requested.
+ * @param options The settings to be filled from the arguments.
  * @return std::vector<std::filesystem::path> A vector of file paths to be analyzed.
  * 
  * @details This function parses the command-line arguments provided to the program. 
@@ -92,11 +161,34 @@ void printHeader(const std::string& title, const std::string& color);
  * '-f' or '--function-metrics' to request function-level metrics, 
  * '-a' or '--file-metrics' to request file-level metrics, 
  * '-g' or '--global-metrics' to request global metrics, 
+ * '-P' or '--preprocess' to skip inactive conditional branches, 
+ * '-D NAME[=VALUE]' and '-U NAME' to define and undefine macros (both imply '-P'), 
+ * '--max-size' and '--timeout' to set the per-file budgets, '--sniff' to skip binary-looking, 
+ * generated and minified files, '--no-dedup' to analyse identical files separately, 
+ * '--list-duplicates' to list the groups of identical files, 
+ * '--dump-tokens FILE' and '--replay FILE' to write and replay the classified token stream, 
+ * '--sample FRACTION' and '--seed N' to estimate global metrics from a random sample of the files, 
+ * '--memory-report' to print the arena usage of the statistics, 
+ * '--global-budget BYTES' and '--spill-dir DIR' to spill the global token tables to disk above a memory budget, 
+ * '--rollup' to report metrics for every directory above the files, 
+ * '--top N' and '--by METRIC' to report only the N highest ranked files and functions, 
+ * '--workers N' to analyse the files in N worker processes that survive crashes of each other, 
+ * '--schedule MODE' and '--timings FILE' to hand the files to the workers by estimated cost and report their idle time, 
+ * '--function-cache FILE' to reuse the statistics of functions unchanged since an earlier run, 
+ * '--heatmap LINES' and '--heat-regions N' to list the N ranges of LINES lines with the most effort per line in each file, 
+ * '--read-ahead N' and '--io-threads N' to read up to N files ahead of the scanner on I/O threads, 
+ * '--lex-threads N' and '--lex-chunk BYTES' to lex large files in parallel chunks, 
+ * '--checkpoint FILE', '--checkpoint-every SECONDS' and '--resume' to save the partial global results and carry on from them, 
+ * '--clones', '--clone-similarity FRACTION' and '--clone-min-tokens N' to list near-duplicate functions, 
+ * '--store FILE' to save the file and function metrics as columns, and '--query FILE' with '--where COND', '--in DIR', 
+ * '--kind KIND', '--sort KEY', '--group BY', '--agg LIST' and '--limit N' to filter, sort and aggregate them, 
+ * '--api-index FILE' to save the files and functions of each API token, and '--api-query FILE' with '--token PATTERN' to look them up, 
+ * '--history RANGE' and '--repo DIR' to write global metrics for each commit of a git range, 
  * and '-h' or '--help' to display usage information. 
  * Any other arguments are treated as file paths to be analyzed. 
  * The function returns a vector of these file paths.
  */
-std::vector<std::filesystem::path> parseArguments(int argc, char* argv[], int& verbosity, bool& functionMetricsFlag, bool& fileMetricsFlag, bool& globalMetricsFlag, bool& printCodeFlag);
+std::vector<std::filesystem::path> parseArguments(int argc, char* argv[], ProgramOptions& options);
 
 /**
  * @brief Extracts all functions from a given source code file.
@@ -111,6 +203,18 @@ std::vector<std::filesystem::path> parseArguments(int argc, char* argv[], int& v
  */
 std::vector<FunctionCode> extractFunctions(const std::string& filePath);
 
+/**
+ * @brief Extracts all functions from a stream of source code.
+ * 
+ * @param input Stream with the source code.
+ * @param context When given, extraction stops between lines once the context is cancelled,
+ * so the watchdog also bounds the regular expressions; the functions found so far are returned.
+ * @return std::vector<FunctionCode> Vector with the name and code of each function found.
+ * 
+ * @details Same extraction as the file-based overload, for code that is already in memory.
+ */
+std::vector<FunctionCode> extractFunctions(std::istream& input, const c3ms::AnalysisContext* context = nullptr);
+
 /**
  * @brief Counts the number of lines of code in a file.
  * 
@@ -123,6 +227,14 @@ std::vector<FunctionCode> extractFunctions(const std::string& filePath);
  */
 int countLinesOfCode(const std::string& filePath);
 
+/**
+ * @brief Counts the number of lines of code in an in-memory buffer.
+ * 
+ * @param code The source code to be analyzed.
+ * @return int The number of newline characters in the buffer.
+ */
+int countLines(std::string_view code);
+
 /**
  * @brief Prints usage information and exits the program.
  * 
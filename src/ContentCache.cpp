@@ -0,0 +1,210 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#include "ContentCache.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "CodeUtils.hpp"
+
+namespace {
+
+inline std::uint64_t rotl(std::uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Final avalanche of MurmurHash3
+inline std::uint64_t fmix(std::uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+// Fixed-width fields, in the layout of this binary, as encodeUnit() writes them
+template <typename T>
+bool get(std::string_view& data, T& value) {
+    if (data.size() < sizeof(value)) {
+        return false;
+    }
+    std::memcpy(&value, data.data(), sizeof(value));
+    data.remove_prefix(sizeof(value));
+    return true;
+}
+
+bool getString(std::string_view& data, std::string& text) {
+    std::size_t size = 0;
+    if (!get(data, size) || size > data.size()) {
+        return false;
+    }
+    text.assign(data.data(), size);
+    data.remove_prefix(size);
+    return true;
+}
+
+// Records point to the color constants, so a color is written as its escape sequence
+const std::string* findColor(const std::string& sequence) {
+    for (const std::string* color : {&RED, &GREEN, &YELLOW, &BLUE, &MAGENTA, &CYAN}) {
+        if (*color == sequence) {
+            return color;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace
+
+// Two MurmurHash3-style lanes over 8-byte words, seeded differently
+ContentKey hashContent(std::string_view code) {
+    const std::uint64_t c1 = 0x87c37b91114253d5ULL;
+    const std::uint64_t c2 = 0x4cf5ad432745937fULL;
+    std::uint64_t h1 = 0x9e3779b97f4a7c15ULL ^ code.size();
+    std::uint64_t h2 = 0xc2b2ae3d27d4eb4fULL ^ code.size();
+
+    const char* p = code.data();
+    std::size_t words = code.size() / 8;
+    for (std::size_t i = 0; i < words; ++i, p += 8) {
+        std::uint64_t k;
+        std::memcpy(&k, p, 8);
+        h1 ^= rotl(k * c1, 31) * c2;
+        h1 = rotl(h1, 27) * 5 + 0x52dce729;
+        h2 ^= rotl(k * c2, 33) * c1;
+        h2 = rotl(h2, 31) * 5 + 0x38495ab5;
+    }
+
+    std::uint64_t tail = 0;
+    if (code.size() % 8) {
+        std::memcpy(&tail, p, code.size() % 8);
+    }
+    h1 ^= rotl(tail * c1, 31) * c2;
+    h2 ^= rotl(tail * c2, 33) * c1;
+
+    return {code.size(), fmix(h1 + h2), fmix(h2 ^ rotl(h1, 17))};
+}
+
+// Groups the inputs by size
+ContentCache::ContentCache(const std::vector<std::filesystem::path>& files)
+    : files_(files), sizes_(files.size()), candidates_(files.size(), false)
+{
+    std::unordered_map<std::uint64_t, std::size_t> counts;
+    std::vector<bool> readable(files.size(), false);
+    for (std::size_t unit = 0; unit < files.size(); ++unit) {
+        std::error_code error;
+        auto size = std::filesystem::file_size(files[unit], error);
+        if (!error) {
+            sizes_[unit] = size;
+            readable[unit] = true;
+            ++counts[size];
+        }
+    }
+    for (std::size_t unit = 0; unit < files.size(); ++unit) {
+        if (readable[unit] && counts[sizes_[unit]] > 1) {
+            candidates_[unit] = true;
+            ++remaining_[sizes_[unit]];
+        }
+    }
+}
+
+bool ContentCache::candidate(std::size_t unit) const {
+    return unit < candidates_.size() && candidates_[unit];
+}
+
+// Looks up an earlier file with the same fingerprint and the same bytes
+const CachedUnit* ContentCache::find(const ContentKey& key, std::string_view code, std::size_t unit) {
+    auto bucket = entries_.find(key.size);
+    if (bucket == entries_.end()) {
+        return nullptr;
+    }
+    for (auto& entry : bucket->second) {
+        if (entry.key == key && sameContents(entry.units.front(), code)) {
+            entry.units.push_back(unit);
+            ++duplicateFiles_;
+            duplicateBytes_ += key.size;
+            return &entry.results;
+        }
+    }
+    return nullptr;
+}
+
+// Whether a unit still holds the given contents; fingerprints of different contents may collide,
+// and reading the earlier file again costs less than analysing the copy
+bool ContentCache::sameContents(std::size_t unit, std::string_view code) {
+    return c3ms::read_file_into(files_[unit].string(), original_) && std::string_view(original_) == code;
+}
+
+// Stores the results of a first occurrence
+void ContentCache::insert(const ContentKey& key, std::size_t unit, CachedUnit&& results) {
+    entries_[key.size].push_back({key, {unit}, std::move(results)});
+}
+
+// Releases the cached results of a size once all of its files are processed
+void ContentCache::done(std::size_t unit) {
+    if (!candidate(unit)) {
+        return;
+    }
+    auto remaining = remaining_.find(sizes_[unit]);
+    if (remaining == remaining_.end() || --remaining->second > 0) {
+        return;
+    }
+    remaining_.erase(remaining);
+    auto bucket = entries_.find(sizes_[unit]);
+    if (bucket != entries_.end()) {
+        retire(bucket->second);
+        entries_.erase(bucket);
+    }
+}
+
+// Keeps the groups that had copies, for the listing
+void ContentCache::retire(std::vector<Entry>& entries) {
+    for (auto& entry : entries) {
+        if (entry.units.size() > 1) {
+            groups_.push_back(std::move(entry.units));
+        }
+    }
+}
+
+// Writes each group of identical files
+void ContentCache::listDuplicates(std::ostream& out, const std::vector<std::filesystem::path>& files) const {
+    // Groups still cached belong to units that were never processed, such as skipped ones
+    std::vector<std::vector<std::size_t>> groups = groups_;
+    for (const auto& [size, entries] : entries_) {
+        for (const auto& entry : entries) {
+            if (entry.units.size() > 1) {
+                groups.push_back(entry.units);
+            }
+        }
+    }
+    std::sort(groups.begin(), groups.end());
+
+    out << "\nDuplicate files: " << duplicateFiles_ << " (" << duplicateBytes_ << " bytes not analysed again)\n";
+    for (const auto& group : groups) {
+        out << files[group.front()].string() << "\n";
+        for (std::size_t i = 1; i < group.size(); ++i) {
+            out << "  = " << files[group[i]].string() << "\n";
+        }
+    }
+}
+
+// Units of the records are left for the caller to set
+bool decodeUnit(std::string_view data, CachedUnit& unit) {
+    std::size_t records = 0;
+    bool valid = get(data, unit.completed) && get(data, unit.linesOfCode) && get(data, unit.skipped.skippedBytes)
+              && get(data, unit.skipped.skippedRegions) && get(data, records);
+    unit.records.clear();
+    std::string color;
+    for (; valid && records > 0; --records) {
+        ReportRecord record;
+        std::size_t apis = 0;
+        valid = get(data, record.last) && getString(data, record.title) && getString(data, color)
+             && get(data, record.metrics) && get(data, record.summary) && getString(data, record.note) && get(data, apis);
+        for (; valid && apis > 0; --apis) {
+            auto& [token, occurrences] = record.apis.emplace_back();
+            valid = getString(data, token) && get(data, occurrences);
+        }
+        record.color = findColor(color);
+        unit.records.push_back(std::move(record));
+    }
+    return valid && unit.stats.deserialize(data);
+}
@@ -0,0 +1,184 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#ifndef CONTENT_CACHE_HPP
+#define CONTENT_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "bison-flex/analysiscontext.hh"
+#include "bison-flex/codestatistics.hh"
+#include "ReportWriter.hpp"
+
+/**
+ * @struct ContentKey
+ *
+ * @brief 128-bit fingerprint of a file's contents, plus its size.
+ */
+struct ContentKey {
+    std::uint64_t size = 0;
+    std::uint64_t low = 0;
+    std::uint64_t high = 0;
+
+    bool operator==(const ContentKey& other) const {
+        return size == other.size && low == other.low && high == other.high;
+    }
+};
+
+/**
+ * @brief Fingerprints a buffer with two independently seeded 64-bit hashes in a single pass.
+ *
+ * @param code The contents of the file.
+ * @return ContentKey The fingerprint.
+ */
+ContentKey hashContent(std::string_view code);
+
+/**
+ * @struct CachedUnit
+ *
+ * @brief Everything a file contributed to the run, kept to be replayed for its copies.
+ *
+ * @member completed Whether the analysis finished within its time budget.
+ * @member records The reports submitted for the file, functions first.
+ * @member stats The file statistics added to the global ones.
+ * @member linesOfCode The lines of code added to the global count.
+ * @member skipped The bytes and regions the preprocessor skipped.
+ */
+struct CachedUnit {
+    bool completed = false;
+    std::vector<ReportRecord> records;
+    c3ms::CodeStatistics stats;
+    int linesOfCode = 0;
+    c3ms::ScanReport skipped;
+};
+
+/**
+ * @brief Appends a CachedUnit to out, to hand it to another process of the same program.
+ *
+ * @details Metrics and summaries are copied as they lie in memory, so only the same binary can
+ * read them back; the statistics use their own compact form. Outcome and totals come first,
+ * then each record, then the statistics.
+ *
+ * @param unit The results.
+ * @param out Anything with push_back(char) and append(const char*, size), such as a std::string.
+ */
+template <typename Out>
+void encodeUnit(const CachedUnit& unit, Out& out) {
+    auto put = [&out](const auto& value) {
+        static_assert(std::is_trivially_copyable_v<std::decay_t<decltype(value)>>);
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    };
+    auto putString = [&out, &put](std::string_view text) {
+        put(text.size());
+        out.append(text.data(), text.size());
+    };
+    put(unit.completed);
+    put(unit.linesOfCode);
+    put(unit.skipped.skippedBytes);
+    put(unit.skipped.skippedRegions);
+    put(unit.records.size());
+    for (const auto& record : unit.records) {
+        put(record.last);
+        putString(record.title);
+        putString(record.color ? std::string_view(*record.color) : std::string_view());
+        put(record.metrics);
+        put(record.summary);
+        putString(record.note);
+        put(record.apis.size());
+        for (const auto& [token, occurrences] : record.apis) {
+            putString(token);
+            put(occurrences);
+        }
+    }
+    unit.stats.serialize(out);
+}
+
+/// Reads back what encodeUnit() wrote; false when the data is malformed
+bool decodeUnit(std::string_view data, CachedUnit& unit);
+
+/**
+ * @class ContentCache
+ *
+ * @brief Finds files with identical contents so each distinct content is analysed once.
+ *
+ * @details Files are first grouped by size, which only takes a stat per file. Only files that
+ * share their size with another input are fingerprinted and have their results cached, and the
+ * cached results of a size are released once every file of that size has been processed. A
+ * file whose fingerprint matches is compared byte for byte with the first file of that
+ * content before its results are reused, so a collision of fingerprints cannot swap results.
+ */
+class ContentCache {
+public:
+    /**
+     * @brief Groups the inputs by size.
+     *
+     * @param files The input files, indexed by unit. Files that cannot be read are ignored.
+     */
+    explicit ContentCache(const std::vector<std::filesystem::path>& files);
+
+    /**
+     * @brief Whether a unit may have copies, because another input has the same size.
+     */
+    bool candidate(std::size_t unit) const;
+
+    /**
+     * @brief Looks up the results of an earlier file with the same contents.
+     *
+     * @param key The fingerprint of the unit.
+     * @param code The contents of the unit, compared with the earlier file on a matching fingerprint.
+     * @param unit The unit being processed, recorded in its duplicate group.
+     * @return const CachedUnit* The cached results, or nullptr for a first occurrence.
+     */
+    const CachedUnit* find(const ContentKey& key, std::string_view code, std::size_t unit);
+
+    /**
+     * @brief Stores the results of the first file with some contents.
+     */
+    void insert(const ContentKey& key, std::size_t unit, CachedUnit&& results);
+
+    /**
+     * @brief Marks a unit as processed, releasing the cached results of its size when it was the last one.
+     */
+    void done(std::size_t unit);
+
+    /**
+     * @brief Writes every group of identical files, the analysed one first.
+     *
+     * @param out The stream the groups are written to.
+     * @param files The input files, indexed by unit.
+     */
+    void listDuplicates(std::ostream& out, const std::vector<std::filesystem::path>& files) const;
+
+    std::size_t duplicateFiles() const { return duplicateFiles_; }
+    std::uint64_t duplicateBytes() const { return duplicateBytes_; }
+
+private:
+    struct Entry {
+        ContentKey key;
+        std::vector<std::size_t> units;
+        CachedUnit results;
+    };
+
+    void retire(std::vector<Entry>& entries);
+    bool sameContents(std::size_t unit, std::string_view code);
+
+    std::vector<std::filesystem::path> files_;                       // Path of each unit
+    std::string original_;                                           // Contents of the earlier file being compared
+
+    std::vector<std::uint64_t> sizes_;                               // Size of each unit
+    std::vector<bool> candidates_;                                   // Units sharing their size
+    std::unordered_map<std::uint64_t, std::size_t> remaining_;       // Unprocessed candidates per size
+    std::unordered_map<std::uint64_t, std::vector<Entry>> entries_;  // Cached results per size
+    std::vector<std::vector<std::size_t>> groups_;                   // Retired groups with copies
+    std::size_t duplicateFiles_ = 0;
+    std::uint64_t duplicateBytes_ = 0;
+};
+
+#endif // CONTENT_CACHE_HPP
@@ -0,0 +1,148 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#include "FunctionCache.hpp"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+
+#include "bison-flex/analysiscontext.hh"
+#include "bison-flex/varint.hh"
+
+namespace {
+
+using c3ms::getVarint;
+using c3ms::putVarint;
+
+constexpr char Magic[4] = {'C', '3', 'F', 'C'};
+constexpr std::uint64_t Version = 1;
+
+void putKey(std::string& out, const ContentKey& key) {
+    putVarint(out, key.size);
+    putVarint(out, key.low);
+    putVarint(out, key.high);
+}
+
+bool getKey(std::string_view& data, ContentKey& key) {
+    return getVarint(data, key.size) && getVarint(data, key.low) && getVarint(data, key.high);
+}
+
+} // namespace
+
+// The binary is known by its size and modification time, which a rebuild or an install
+// changes, so it is never read; when it cannot be found, nothing loaded can match
+FunctionCache::FunctionCache() {
+    struct stat info;
+    if (::stat("/proc/self/exe", &info) == 0) {
+        binary_ = {static_cast<std::uint64_t>(info.st_size), static_cast<std::uint64_t>(info.st_mtim.tv_sec),
+                   static_cast<std::uint64_t>(info.st_mtim.tv_nsec)};
+    }
+}
+
+// Entries are checked against what is left of the data, so a damaged file cannot make it allocate wildly
+bool FunctionCache::load(const std::filesystem::path& path, std::string& error) {
+    std::string contents;
+    if (!c3ms::read_file_into(path.string(), contents)) {
+        if (errno == ENOENT) {
+            return true;
+        }
+        error = std::strerror(errno);
+        return false;
+    }
+    std::string_view data = contents;
+    std::uint64_t version = 0, run = 0, count = 0;
+    ContentKey binary;
+    error = "not a function cache";
+    if (data.compare(0, sizeof(Magic), std::string_view(Magic, sizeof(Magic))) != 0) {
+        return false;
+    }
+    data.remove_prefix(sizeof(Magic));
+    if (!getVarint(data, version) || version != Version || !getKey(data, binary) || !getVarint(data, run) || !getVarint(data, count)
+        || count > data.size()) {
+        return false;
+    }
+    error.clear();
+    run_ = run + 1;
+    if (!(binary == binary_) || binary_.size == 0) {
+        return true; // Another scanner made these statistics
+    }
+    entries_.reserve(count);
+    for (std::uint64_t i = 0; i < count; ++i) {
+        ContentKey key;
+        Entry entry;
+        std::uint64_t size = 0;
+        if (!getKey(data, key) || !getVarint(data, entry.run) || !getVarint(data, size) || size > data.size()) {
+            entries_.clear();
+            error = "not a function cache";
+            return false;
+        }
+        entry.stats.assign(data.data(), size);
+        data.remove_prefix(size);
+        entries_[key] = std::move(entry);
+    }
+    return true;
+}
+
+bool FunctionCache::find(std::string_view code, ContentKey& key, c3ms::CodeStatistics& stats) {
+    key = hashContent(code);
+    auto it = entries_.find(key);
+    if (it != entries_.end() && stats.deserialize(it->second.stats)) {
+        it->second.run = run_;
+        ++report_.hits;
+        report_.hitBytes += code.size();
+        return true;
+    }
+    ++report_.misses;
+    report_.missBytes += code.size();
+    return false;
+}
+
+void FunctionCache::insert(const ContentKey& key, const c3ms::CodeStatistics& stats) {
+    Entry& entry = entries_[key];
+    entry.stats.clear();
+    stats.serialize(entry.stats);
+    entry.run = run_;
+}
+
+// Written next to its place and renamed there
+bool FunctionCache::save(const std::filesystem::path& path, std::string& error) {
+    std::string data(Magic, sizeof(Magic));
+    putVarint(data, Version);
+    putKey(data, binary_);
+    putVarint(data, run_);
+    std::size_t kept = 0;
+    for (const auto& [key, entry] : entries_) {
+        kept += run_ - entry.run < MaxIdleRuns;
+    }
+    putVarint(data, kept);
+    for (const auto& [key, entry] : entries_) {
+        if (run_ - entry.run < MaxIdleRuns) {
+            putKey(data, key);
+            putVarint(data, entry.run);
+            putVarint(data, entry.stats.size());
+            data.append(entry.stats);
+        }
+    }
+    report_.entries = kept;
+    report_.dropped = entries_.size() - kept;
+
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    out.close();
+    if (!out) {
+        error = std::strerror(errno);
+        return false;
+    }
+    std::error_code renameError;
+    std::filesystem::rename(temporary, path, renameError);
+    if (renameError) {
+        error = renameError.message();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,101 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#ifndef FUNCTION_CACHE_HPP
+#define FUNCTION_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "bison-flex/codestatistics.hh"
+#include "ContentCache.hpp"
+
+/**
+ * @class FunctionCache
+ *
+ * @brief The statistics of functions analysed in earlier runs, kept on disk and keyed by their text.
+ *
+ * @details A function whose text was seen before takes its statistics from the cache instead
+ * of the scanner, so after an edit only the functions that changed are lexed. The key is a
+ * hash of the bytes as they are: the scanner keeps some layout in its tokens, such as the
+ * condition of an if constexpr, so a change of layout or comments is a change too. Metrics
+ * are computed again from the statistics, since the lines of code are not part of them.
+ *
+ * The file is tied to the binary that wrote it by the size and modification time of the
+ * executable, so a scanner that classifies tokens differently never reads statistics it did
+ * not make. Each
+ * save is a new generation; entries not used for MaxIdleRuns generations are left out.
+ */
+class FunctionCache {
+public:
+    /// Saves an entry survives without being used
+    static constexpr std::uint64_t MaxIdleRuns = 16;
+
+    /**
+     * @brief What the cache saved in this run.
+     */
+    struct Report {
+        std::size_t hits = 0;          ///< Functions that took their statistics from the cache.
+        std::size_t misses = 0;        ///< Functions that were lexed.
+        std::uint64_t hitBytes = 0;    ///< Bytes of the functions that were not lexed.
+        std::uint64_t missBytes = 0;   ///< Bytes of the functions that were lexed.
+        std::size_t entries = 0;       ///< Entries written by the last save.
+        std::size_t dropped = 0;       ///< Entries left out of the last save for being idle.
+    };
+
+    FunctionCache();
+
+    /**
+     * @brief Reads the entries of earlier runs.
+     *
+     * @param path The cache file; a missing file holds no entries.
+     * @param error Set to the reason when the file is damaged; the cache is then left empty.
+     * @return bool Whether the file was read.
+     *
+     * @details A file written by another binary is not an error: its entries are dropped.
+     */
+    bool load(const std::filesystem::path& path, std::string& error);
+
+    /**
+     * @brief Looks up the statistics of a function.
+     *
+     * @param code The code of the function.
+     * @param key Set to the key of the function, to store its statistics on a miss.
+     * @param stats Replaced with the cached statistics on a hit.
+     * @return bool Whether the function was found.
+     */
+    bool find(std::string_view code, ContentKey& key, c3ms::CodeStatistics& stats);
+
+    /// Keeps the statistics of a function that was lexed
+    void insert(const ContentKey& key, const c3ms::CodeStatistics& stats);
+
+    /**
+     * @brief Writes the entries used in the last MaxIdleRuns runs.
+     *
+     * @param path The file to write; it is replaced only once complete.
+     * @param error Set to the reason when the file cannot be written.
+     * @return bool Whether the file was written.
+     */
+    bool save(const std::filesystem::path& path, std::string& error);
+
+    const Report& report() const { return report_; }
+
+private:
+    struct KeyHash {
+        std::size_t operator()(const ContentKey& key) const { return static_cast<std::size_t>(key.low); }
+    };
+    struct Entry {
+        std::string stats; // As serialized by CodeStatistics
+        std::uint64_t run = 0; // Generation it was last used in
+    };
+
+    ContentKey binary_;
+    std::uint64_t run_ = 1;
+    std::unordered_map<ContentKey, Entry, KeyHash> entries_;
+    Report report_;
+};
+
+#endif // FUNCTION_CACHE_HPP
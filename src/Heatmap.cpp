@@ -0,0 +1,62 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#include "Heatmap.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#include "CodeMetrics.hpp"
+
+namespace {
+
+struct Region {
+    int firstLine;
+    int lastLine;
+    double effort;
+    double density;
+    std::int64_t conditions;
+};
+
+} // namespace
+
+// Ranges are ranked by density, then by position, so equal ranges keep their order in the file
+std::string describeHotLines(const c3ms::LineProfile& profile, std::size_t window, std::size_t regions) {
+    std::vector<Region> ranges;
+    profile.forEachWindow(window, [&ranges](const c3ms::LineProfile::Window& range) {
+        int lines = range.lastLine - range.firstLine + 1;
+        MetricsCalculator metrics(static_cast<unsigned int>(range.uniqueOperators), static_cast<unsigned int>(range.uniqueOperands),
+                                  static_cast<unsigned int>(std::max<std::int64_t>(range.operators, 0)),
+                                  static_cast<unsigned int>(range.operands), static_cast<int>(range.conditions), lines);
+        double effort = metrics.getMetrics().effort;
+        if (effort > 0) {
+            ranges.push_back({range.firstLine, range.lastLine, effort, effort / lines, range.conditions});
+        }
+    });
+    std::stable_sort(ranges.begin(), ranges.end(), [](const Region& a, const Region& b) { return a.density > b.density; });
+
+    std::vector<const Region*> hottest;
+    for (const auto& range : ranges) {
+        if (hottest.size() == regions) {
+            break;
+        }
+        bool overlaps = std::any_of(hottest.begin(), hottest.end(), [&range](const Region* other) {
+            return range.firstLine <= other->lastLine && other->firstLine <= range.lastLine;
+        });
+        if (!overlaps) {
+            hottest.push_back(&range);
+        }
+    }
+    if (hottest.empty()) {
+        return {};
+    }
+
+    std::ostringstream note;
+    note << std::fixed << std::setprecision(2) << "Hot lines (" << window << "-line windows, effort per line):";
+    for (const Region* region : hottest) {
+        note << "\n  lines " << region->firstLine << "-" << region->lastLine << ": " << region->density
+             << " (effort " << region->effort << ", " << region->conditions << " conditions)";
+    }
+    return note.str();
+}
@@ -0,0 +1,26 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#ifndef HEATMAP_HPP
+#define HEATMAP_HPP
+
+#include <cstddef>
+#include <string>
+
+#include "bison-flex/lineprofile.hh"
+
+/**
+ * @brief The hottest ranges of lines of a file, by Halstead effort per line, as a note for its report.
+ *
+ * @details Every range of window lines is measured from the line profile of the file's scan,
+ * sliding one line at a time, with the effort of its own operators and operands divided by
+ * its lines. The densest ranges are listed first, each skipping ranges that overlap one
+ * listed before it. The note leaves the file unnamed, since the report that follows names it.
+ *
+ * @param profile The line profile of the file.
+ * @param window The lines of each range.
+ * @param regions The most ranges to list.
+ * @return std::string The note, or an empty string when no range has any effort.
+ */
+std::string describeHotLines(const c3ms::LineProfile& profile, std::size_t window, std::size_t regions);
+
+#endif // HEATMAP_HPP
@@ -0,0 +1,401 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#include "History.hpp"
+#include "InputGuard.hpp"
+#include "bison-flex/analysiscontext.hh"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <stdexcept>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+const char* const SourceExtensions[] = {".c", ".cc", ".cpp", ".cxx", ".c++", ".h", ".hh", ".hpp", ".hxx", ".h++", ".inl", ".ipp", ".tpp"};
+
+// Whether a path names a C or C++ source or header
+bool isSource(std::string_view path) {
+    auto dot = path.rfind('.');
+    if (dot == std::string_view::npos || path.find('/', dot) != std::string_view::npos) {
+        return false;
+    }
+    std::string extension(path.substr(dot));
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+    return std::find(std::begin(SourceExtensions), std::end(SourceExtensions), extension) != std::end(SourceExtensions);
+}
+
+// Fields of a git record, separated by spaces
+std::vector<std::string_view> split(std::string_view record) {
+    std::vector<std::string_view> fields;
+    while (!record.empty()) {
+        auto space = record.find(' ');
+        fields.push_back(record.substr(0, space));
+        record.remove_prefix(space == std::string_view::npos ? record.size() : space + 1);
+    }
+    return fields;
+}
+
+// Regular and executable files; symbolic links and submodules are not sources
+bool isRegularFile(std::string_view mode) {
+    return mode == "100644" || mode == "100755";
+}
+
+/**
+ * @brief A git command run in the repository, with its output, and optionally its input, piped.
+ */
+class GitProcess {
+public:
+    GitProcess(const std::string& repository, const std::vector<std::string>& args, bool input) {
+        int outPipe[2], inPipe[2] = {-1, -1};
+        if (pipe(outPipe) != 0 || (input && pipe(inPipe) != 0)) {
+            throw std::runtime_error("cannot create a pipe for git");
+        }
+        // Later git processes must not inherit these ends, or cat-file would never see EOF
+        for (int fd : {outPipe[0], outPipe[1], inPipe[0], inPipe[1]}) {
+            if (fd >= 0) {
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+            }
+        }
+
+        std::vector<std::string> command = {"git", "-C", repository};
+        command.insert(command.end(), args.begin(), args.end());
+        pid_ = fork();
+        if (pid_ < 0) {
+            throw std::runtime_error("cannot start git");
+        }
+        if (pid_ == 0) {
+            dup2(outPipe[1], STDOUT_FILENO);
+            if (input) {
+                dup2(inPipe[0], STDIN_FILENO);
+                close(inPipe[0]);
+                close(inPipe[1]);
+            }
+            close(outPipe[0]);
+            close(outPipe[1]);
+            std::vector<char*> argv;
+            for (auto& arg : command) {
+                argv.push_back(arg.data());
+            }
+            argv.push_back(nullptr);
+            execvp("git", argv.data());
+            _exit(127);
+        }
+
+        close(outPipe[1]);
+        out_ = fdopen(outPipe[0], "r");
+        if (input) {
+            close(inPipe[0]);
+            in_ = fdopen(inPipe[1], "w");
+        }
+        name_ = args.empty() ? "git" : "git " + args.front();
+    }
+
+    ~GitProcess() {
+        wait();
+    }
+
+    GitProcess(const GitProcess&) = delete;
+    GitProcess& operator=(const GitProcess&) = delete;
+
+    FILE* in() const { return in_; }
+    FILE* out() const { return out_; }
+
+    // Closes the pipes and throws if git did not succeed
+    void finish() {
+        if (wait() != 0) {
+            throw std::runtime_error(name_ + " failed");
+        }
+    }
+
+private:
+    int wait() {
+        if (in_) {
+            fclose(in_);
+            in_ = nullptr;
+        }
+        if (out_) {
+            fclose(out_);
+            out_ = nullptr;
+        }
+        if (pid_ > 0) {
+            waitpid(pid_, &status_, 0);
+            pid_ = -1;
+        }
+        return WIFEXITED(status_) ? WEXITSTATUS(status_) : -1;
+    }
+
+    pid_t pid_ = -1;
+    int status_ = 0;
+    FILE* in_ = nullptr;
+    FILE* out_ = nullptr;
+    std::string name_;
+};
+
+// Runs a git command and returns its output
+std::string runGit(const std::string& repository, const std::vector<std::string>& args) {
+    GitProcess git(repository, args, false);
+    std::string output;
+    char buffer[1 << 16];
+    std::size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), git.out())) > 0) {
+        output.append(buffer, read);
+    }
+    git.finish();
+    return output;
+}
+
+/**
+ * @brief Reads blobs through a single 'git cat-file --batch' process.
+ */
+class BlobReader {
+public:
+    explicit BlobReader(const std::string& repository) : git_(repository, {"cat-file", "--batch"}, true) {}
+
+    void read(const std::string& id, std::string& content) {
+        std::fprintf(git_.in(), "%s\n", id.c_str());
+        std::fflush(git_.in());
+
+        // Header: "<id> <type> <size>", or "<id> missing"
+        std::string header;
+        int c;
+        while ((c = std::fgetc(git_.out())) != EOF && c != '\n') {
+            header.push_back(static_cast<char>(c));
+        }
+        auto space = header.rfind(' ');
+        if (c == EOF || space == std::string::npos || header.compare(space + 1, std::string::npos, "missing") == 0) {
+            throw std::runtime_error("cannot read blob " + id);
+        }
+        content.resize(std::stoull(header.substr(space + 1)));
+        if (std::fread(content.data(), 1, content.size(), git_.out()) != content.size() || std::fgetc(git_.out()) != '\n') {
+            throw std::runtime_error("truncated blob " + id);
+        }
+    }
+
+private:
+    GitProcess git_;
+};
+
+/**
+ * @brief A file changed by a commit; an empty blob id means it is gone.
+ */
+struct Change {
+    std::string path;
+    std::string blob;
+};
+
+// Every source of a commit, for the first commit of the range
+std::vector<Change> listTree(const std::string& repository, const std::string& commit) {
+    std::string output = runGit(repository, {"ls-tree", "-r", "-z", "--full-tree", commit});
+    std::vector<Change> changes;
+    std::string_view rest(output);
+    while (!rest.empty()) {
+        // "<mode> <type> <id>\t<path>\0"
+        auto end = rest.find('\0');
+        std::string_view entry = rest.substr(0, end);
+        rest.remove_prefix(end == std::string_view::npos ? rest.size() : end + 1);
+        auto tab = entry.find('\t');
+        auto fields = split(entry.substr(0, tab));
+        if (tab == std::string_view::npos || fields.size() != 3 || !isRegularFile(fields[0]) || fields[1] != "blob") {
+            continue;
+        }
+        changes.push_back({std::string(entry.substr(tab + 1)), std::string(fields[2])});
+    }
+    return changes;
+}
+
+// Files that differ between two commits
+std::vector<Change> diffTrees(const std::string& repository, const std::string& from, const std::string& to) {
+    std::string output = runGit(repository, {"diff-tree", "-r", "-z", "--no-renames", "--no-commit-id", from, to});
+    std::vector<Change> changes;
+    std::string_view rest(output);
+    auto next = [&rest]() {
+        auto end = rest.find('\0');
+        std::string_view field = rest.substr(0, end);
+        rest.remove_prefix(end == std::string_view::npos ? rest.size() : end + 1);
+        return field;
+    };
+    while (!rest.empty()) {
+        // ":<old mode> <new mode> <old id> <new id> <status>\0<path>\0"
+        std::string_view meta = next();
+        std::string_view path = next();
+        auto fields = split(meta);
+        if (fields.size() != 5 || meta[0] != ':') {
+            continue;
+        }
+        changes.push_back({std::string(path), isRegularFile(fields[1]) ? std::string(fields[3]) : std::string()});
+    }
+    return changes;
+}
+
+} // namespace
+
+// Interns the tokens of a file content
+BlobSummary HistoryTotals::summarize(const CodeStatistics& stats, int linesOfCode) {
+    BlobSummary blob;
+    blob.analysed = true;
+    blob.linesOfCode = linesOfCode;
+    for (std::size_t i = 0; i < CodeStatistics::NumCategories; ++i) {
+        blob.counts[i] = stats.getCounterValue(static_cast<StatsCategory>(i));
+    }
+    stats.forEachToken([this, &blob](StatsCategory category, std::string_view token, CodeStatistics::StatSize occurrences) {
+        key_.assign(token.data(), token.size());
+        auto symbol = symbols_.try_emplace(key_, static_cast<std::uint32_t>(symbols_.size())).first->second;
+        auto slot = static_cast<std::uint32_t>(symbol * CodeStatistics::NumCategories + static_cast<std::size_t>(category));
+        blob.tokens.emplace_back(slot, static_cast<std::uint32_t>(occurrences));
+    });
+    occurrences_.resize(symbols_.size() * CodeStatistics::NumCategories, 0);
+    return blob;
+}
+
+void HistoryTotals::add(const BlobSummary& blob) {
+    update(blob, 1);
+}
+
+void HistoryTotals::remove(const BlobSummary& blob) {
+    update(blob, -1);
+}
+
+// Adds or removes a file, keeping the number of slots in use per category
+void HistoryTotals::update(const BlobSummary& blob, int sign) {
+    if (!blob.analysed) {
+        return;
+    }
+    for (std::size_t i = 0; i < CodeStatistics::NumCategories; ++i) {
+        counts_[i] += sign * static_cast<std::int64_t>(blob.counts[i]);
+    }
+    for (const auto& [slot, count] : blob.tokens) {
+        auto& occurrences = occurrences_[slot];
+        auto category = slot % CodeStatistics::NumCategories;
+        if (sign > 0) {
+            uniques_[category] += occurrences == 0;
+            occurrences += count;
+        } else {
+            occurrences -= count;
+            uniques_[category] -= occurrences == 0;
+        }
+    }
+    linesOfCode_ += sign * blob.linesOfCode;
+    files_ = sign > 0 ? files_ + 1 : files_ - 1;
+}
+
+// Metrics of the tree, from the same sums as CodeStatistics
+HalsteadMetrics HistoryTotals::metrics() const {
+    auto sum = [](const auto& values, std::initializer_list<StatsCategory> categories) {
+        std::int64_t total = 0;
+        for (StatsCategory category : categories) {
+            total += values[static_cast<std::size_t>(category)];
+        }
+        return static_cast<unsigned int>(std::max<std::int64_t>(total, 0));
+    };
+    const auto operators = {StatsCategory::KEYWORD, StatsCategory::OPERATOR, StatsCategory::APIKEYWORD,
+                            StatsCategory::APILLKEYWORD, StatsCategory::CUSTOMKEYWORD};
+    const auto operands = {StatsCategory::CONSTANT, StatsCategory::IDENTIFIER, StatsCategory::CSPECIFIER, StatsCategory::TYPE};
+    MetricsCalculator calculator(sum(uniques_, operators), sum(uniques_, operands), sum(counts_, operators), sum(counts_, operands),
+                                 static_cast<int>(counts_[static_cast<std::size_t>(StatsCategory::CONDITION)]),
+                                 static_cast<int>(linesOfCode_));
+    return calculator.getMetrics();
+}
+
+// Walks the commits of a range and writes their global metrics
+int runHistory(const ProgramOptions& options, std::ostream& out) {
+    const std::string& repository = options.repository;
+    const InputLimits& limits = options.limits;
+
+    Preprocessor preprocessor;
+    for (const auto& definition : options.defines) {
+        preprocessor.define(definition);
+    }
+    for (const auto& name : options.undefines) {
+        preprocessor.undefine(name);
+    }
+    auto context = ContextPool::global().acquire();
+    if (options.preprocess) {
+        context->options().preprocessor = &preprocessor;
+    }
+    Watchdog watchdog;
+    CodeStatistics stats;
+
+    std::size_t analysed = 0, reused = 0;
+    try {
+        std::string log = runGit(repository, {"log", "--reverse", "--first-parent", "--format=%H %cI", options.history, "--"});
+        BlobReader blobs(repository);
+        std::unordered_map<std::string, BlobSummary> summaries; // By blob id
+        std::unordered_map<std::string, std::string> tree;      // Blob id of each source path
+        HistoryTotals totals;
+        std::string content;
+
+        // Each blob is read and analysed the first time a commit brings it in
+        auto summaryOf = [&](const std::string& id) -> const BlobSummary& {
+            auto [it, inserted] = summaries.try_emplace(id);
+            if (!inserted) {
+                ++reused;
+                return it->second;
+            }
+            ++analysed;
+            blobs.read(id, content);
+            if ((limits.maxBytes > 0 && content.size() > limits.maxBytes) || (limits.sniff && !sniffInput(content).empty())) {
+                return it->second;
+            }
+            stats.reset();
+            if (limits.timeoutSeconds > 0) {
+                watchdog.arm(*context, limits.timeoutSeconds);
+            }
+            context->parse_buffer(content, stats);
+            if (!watchdog.disarm() && !context->cancelled()) {
+                it->second = totals.summarize(stats, countLines(content));
+            }
+            return it->second;
+        };
+
+        out << "commit,date,files,lines,n1,n2,N1,N2,volume,difficulty,effort,conditions,cyclomatic,maintainability\n";
+        out << std::fixed << std::setprecision(2);
+
+        std::string previous;
+        std::string_view commits(log);
+        while (!commits.empty()) {
+            auto end = commits.find('\n');
+            std::string_view line = commits.substr(0, end);
+            commits.remove_prefix(end == std::string_view::npos ? commits.size() : end + 1);
+            auto space = line.find(' ');
+            if (space == std::string_view::npos) {
+                continue;
+            }
+            std::string commit(line.substr(0, space));
+
+            auto changes = previous.empty() ? listTree(repository, commit) : diffTrees(repository, previous, commit);
+            for (const auto& change : changes) {
+                if (!isSource(change.path)) {
+                    continue;
+                }
+                auto old = tree.find(change.path);
+                if (old != tree.end()) {
+                    totals.remove(summaries.at(old->second));
+                    tree.erase(old);
+                }
+                if (!change.blob.empty()) {
+                    totals.add(summaryOf(change.blob));
+                    tree.emplace(change.path, change.blob);
+                }
+            }
+            previous = commit;
+
+            HalsteadMetrics metrics = totals.metrics();
+            out << commit << "," << line.substr(space + 1) << "," << totals.files() << "," << metrics.linesOfCode << ","
+                << metrics.n1 << "," << metrics.n2 << "," << metrics.N1 << "," << metrics.N2 << ","
+                << metrics.volume << "," << metrics.difficulty << "," << metrics.effort << "," << metrics.conditions << ","
+                << metrics.cyclomaticComplexity << "," << metrics.maintainabilityIndex << "\n";
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << repository << ": " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::clog << "History: analysed " << analysed << " distinct blobs, reused " << reused << " times\n";
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#ifndef HISTORY_HPP
+#define HISTORY_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "bison-flex/codestatistics.hh"
+#include "CodeMetrics.hpp"
+#include "CodeUtils.hpp"
+
+/**
+ * @struct BlobSummary
+ *
+ * @brief What one file content contributes to the global metrics of a commit.
+ *
+ * @details Tokens are kept as (slot, occurrences) pairs, where a slot is an interned symbol
+ * and a category, so a summary is much smaller than the CodeStatistics it comes from.
+ */
+struct BlobSummary {
+    bool analysed = false; ///< False when the content was skipped by the budgets or the sniffer.
+    std::array<CodeStatistics::StatSize, CodeStatistics::NumCategories> counts{}; ///< Occurrences per category.
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> tokens; ///< Occurrences per slot.
+    int linesOfCode = 0;
+};
+
+/**
+ * @class HistoryTotals
+ *
+ * @brief Global token counts of a tree, updated as files are added and removed.
+ *
+ * @details Every slot keeps its occurrences over the whole tree, and every category keeps how
+ * many of its slots are in use, so unique counts stay exact when a file is removed and the
+ * cost of a commit depends only on the files it changes.
+ */
+class HistoryTotals {
+public:
+    /**
+     * @brief Summarizes the statistics of a file content, interning its tokens.
+     *
+     * @param stats The statistics of the content.
+     * @param linesOfCode The lines of code of the content.
+     * @return BlobSummary The summary to add and remove.
+     */
+    BlobSummary summarize(const CodeStatistics& stats, int linesOfCode);
+
+    void add(const BlobSummary& blob);
+    void remove(const BlobSummary& blob);
+
+    /**
+     * @brief Computes the metrics of the current tree.
+     */
+    HalsteadMetrics metrics() const;
+
+    std::size_t files() const { return files_; }
+
+private:
+    void update(const BlobSummary& blob, int sign);
+
+    std::unordered_map<std::string, std::uint32_t> symbols_;
+    std::string key_;
+    std::vector<std::uint64_t> occurrences_; // Per slot: symbol id * NumCategories + category
+    std::array<std::int64_t, CodeStatistics::NumCategories> counts_{};
+    std::array<std::int64_t, CodeStatistics::NumCategories> uniques_{};
+    std::int64_t linesOfCode_ = 0;
+    std::size_t files_ = 0;
+};
+
+/**
+ * @brief Writes one row of global metrics per commit of a range of a git repository.
+ *
+ * @param options The settings; history holds the range and repository the working tree.
+ * @param out The stream the rows are written to, as CSV.
+ * @return int EXIT_SUCCESS, or EXIT_FAILURE when git fails.
+ *
+ * @details The commits are walked oldest first, following first parents. Only the files
+ * that change between two commits are looked at, and each distinct blob is read and
+ * analysed once, however many commits contain it. Files are selected by their C and C++
+ * extensions, and the size budget, the sniffer, the time budget and -P apply to each blob.
+ */
+int runHistory(const ProgramOptions& options, std::ostream& out = std::cout);
+
+#endif // HISTORY_HPP
@@ -0,0 +1,137 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#include "Hotspots.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#include "CodeUtils.hpp"
+
+namespace {
+
+// Value of the ranking metric; undefined values, as for code without operands, rank last
+double rankValue(const HalsteadMetrics& metrics, HotspotMetric metric) {
+    double value = 0;
+    switch (metric) {
+        case HotspotMetric::EFFORT: value = metrics.effort; break;
+        case HotspotMetric::CYCLOMATIC: value = metrics.cyclomaticComplexity; break;
+        case HotspotMetric::VOLUME: value = metrics.volume; break;
+        case HotspotMetric::BUGS: value = metrics.numberOfBugs; break;
+    }
+    return std::isnan(value) ? -std::numeric_limits<double>::infinity() : value;
+}
+
+const char* metricName(HotspotMetric metric) {
+    switch (metric) {
+        case HotspotMetric::EFFORT: return "effort";
+        case HotspotMetric::CYCLOMATIC: return "cyclomatic complexity";
+        case HotspotMetric::VOLUME: return "volume";
+        case HotspotMetric::BUGS: return "bugs";
+    }
+    return "";
+}
+
+} // namespace
+
+// Reads the name of a ranking metric
+bool parseHotspotMetric(const std::string& name, HotspotMetric& metric) {
+    if (name == "effort") {
+        metric = HotspotMetric::EFFORT;
+    } else if (name == "cyclomatic") {
+        metric = HotspotMetric::CYCLOMATIC;
+    } else if (name == "volume") {
+        metric = HotspotMetric::VOLUME;
+    } else if (name == "bugs") {
+        metric = HotspotMetric::BUGS;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Heap order: the weakest entry ends up at the front
+bool HotspotHeap::stronger(const Entry& a, const Entry& b) {
+    if (a.value != b.value) {
+        return a.value > b.value;
+    }
+    return a.record.unit != b.record.unit ? a.record.unit < b.record.unit : a.order < b.order;
+}
+
+// A new report is offered after every kept one, so at the same value it only wins with an earlier unit
+bool HotspotHeap::admits(const HalsteadMetrics& metrics, std::size_t unit) const {
+    if (heap_.size() < capacity_) {
+        return true;
+    }
+    if (capacity_ == 0) {
+        return false;
+    }
+    double value = rankValue(metrics, metric_);
+    const Entry& weakest = heap_.front();
+    return value > weakest.value || (value == weakest.value && unit < weakest.record.unit);
+}
+
+// Keeps a report, replacing the weakest one when full
+void HotspotHeap::push(ReportRecord record) {
+    if (!admits(record.metrics, record.unit)) {
+        return;
+    }
+    if (heap_.size() == capacity_) {
+        std::pop_heap(heap_.begin(), heap_.end(), stronger);
+        heap_.pop_back();
+    }
+    double value = rankValue(record.metrics, metric_);
+    heap_.push_back({value, offered_++, std::move(record)});
+    std::push_heap(heap_.begin(), heap_.end(), stronger);
+}
+
+// Returns the kept reports, highest first
+std::vector<ReportRecord> HotspotHeap::drain() {
+    std::sort_heap(heap_.begin(), heap_.end(), stronger);
+    std::vector<ReportRecord> records;
+    records.reserve(heap_.size());
+    for (auto& entry : heap_) {
+        records.push_back(std::move(entry.record));
+    }
+    heap_.clear();
+    return records;
+}
+
+// Builds the file and function heaps
+HotspotReport::HotspotReport(std::size_t count, HotspotMetric metric, const std::vector<std::filesystem::path>& inputs)
+    : count_(count), metricName_(metricName(metric)), inputs_(inputs), files_(count, metric), functions_(count, metric) {}
+
+// Submits the function ranking, then the file ranking
+void HotspotReport::submit(ReportWriter& writer, std::size_t unit) {
+    submit(writer, unit, functions_, "functions", false);
+    submit(writer, unit, files_, "files", true);
+}
+
+// Submits one ranking, under a line that names it
+void HotspotReport::submit(ReportWriter& writer, std::size_t unit, HotspotHeap& heap, const std::string& level, bool file) {
+    auto records = heap.drain();
+    if (records.empty()) {
+        return;
+    }
+
+    ReportRecord heading;
+    heading.unit = unit;
+    heading.last = false;
+    heading.note = "\nTop " + std::to_string(records.size()) + " " + level + " by " + metricName_
+                 + (records.size() < count_ ? " (all of them)" : "") + ":";
+    writer.submit(std::move(heading));
+
+    std::size_t rank = 0;
+    for (auto& record : records) {
+        // Function titles do not name their file, which matters once files are mixed
+        std::string title = "#" + std::to_string(++rank) + " " + record.title;
+        if (!file && record.unit < inputs_.size()) {
+            title += " (" + inputs_[record.unit].filename().string() + ")";
+        }
+        record.title = std::move(title);
+        record.unit = unit;
+        record.last = false;
+        writer.submit(std::move(record));
+    }
+}
@@ -0,0 +1,105 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#ifndef HOTSPOTS_HPP
+#define HOTSPOTS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "CodeMetrics.hpp"
+#include "ReportWriter.hpp"
+
+/**
+ * @brief Metric hotspots are ranked by.
+ */
+enum class HotspotMetric { EFFORT, CYCLOMATIC, VOLUME, BUGS };
+
+/**
+ * @brief Reads the name of a metric given with --by.
+ *
+ * @param name One of effort, cyclomatic, volume and bugs.
+ * @param metric Set to the metric when the name is known.
+ * @return bool Whether the name is known.
+ */
+bool parseHotspotMetric(const std::string& name, HotspotMetric& metric);
+
+/**
+ * @class HotspotHeap
+ *
+ * @brief The N reports with the highest value of a metric, out of a stream of any length.
+ *
+ * @details A min-heap holds the candidates, so the weakest one is known at all times and a
+ * report that cannot enter is turned down before it is even built. Ties go to the report of
+ * the earlier unit, then to the one offered first, so the result depends neither on the size
+ * of the stream nor on the order units finish in.
+ */
+class HotspotHeap {
+public:
+    HotspotHeap(std::size_t capacity, HotspotMetric metric) : capacity_(capacity), metric_(metric) {}
+
+    /// Whether a report of the unit with these metrics would be kept now; once false, it stays false for later units
+    bool admits(const HalsteadMetrics& metrics, std::size_t unit) const;
+
+    /// Keeps a report, dropping the weakest one when the heap is full
+    void push(ReportRecord record);
+
+    /// The reports kept, highest first; leaves the heap empty
+    std::vector<ReportRecord> drain();
+
+private:
+    struct Entry {
+        double value;
+        std::uint64_t order;
+        ReportRecord record;
+    };
+
+    // Weakest first: lower value, or a later unit or offered later at the same value
+    static bool stronger(const Entry& a, const Entry& b);
+
+    std::size_t capacity_;
+    HotspotMetric metric_;
+    std::uint64_t offered_ = 0;
+    std::vector<Entry> heap_;
+};
+
+/**
+ * @class HotspotReport
+ *
+ * @brief Keeps the top files and functions of a run instead of reporting each one.
+ */
+class HotspotReport {
+public:
+    /**
+     * @param count The number of files and of functions to keep.
+     * @param metric The metric they are ranked by.
+     * @param inputs The input files, to name the file of each function.
+     */
+    HotspotReport(std::size_t count, HotspotMetric metric, const std::vector<std::filesystem::path>& inputs);
+
+    /// Whether a file report, or a function report when file is false, would be kept
+    bool admits(bool file, const HalsteadMetrics& metrics, std::size_t unit) const { return (file ? files_ : functions_).admits(metrics, unit); }
+
+    void push(bool file, ReportRecord record) { (file ? files_ : functions_).push(std::move(record)); }
+
+    /**
+     * @brief Submits the rankings, functions first, as records of a unit they do not close.
+     *
+     * @param writer The writer the rankings are submitted to.
+     * @param unit The unit after every file, where the global report goes.
+     */
+    void submit(ReportWriter& writer, std::size_t unit);
+
+private:
+    void submit(ReportWriter& writer, std::size_t unit, HotspotHeap& heap, const std::string& level, bool file);
+
+    std::size_t count_;
+    std::string metricName_;
+    const std::vector<std::filesystem::path>& inputs_;
+    HotspotHeap files_;
+    HotspotHeap functions_;
+};
+
+#endif // HOTSPOTS_HPP
@@ -0,0 +1,96 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#include "InputGuard.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+// Looks at the start of a file for binary, generated or minified content
+std::string sniffInput(std::string_view code) {
+    std::string_view head = code.substr(0, 64 << 10);
+
+    // Binary: NUL bytes, or more than 10% control characters other than whitespace
+    std::size_t control = 0;
+    for (unsigned char c : head) {
+        if (c == 0) {
+            return "binary file";
+        }
+        if ((c < 0x20 && !std::isspace(c)) || c == 0x7f) {
+            ++control;
+        }
+    }
+    if (control * 10 > head.size()) {
+        return "binary file";
+    }
+
+    // Generated: a marker in the leading comment block
+    std::string top(head.substr(0, 1024));
+    std::transform(top.begin(), top.end(), top.begin(), [](unsigned char c) { return std::tolower(c); });
+    static const char* const markers[] = {
+        "@generated", "do not edit", "autogenerated", "auto-generated", "automatically generated", "code generated by"
+    };
+    for (const char* marker : markers) {
+        if (top.find(marker) != std::string::npos) {
+            return "generated file";
+        }
+    }
+
+    // Minified: lines longer than 1 KiB on average
+    std::size_t lines = std::count(head.begin(), head.end(), '\n') + 1;
+    if (head.size() > 4096 && head.size() / lines > 1024) {
+        return "minified or single-line code";
+    }
+
+    return "";
+}
+
+// Starts the watchdog thread
+Watchdog::Watchdog() {
+    thread_ = std::thread(&Watchdog::run, this);
+}
+
+// Stops the watchdog thread
+Watchdog::~Watchdog() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+}
+
+// Clears the context's cancellation and sets the deadline
+void Watchdog::arm(c3ms::AnalysisContext& context, double seconds) {
+    context.reset_cancel();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        context_ = &context;
+        deadline_ = std::chrono::steady_clock::now() +
+                    std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+        fired_ = false;
+    }
+    wake_.notify_one();
+}
+
+// Forgets the armed context; once this returns it can no longer be cancelled
+bool Watchdog::disarm() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    context_ = nullptr;
+    return fired_;
+}
+
+// Watchdog thread loop
+void Watchdog::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        if (!context_) {
+            wake_.wait(lock);
+        } else if (std::chrono::steady_clock::now() >= deadline_) {
+            context_->cancel();
+            context_ = nullptr;
+            fired_ = true;
+        } else {
+            wake_.wait_until(lock, deadline_);
+        }
+    }
+}
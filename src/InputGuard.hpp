@@ -0,0 +1,88 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#ifndef INPUT_GUARD_HPP
+#define INPUT_GUARD_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "bison-flex/analysiscontext.hh"
+
+/**
+ * @struct InputLimits
+ *
+ * @brief Per-file budgets that keep pathological inputs from stalling a run.
+ *
+ * @details Every guard is off unless asked for, so a run without them analyses every file.
+ *
+ * @member maxBytes Files larger than this are skipped; 0 means no limit.
+ * @member timeoutSeconds Wall-clock time after which a file is abandoned; 0 means no limit.
+ * @member sniff Whether binary, generated and minified files are skipped.
+ */
+struct InputLimits {
+    std::size_t maxBytes = 0;
+    double timeoutSeconds = 0;
+    bool sniff = false;
+};
+
+/**
+ * @brief Looks at the start of a file for signs that it is not hand-written source code.
+ *
+ * @param code The contents of the file.
+ * @return std::string Why the file should be skipped, or an empty string to analyse it.
+ *
+ * @details Only the first 64 KiB are examined. A file is binary when it contains NUL bytes or
+ * many control characters, generated when its first lines carry a marker such as "@generated"
+ * or "DO NOT EDIT", and minified when its lines are very long on average.
+ */
+std::string sniffInput(std::string_view code);
+
+/**
+ * @class Watchdog
+ *
+ * @brief Abandons an analysis that runs past its wall-clock budget.
+ *
+ * @details A single thread sleeps until the deadline of the armed context and cancels it,
+ * which makes its scanner stop at the next token. Arming and disarming only take a lock.
+ */
+class Watchdog {
+public:
+    Watchdog();
+    ~Watchdog();
+
+    Watchdog(const Watchdog&) = delete;
+    Watchdog& operator=(const Watchdog&) = delete;
+
+    /**
+     * @brief Starts timing the analysis done with a context.
+     *
+     * @param context The context to cancel when the budget runs out.
+     * @param seconds The budget, in seconds.
+     */
+    void arm(c3ms::AnalysisContext& context, double seconds);
+
+    /**
+     * @brief Stops timing the armed context.
+     *
+     * @return bool Whether the budget ran out and the context was cancelled.
+     */
+    bool disarm();
+
+private:
+    void run();
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    c3ms::AnalysisContext* context_ = nullptr;
+    std::chrono::steady_clock::time_point deadline_;
+    bool fired_ = false;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+#endif // INPUT_GUARD_HPP
@@ -0,0 +1,102 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#include "ReadAhead.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "bison-flex/analysiscontext.hh"
+
+// The I/O threads start reading at once
+ReadAhead::ReadAhead(std::vector<std::filesystem::path> files, std::size_t inFlight, std::size_t threads, std::uintmax_t maxBytes)
+    : files_(std::move(files)), inFlight_(std::max<std::size_t>(inFlight, 1)), maxBytes_(maxBytes) {
+    threads = std::min(std::max<std::size_t>(threads, 1), inFlight_);
+    for (std::size_t i = 0; i < threads; ++i) {
+        threads_.emplace_back(&ReadAhead::run, this);
+    }
+}
+
+ReadAhead::~ReadAhead() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    space_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+// Claims the next file while the window has room, and reads it without the lock
+void ReadAhead::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        space_.wait(lock, [this] { return stopping_ || (next_ < files_.size() && next_ - first_ <= inFlight_); });
+        if (stopping_) {
+            return;
+        }
+        const auto& path = files_[next_++];
+        // Slots are only appended or popped at the front, so this one stays in place
+        Slot& slot = slots_.emplace_back();
+        if (!spare_.empty()) {
+            slot.buffer = std::move(spare_.back());
+            spare_.pop_back();
+        }
+        lock.unlock();
+
+        std::error_code error;
+        auto size = std::filesystem::file_size(path, error);
+        if (error || (maxBytes_ > 0 && size > maxBytes_)) {
+            slot.buffer.clear();
+        } else if (!c3ms::read_file_into(path.string(), slot.buffer)) {
+            // Written at once, so it does not interleave with the scanner's diagnostics
+            std::cerr << "Warning: cannot read " + path.string() + ": " + std::strerror(errno) + "\n";
+            slot.buffer.clear();
+        }
+
+        lock.lock();
+        slot.ready = true;
+        ready_.notify_all();
+    }
+}
+
+// Gives the first slot back; a slot still being read is waited for, as its thread writes to it
+void ReadAhead::release(std::unique_lock<std::mutex>& lock) {
+    if (first_ == next_) {
+        ++next_; // Never claimed, so never read
+    } else {
+        ready_.wait(lock, [this] { return slots_.front().ready; });
+        spare_.push_back(std::move(slots_.front().buffer));
+        slots_.pop_front();
+    }
+    ++first_;
+    space_.notify_one();
+}
+
+// Drops the files passed over, then waits for this one
+std::string_view ReadAhead::take(const std::filesystem::path& file) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (holding_) {
+        release(lock);
+        holding_ = false;
+    }
+    while (first_ < files_.size() && files_[first_] != file) {
+        release(lock);
+    }
+    if (first_ == files_.size()) {
+        return {};
+    }
+
+    ++report_.files;
+    if (first_ == next_ || !slots_.front().ready) {
+        ++report_.waits;
+        auto start = std::chrono::steady_clock::now();
+        ready_.wait(lock, [this] { return first_ < next_ && slots_.front().ready; });
+        report_.waitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    holding_ = true;
+    return slots_.front().buffer;
+}
@@ -0,0 +1,95 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#ifndef READAHEAD_HPP
+#define READAHEAD_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ReadAhead
+ *
+ * @brief Reads the files the scanner is about to analyse on I/O threads, so it does not wait for them.
+ *
+ * @details The files are given up front, in the order the scanner takes them. A small pool
+ * of I/O threads reads them whole into buffers, keeping at most a given number read ahead
+ * of the file being scanned, so memory stays bounded however long the list is. Buffers are
+ * reused once the scanner is done with them. Files larger than the size budget are not read,
+ * since the scanner skips them anyway.
+ *
+ * The time the scanner spends blocked on a file that is not read yet is measured, to tell
+ * whether the run is bound by I/O.
+ */
+class ReadAhead {
+public:
+    /**
+     * @brief What the scanner waited for since the read-ahead started.
+     */
+    struct Report {
+        std::size_t files = 0;  ///< Files taken by the scanner.
+        std::size_t waits = 0;  ///< Files the scanner had to wait for.
+        double waitSeconds = 0; ///< Time spent waiting, in seconds.
+    };
+
+    /**
+     * @brief Starts the I/O threads.
+     *
+     * @param files The files, in the order they are taken.
+     * @param inFlight The number of files read ahead of the one being scanned, at least 1.
+     * @param threads The number of I/O threads, at least 1.
+     * @param maxBytes Files larger than this are not read, 0 for no limit.
+     */
+    ReadAhead(std::vector<std::filesystem::path> files, std::size_t inFlight, std::size_t threads, std::uintmax_t maxBytes);
+
+    /// Stops the I/O threads once the files they are reading are done
+    ~ReadAhead();
+
+    ReadAhead(const ReadAhead&) = delete;
+    ReadAhead& operator=(const ReadAhead&) = delete;
+
+    /**
+     * @brief Waits for the contents of a file.
+     *
+     * @param file The file; files given before it and not taken are dropped.
+     * @return std::string_view The contents, empty when the file cannot be read. Valid until the next take.
+     */
+    std::string_view take(const std::filesystem::path& file);
+
+    const Report& report() const { return report_; }
+
+private:
+    struct Slot {
+        std::string buffer;
+        bool ready = false;
+    };
+
+    void run();
+    void release(std::unique_lock<std::mutex>& lock);
+
+    std::vector<std::filesystem::path> files_;
+    std::size_t inFlight_;
+    std::uintmax_t maxBytes_;
+    Report report_;
+
+    std::mutex mutex_;
+    std::condition_variable ready_;  // A slot was filled
+    std::condition_variable space_;  // The scanner released a slot
+    std::deque<Slot> slots_;         // Files from first_ to next_, claimed by an I/O thread
+    std::size_t first_ = 0;          // First file not released by the scanner
+    std::size_t next_ = 0;           // Next file to claim
+    bool holding_ = false;           // The scanner holds the buffer of first_
+    bool stopping_ = false;
+    std::vector<std::string> spare_; // Released buffers, kept for their capacity
+
+    std::vector<std::thread> threads_;
+};
+
+#endif // READAHEAD_HPP
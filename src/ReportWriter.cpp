@@ -0,0 +1,133 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#include "ReportWriter.hpp"
+#include "CodeUtils.hpp"
+
+// Starts the writer thread
+ReportWriter::ReportWriter(std::ostream& out, int verbosity, std::size_t capacity, std::size_t batchBytes)
+    : out_(out), verbosity_(verbosity), batchBytes_(batchBytes), queue_(capacity)
+{
+    thread_ = std::thread(&ReportWriter::run, this);
+}
+
+// Writes every pending record before destruction
+ReportWriter::~ReportWriter() {
+    close();
+}
+
+// Queues a record, backing off while the queue is full
+void ReportWriter::submit(ReportRecord record) {
+    Backoff backoff;
+    while (!queue_.tryPush(std::move(record))) {
+        backoff.pause();
+    }
+}
+
+// Closes a unit without writing anything for it
+void ReportWriter::skip(std::size_t unit, std::string note) {
+    ReportRecord record;
+    record.unit = unit;
+    record.last = true;
+    record.note = std::move(note);
+    submit(std::move(record));
+}
+
+// Signals the writer thread to drain the queue and waits for it
+void ReportWriter::close() {
+    if (thread_.joinable()) {
+        closed_.store(true, std::memory_order_release);
+        thread_.join();
+    }
+}
+
+// Writer thread loop
+void ReportWriter::run() {
+    ReportRecord record;
+    Backoff backoff;
+
+    for (;;) {
+        if (queue_.tryPop(record)) {
+            handle(record);
+            backoff.reset();
+            continue;
+        }
+        if (closed_.load(std::memory_order_acquire)) {
+            // Every submit happened before close(), so one last pass drains the queue
+            while (queue_.tryPop(record)) {
+                handle(record);
+            }
+            break;
+        }
+        // The writer caught up with the analysis: write out what is ready while waiting
+        if (batch_.tellp() > 0) {
+            flush();
+        }
+        backoff.pause();
+    }
+
+    // Units that were never closed are still written, in input order
+    for (auto& [unit, records] : pending_) {
+        for (const auto& pendingRecord : records) {
+            emit(pendingRecord);
+        }
+    }
+    pending_.clear();
+    flush();
+}
+
+// Writes the record if its unit is next in input order, or holds it back otherwise
+void ReportWriter::handle(ReportRecord& record) {
+    if (record.unit != nextUnit_) {
+        pending_[record.unit].push_back(std::move(record));
+        return;
+    }
+
+    emit(record);
+    if (!record.last) {
+        return;
+    }
+    ++nextUnit_;
+
+    // Release the units that were waiting for this one
+    while (!pending_.empty() && pending_.begin()->first == nextUnit_) {
+        auto records = std::move(pending_.begin()->second);
+        pending_.erase(pending_.begin());
+        bool closedUnit = false;
+        for (const auto& pendingRecord : records) {
+            emit(pendingRecord);
+            closedUnit = closedUnit || pendingRecord.last;
+        }
+        if (!closedUnit) {
+            break; // Later records of this unit are written as they arrive
+        }
+        ++nextUnit_;
+    }
+}
+
+// Formats a record into the current batch
+void ReportWriter::emit(const ReportRecord& record) {
+    if (!record.note.empty()) {
+        batch_ << record.note << "\n";
+    }
+    if (record.title.empty()) {
+        return; // Only closes its unit
+    }
+    if (observer_) {
+        observer_(record);
+    }
+    printHeader(batch_, record.title, record.color ? *record.color : RESET);
+    writeReport(batch_, verbosity_, record.metrics, record.summary);
+    if (static_cast<std::size_t>(batch_.tellp()) >= batchBytes_) {
+        flush();
+    }
+}
+
+// Writes the current batch in a single call
+void ReportWriter::flush() {
+    const std::string text = batch_.str();
+    if (!text.empty()) {
+        out_.write(text.data(), static_cast<std::streamsize>(text.size()));
+        out_.flush();
+    }
+    batch_.str(std::string());
+}
@@ -0,0 +1,129 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#ifndef REPORT_WRITER_HPP
+#define REPORT_WRITER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "BoundedQueue.hpp"
+#include "CodeMetrics.hpp"
+
+/**
+ * @struct ReportRecord
+ *
+ * @brief A finished metrics report waiting to be written.
+ *
+ * @details Records belong to a unit, the position of a file in the input. Records of one unit
+ * are written in the order they were submitted, and units are written in input order whatever
+ * order they finish in. A record with an empty title only closes its unit, after writing its
+ * note if it has one.
+ *
+ * @member unit The input position of the file the record belongs to.
+ * @member last Whether this is the final record of its unit.
+ * @member title The title of the report header.
+ * @member color The color of the report header.
+ * @member metrics The calculated metrics.
+ * @member summary The token counts for the additional statistics.
+ * @member note A line written before the report, such as why a file was skipped.
+ * @member apis The API tokens of the code reported on, with their occurrences; only gathered for --api-index.
+ */
+struct ReportRecord {
+    std::size_t unit = 0;
+    bool last = true;
+    std::string title;
+    const std::string* color = nullptr;
+    HalsteadMetrics metrics{};
+    StatisticsSummary summary{};
+    std::string note;
+    std::vector<std::pair<std::string, std::uint32_t>> apis;
+};
+
+/**
+ * @class ReportWriter
+ *
+ * @brief Formats and writes metric reports on a dedicated thread.
+ *
+ * @details Analysis threads submit records through a bounded lock-free queue and carry on.
+ * The writer thread puts records back into input order, formats them into a batch and writes
+ * the batch in one call once it is large enough or the queue runs dry. A slow output stream
+ * only stalls the analysis once the queue is full.
+ */
+class ReportWriter {
+public:
+    /**
+     * @brief Starts the writer thread.
+     *
+     * @param out The stream reports are written to.
+     * @param verbosity The level of verbosity for the reports.
+     * @param capacity The number of records the queue can hold.
+     * @param batchBytes The size at which a batch is written out.
+     */
+    ReportWriter(std::ostream& out, int verbosity, std::size_t capacity = 4096, std::size_t batchBytes = 1 << 20);
+
+    /**
+     * @brief Writes every pending record and stops the writer thread.
+     */
+    ~ReportWriter();
+
+    ReportWriter(const ReportWriter&) = delete;
+    ReportWriter& operator=(const ReportWriter&) = delete;
+
+    /**
+     * @brief Queues a record, waiting only while the queue is full. Safe to call from several threads.
+     *
+     * @param record The record to write.
+     */
+    void submit(ReportRecord record);
+
+    /**
+     * @brief Closes a unit that produced no report.
+     *
+     * @param unit The input position of the file.
+     * @param note A line to write in place of the report, or an empty string to write nothing.
+     */
+    void skip(std::size_t unit, std::string note = "");
+
+    /**
+     * @brief Writes every pending record and stops the writer thread. Called by the destructor.
+     */
+    void close();
+
+    /**
+     * @brief Shows every report to an observer as it is written, on the writer thread and in input order.
+     *
+     * @param observer Called with each record that has a title. Must be set before the first record is submitted.
+     */
+    void observe(std::function<void(const ReportRecord&)> observer) { observer_ = std::move(observer); }
+
+private:
+    void run();
+    void handle(ReportRecord& record);
+    void emit(const ReportRecord& record);
+    void flush();
+
+    std::ostream& out_;
+    int verbosity_;
+    std::size_t batchBytes_;
+    BoundedQueue<ReportRecord> queue_;
+    std::atomic<bool> closed_{false};
+    std::function<void(const ReportRecord&)> observer_;
+
+    // Only touched by the writer thread
+    std::size_t nextUnit_ = 0;
+    std::map<std::size_t, std::vector<ReportRecord>> pending_;
+    std::ostringstream batch_;
+
+    std::thread thread_;
+};
+
+#endif // REPORT_WRITER_HPP
@@ -0,0 +1,673 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#include "ResultStore.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <limits>
+#include <map>
+
+namespace {
+
+constexpr char Magic[4] = {'C', '3', 'R', 'S'};
+constexpr std::uint32_t Version = 1;
+constexpr std::size_t MetricCount = static_cast<std::size_t>(StoreMetric::COUNT);
+constexpr std::uint32_t NoFile = std::numeric_limits<std::uint32_t>::max();
+
+const char* const MetricNames[MetricCount] = {
+    "n1", "n2", "N1", "N2", "volume", "difficulty", "effort", "time", "bugs", "conditions", "cyclomatic", "lines", "maintainability"
+};
+
+struct Header {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t rows;
+    std::uint64_t files;
+    std::uint64_t nameBytes;
+    std::uint64_t pathBytes;
+};
+
+bool isReal(StoreMetric metric) {
+    switch (metric) {
+        case StoreMetric::VOLUME:
+        case StoreMetric::DIFFICULTY:
+        case StoreMetric::EFFORT:
+        case StoreMetric::TIME:
+        case StoreMetric::BUGS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+double metricValue(const HalsteadMetrics& metrics, StoreMetric metric) {
+    switch (metric) {
+        case StoreMetric::UNIQUE_OPERATORS: return metrics.n1;
+        case StoreMetric::UNIQUE_OPERANDS: return metrics.n2;
+        case StoreMetric::OPERATORS: return metrics.N1;
+        case StoreMetric::OPERANDS: return metrics.N2;
+        case StoreMetric::VOLUME: return metrics.volume;
+        case StoreMetric::DIFFICULTY: return metrics.difficulty;
+        case StoreMetric::EFFORT: return metrics.effort;
+        case StoreMetric::TIME: return metrics.timeRequired;
+        case StoreMetric::BUGS: return metrics.numberOfBugs;
+        case StoreMetric::CONDITIONS: return metrics.conditions;
+        case StoreMetric::CYCLOMATIC: return metrics.cyclomaticComplexity;
+        case StoreMetric::LINES: return metrics.linesOfCode;
+        case StoreMetric::MAINTAINABILITY: return metrics.maintainabilityIndex;
+        case StoreMetric::COUNT: break;
+    }
+    return 0;
+}
+
+std::size_t align(std::size_t offset) {
+    return (offset + 7) & ~static_cast<std::size_t>(7);
+}
+
+// Offsets of the sections of a store; every column starts on an 8-byte boundary
+struct Layout {
+    std::size_t kinds, files, nameEnds, columns[MetricCount], pathEnds, paths, names, size;
+};
+
+Layout layout(const Header& header) {
+    Layout at;
+    std::size_t offset = sizeof(Header);
+    at.kinds = offset;
+    offset = align(offset + header.rows);
+    at.files = offset;
+    offset = align(offset + header.rows * sizeof(std::uint32_t));
+    at.nameEnds = offset;
+    offset += header.rows * sizeof(std::uint64_t);
+    for (std::size_t i = 0; i < MetricCount; ++i) {
+        at.columns[i] = offset;
+        offset = align(offset + header.rows * (isReal(static_cast<StoreMetric>(i)) ? sizeof(double) : sizeof(std::int32_t)));
+    }
+    at.pathEnds = offset;
+    offset += header.files * sizeof(std::uint64_t);
+    at.paths = offset;
+    offset += header.pathBytes;
+    at.names = offset;
+    at.size = offset + header.nameBytes;
+    return at;
+}
+
+// Whether the ends of a run of strings grow and stop at the size of their blob
+bool validEnds(const std::uint64_t* ends, std::size_t count, std::uint64_t bytes) {
+    std::uint64_t previous = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        if (ends[i] < previous) {
+            return false;
+        }
+        previous = ends[i];
+    }
+    return previous == bytes;
+}
+
+enum class Compare { LESS, LESS_EQUAL, GREATER, GREATER_EQUAL, EQUAL, NOT_EQUAL };
+
+struct Condition {
+    StoreMetric metric;
+    Compare compare;
+    double value;
+};
+
+// Reads a condition such as "cyclomatic>15"
+bool parseCondition(const std::string& text, Condition& condition) {
+    auto begin = text.find_first_of("<>=!");
+    if (begin == std::string::npos) {
+        return false;
+    }
+    auto end = text.find_first_not_of("<>=!", begin);
+    std::string name = text.substr(0, begin);
+    name.erase(std::remove(name.begin(), name.end(), ' '), name.end());
+    std::string op = text.substr(begin, end - begin);
+    if (!parseStoreMetric(name, condition.metric) || end == std::string::npos) {
+        return false;
+    }
+
+    if (op == "<") {
+        condition.compare = Compare::LESS;
+    } else if (op == "<=") {
+        condition.compare = Compare::LESS_EQUAL;
+    } else if (op == ">") {
+        condition.compare = Compare::GREATER;
+    } else if (op == ">=") {
+        condition.compare = Compare::GREATER_EQUAL;
+    } else if (op == "=" || op == "==") {
+        condition.compare = Compare::EQUAL;
+    } else if (op == "!=") {
+        condition.compare = Compare::NOT_EQUAL;
+    } else {
+        return false;
+    }
+
+    std::size_t parsed = 0;
+    try {
+        condition.value = std::stod(text.substr(end), &parsed);
+    } catch (const std::exception&) {
+        return false;
+    }
+    return text.find_first_not_of(' ', end + parsed) == std::string::npos;
+}
+
+// Compacts the selection to the rows that pass; one column, read in row order
+template <typename T, typename Test>
+void keep(const T* column, double value, Test test, std::vector<std::uint32_t>& rows) {
+    std::size_t kept = 0;
+    for (std::uint32_t row : rows) {
+        if (test(static_cast<double>(column[row]), value)) {
+            rows[kept++] = row;
+        }
+    }
+    rows.resize(kept);
+}
+
+template <typename T>
+void filter(const T* column, const Condition& condition, std::vector<std::uint32_t>& rows) {
+    switch (condition.compare) {
+        case Compare::LESS: keep(column, condition.value, std::less<double>(), rows); break;
+        case Compare::LESS_EQUAL: keep(column, condition.value, std::less_equal<double>(), rows); break;
+        case Compare::GREATER: keep(column, condition.value, std::greater<double>(), rows); break;
+        case Compare::GREATER_EQUAL: keep(column, condition.value, std::greater_equal<double>(), rows); break;
+        case Compare::EQUAL: keep(column, condition.value, std::equal_to<double>(), rows); break;
+        case Compare::NOT_EQUAL: keep(column, condition.value, std::not_equal_to<double>(), rows); break;
+    }
+}
+
+// Strips ":asc" or ":desc" off a sort key; highest first unless asked otherwise
+std::string sortKey(std::string key, bool& ascending) {
+    ascending = false;
+    for (const char* suffix : {":asc", ":desc"}) {
+        std::size_t length = std::strlen(suffix);
+        if (key.size() > length && key.compare(key.size() - length, length, suffix) == 0) {
+            ascending = suffix[1] == 'a';
+            key.resize(key.size() - length);
+        }
+    }
+    return key;
+}
+
+// Orders (key, row) pairs, undefined keys last either way, then in row order
+void sortPairs(std::vector<std::pair<double, std::uint32_t>>& pairs, bool ascending, std::size_t limit) {
+    double last = ascending ? std::numeric_limits<double>::infinity() : -std::numeric_limits<double>::infinity();
+    for (auto& pair : pairs) {
+        if (std::isnan(pair.first)) {
+            pair.first = last;
+        }
+    }
+    auto order = [ascending](const auto& a, const auto& b) {
+        if (a.first != b.first) {
+            return ascending ? a.first < b.first : a.first > b.first;
+        }
+        return a.second < b.second;
+    };
+    if (limit > 0 && limit < pairs.size()) {
+        std::partial_sort(pairs.begin(), pairs.begin() + static_cast<std::ptrdiff_t>(limit), pairs.end(), order);
+        pairs.resize(limit);
+    } else {
+        std::sort(pairs.begin(), pairs.end(), order);
+    }
+}
+
+struct Aggregate {
+    enum class Kind { COUNT, SUM, AVERAGE, MIN, MAX } kind;
+    StoreMetric metric;
+    std::string name;
+};
+
+// Reads a list such as "count,sum:effort,max:cyclomatic"
+bool parseAggregates(const std::string& text, std::vector<Aggregate>& aggregates) {
+    std::size_t begin = 0;
+    while (begin <= text.size()) {
+        std::size_t end = std::min(text.find(',', begin), text.size());
+        std::string item = text.substr(begin, end - begin);
+        begin = end + 1;
+        if (item == "count") {
+            aggregates.push_back({Aggregate::Kind::COUNT, StoreMetric::COUNT, item});
+            continue;
+        }
+        auto colon = item.find(':');
+        if (colon == std::string::npos) {
+            return false;
+        }
+        std::string function = item.substr(0, colon);
+        Aggregate aggregate{Aggregate::Kind::COUNT, StoreMetric::COUNT, item};
+        if (function == "sum") {
+            aggregate.kind = Aggregate::Kind::SUM;
+        } else if (function == "avg") {
+            aggregate.kind = Aggregate::Kind::AVERAGE;
+        } else if (function == "min") {
+            aggregate.kind = Aggregate::Kind::MIN;
+        } else if (function == "max") {
+            aggregate.kind = Aggregate::Kind::MAX;
+        } else {
+            return false;
+        }
+        if (!parseStoreMetric(item.substr(colon + 1), aggregate.metric)) {
+            return false;
+        }
+        aggregates.push_back(aggregate);
+    }
+    return !aggregates.empty();
+}
+
+// Running values of one aggregate of one group; undefined values are left out
+struct Accumulator {
+    double sum = 0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    std::size_t count = 0;
+
+    void add(double value) {
+        if (std::isnan(value)) {
+            return;
+        }
+        sum += value;
+        min = std::min(min, value);
+        max = std::max(max, value);
+        ++count;
+    }
+};
+
+} // namespace
+
+bool parseStoreMetric(std::string_view name, StoreMetric& metric) {
+    for (std::size_t i = 0; i < MetricCount; ++i) {
+        if (name == MetricNames[i]) {
+            metric = static_cast<StoreMetric>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+ResultStoreBuilder::ResultStoreBuilder(const std::vector<std::filesystem::path>& inputs)
+    : inputs_(inputs), fileOfUnit_(inputs.size(), NoFile) {}
+
+// Reports of files close their unit; the others before them are the functions of the file
+void ResultStoreBuilder::add(const ReportRecord& record) {
+    if (record.title.empty() || record.unit >= inputs_.size()) {
+        return;
+    }
+    std::uint32_t& file = fileOfUnit_[record.unit];
+    if (file == NoFile) {
+        file = static_cast<std::uint32_t>(paths_.size());
+        paths_.push_back(inputs_[record.unit].lexically_normal().string());
+    }
+    kinds_.push_back(record.last ? 0 : 1);
+    files_.push_back(file);
+    if (!record.last) {
+        auto colon = record.title.find(": ");
+        names_.append(colon == std::string::npos ? record.title : record.title.substr(colon + 2));
+    }
+    nameEnds_.push_back(names_.size());
+    metrics_.push_back(record.metrics);
+}
+
+// Lays the rows out column by column, then writes the store next to its place and renames it there
+bool ResultStoreBuilder::save(const std::filesystem::path& path, std::string& error) const {
+    Header header{};
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.rows = kinds_.size();
+    header.files = paths_.size();
+    header.nameBytes = names_.size();
+    std::vector<std::uint64_t> pathEnds;
+    std::string paths;
+    for (const auto& file : paths_) {
+        paths += file;
+        pathEnds.push_back(paths.size());
+    }
+    header.pathBytes = paths.size();
+
+    Layout at = layout(header);
+    std::string data(at.size, '\0');
+    std::memcpy(&data[0], &header, sizeof(header));
+    std::memcpy(&data[at.kinds], kinds_.data(), kinds_.size());
+    std::memcpy(&data[at.files], files_.data(), files_.size() * sizeof(std::uint32_t));
+    std::memcpy(&data[at.nameEnds], nameEnds_.data(), nameEnds_.size() * sizeof(std::uint64_t));
+    for (std::size_t i = 0; i < MetricCount; ++i) {
+        auto metric = static_cast<StoreMetric>(i);
+        char* column = &data[at.columns[i]];
+        for (std::size_t row = 0; row < metrics_.size(); ++row) {
+            double value = metricValue(metrics_[row], metric);
+            if (isReal(metric)) {
+                std::memcpy(column + row * sizeof(double), &value, sizeof(double));
+            } else {
+                auto integer = static_cast<std::int32_t>(value);
+                std::memcpy(column + row * sizeof(std::int32_t), &integer, sizeof(integer));
+            }
+        }
+    }
+    std::memcpy(&data[at.pathEnds], pathEnds.data(), pathEnds.size() * sizeof(std::uint64_t));
+    std::memcpy(&data[at.paths], paths.data(), paths.size());
+    std::memcpy(&data[at.names], names_.data(), names_.size());
+
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    out.close();
+    if (!out) {
+        error = std::strerror(errno);
+        return false;
+    }
+    std::error_code renameError;
+    std::filesystem::rename(temporary, path, renameError);
+    if (renameError) {
+        error = renameError.message();
+        return false;
+    }
+    return true;
+}
+
+ResultStore::~ResultStore() {
+    if (data_) {
+        ::munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+// Maps the whole file, then checks that every section lies within it before pointing into it
+bool ResultStore::open(const std::filesystem::path& path, std::string& error) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) != 0) {
+        error = std::strerror(errno);
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return false;
+    }
+    size_ = static_cast<std::size_t>(st.st_size);
+    void* mapping = size_ >= sizeof(Header) ? ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    error = "not a result store";
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    data_ = static_cast<const char*>(mapping);
+
+    Header header;
+    std::memcpy(&header, data_, sizeof(header));
+    if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version
+        || header.rows > size_ || header.files > size_ || header.nameBytes > size_ || header.pathBytes > size_) {
+        return false;
+    }
+    Layout at = layout(header);
+    if (at.size != size_) {
+        return false;
+    }
+
+    rows_ = header.rows;
+    fileCount_ = header.files;
+    kinds_ = reinterpret_cast<const std::uint8_t*>(data_ + at.kinds);
+    files_ = reinterpret_cast<const std::uint32_t*>(data_ + at.files);
+    nameEnds_ = reinterpret_cast<const std::uint64_t*>(data_ + at.nameEnds);
+    pathEnds_ = reinterpret_cast<const std::uint64_t*>(data_ + at.pathEnds);
+    paths_ = data_ + at.paths;
+    names_ = data_ + at.names;
+    for (std::size_t i = 0; i < MetricCount; ++i) {
+        columns_[i] = data_ + at.columns[i];
+    }
+    if (!validEnds(nameEnds_, rows_, header.nameBytes) || !validEnds(pathEnds_, fileCount_, header.pathBytes)
+        || std::any_of(files_, files_ + rows_, [this](std::uint32_t file) { return file >= fileCount_; })) {
+        return false;
+    }
+    error.clear();
+    return true;
+}
+
+std::string_view ResultStore::name(std::size_t row) const {
+    std::uint64_t begin = row > 0 ? nameEnds_[row - 1] : 0;
+    return std::string_view(names_ + begin, nameEnds_[row] - begin);
+}
+
+std::string_view ResultStore::path(std::uint32_t file) const {
+    std::uint64_t begin = file > 0 ? pathEnds_[file - 1] : 0;
+    return std::string_view(paths_ + begin, pathEnds_[file] - begin);
+}
+
+const std::int32_t* ResultStore::integers(StoreMetric metric) const {
+    return isReal(metric) ? nullptr : reinterpret_cast<const std::int32_t*>(columns_[static_cast<std::size_t>(metric)]);
+}
+
+const double* ResultStore::reals(StoreMetric metric) const {
+    return isReal(metric) ? reinterpret_cast<const double*>(columns_[static_cast<std::size_t>(metric)]) : nullptr;
+}
+
+double ResultStore::value(StoreMetric metric, std::size_t row) const {
+    const double* real = reals(metric);
+    return real ? real[row] : integers(metric)[row];
+}
+
+// Quoted only when it holds a comma, a quote or a line break
+void writeCsvField(std::ostream& out, std::string_view text) {
+    if (text.find_first_of(",\"\n") == std::string_view::npos) {
+        out << text;
+        return;
+    }
+    out << '"';
+    for (char c : text) {
+        if (c == '"') {
+            out << '"';
+        }
+        out << c;
+    }
+    out << '"';
+}
+
+// A prefix ends at a separator or at the end of the path
+bool pathWithin(std::string_view path, std::string_view prefix) {
+    if (prefix.empty() || prefix == ".") {
+        return true;
+    }
+    if (path.compare(0, prefix.size(), prefix) != 0) {
+        return false;
+    }
+    return path.size() == prefix.size() || prefix.back() == '/' || path[prefix.size()] == '/';
+}
+
+// Selects the rows, then writes them sorted, or one line per group
+int runQuery(const ProgramOptions& options, std::ostream& out) {
+    ResultStore store;
+    std::string error;
+    if (!store.open(options.query, error)) {
+        std::cerr << "Error: " << options.query << ": " << error << "\n";
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Condition> conditions;
+    for (const auto& text : options.queryWhere) {
+        Condition condition;
+        if (!parseCondition(text, condition)) {
+            std::cerr << "Error: --where takes a metric, a comparison and a number, such as cyclomatic>15, not " << text << "\n";
+            return EXIT_FAILURE;
+        }
+        conditions.push_back(condition);
+    }
+    const std::string& kind = options.queryKind;
+    if (!kind.empty() && kind != "file" && kind != "function") {
+        std::cerr << "Error: --kind takes file or function\n";
+        return EXIT_FAILURE;
+    }
+    const std::string& group = options.queryGroup;
+    if (!group.empty() && group != "file" && group != "dir" && group != "kind") {
+        std::cerr << "Error: --group takes file, dir or kind\n";
+        return EXIT_FAILURE;
+    }
+    std::vector<Aggregate> aggregates;
+    if (!group.empty() && !parseAggregates(options.queryAggregates, aggregates)) {
+        std::cerr << "Error: --agg takes count, or sum, avg, min or max and a metric, such as sum:effort\n";
+        return EXIT_FAILURE;
+    }
+    bool ascending = false;
+    std::string key = sortKey(options.querySort, ascending);
+    StoreMetric sortMetric = StoreMetric::COUNT;
+    std::size_t sortAggregate = 0;
+    if (group.empty() && !key.empty() && !parseStoreMetric(key, sortMetric)) {
+        std::cerr << "Error: --sort takes a metric, such as effort or effort:asc\n";
+        return EXIT_FAILURE;
+    }
+    if (!group.empty() && !key.empty()) {
+        auto it = std::find_if(aggregates.begin(), aggregates.end(), [&](const Aggregate& a) { return a.name == key; });
+        if (it == aggregates.end()) {
+            std::cerr << "Error: --sort with --group takes one of the --agg aggregates\n";
+            return EXIT_FAILURE;
+        }
+        sortAggregate = static_cast<std::size_t>(it - aggregates.begin());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Files and kind first, as they only take a lookup per row
+    std::string prefix = std::filesystem::path(options.queryWithin).lexically_normal().string();
+    std::vector<char> fileMatches(store.files());
+    for (std::uint32_t file = 0; file < store.files(); ++file) {
+        fileMatches[file] = pathWithin(store.path(file), prefix);
+    }
+    std::vector<std::uint32_t> rows;
+    rows.reserve(store.rows());
+    for (std::uint32_t row = 0; row < store.rows(); ++row) {
+        if (fileMatches[store.file(row)] && (kind.empty() || store.function(row) == (kind == "function"))) {
+            rows.push_back(row);
+        }
+    }
+    for (const auto& condition : conditions) {
+        if (const double* column = store.reals(condition.metric)) {
+            filter(column, condition, rows);
+        } else {
+            filter(store.integers(condition.metric), condition, rows);
+        }
+    }
+    std::size_t matched = rows.size();
+
+    out << std::fixed << std::setprecision(2);
+    if (group.empty()) {
+        std::vector<std::pair<double, std::uint32_t>> pairs;
+        pairs.reserve(rows.size());
+        for (std::uint32_t row : rows) {
+            pairs.emplace_back(sortMetric == StoreMetric::COUNT ? 0 : store.value(sortMetric, row), row);
+        }
+        if (sortMetric != StoreMetric::COUNT) {
+            sortPairs(pairs, ascending, options.queryLimit);
+        } else if (options.queryLimit > 0 && options.queryLimit < pairs.size()) {
+            pairs.resize(options.queryLimit);
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        out << "kind,file,function";
+        for (const char* name : MetricNames) {
+            out << "," << name;
+        }
+        out << "\n";
+        for (const auto& [value, row] : pairs) {
+            out << (store.function(row) ? "function," : "file,");
+            writeCsvField(out, store.path(store.file(row)));
+            out << ",";
+            writeCsvField(out, store.name(row));
+            for (std::size_t i = 0; i < MetricCount; ++i) {
+                auto metric = static_cast<StoreMetric>(i);
+                if (const double* column = store.reals(metric)) {
+                    out << "," << column[row];
+                } else {
+                    out << "," << store.integers(metric)[row];
+                }
+            }
+            out << "\n";
+        }
+        std::clog << "Query: " << matched << " of " << store.rows() << " rows matched in "
+                  << std::chrono::duration<double, std::milli>(elapsed).count() << " ms\n";
+        return EXIT_SUCCESS;
+    }
+
+    // Group of every file, or of every kind
+    std::vector<std::string> names;
+    std::vector<std::uint32_t> groupOfFile(store.files());
+    if (group == "kind") {
+        names = {"file", "function"};
+    } else {
+        std::map<std::string, std::uint32_t> ids;
+        for (std::uint32_t file = 0; file < store.files(); ++file) {
+            std::string name(store.path(file));
+            if (group == "dir") {
+                name = std::filesystem::path(name).parent_path().string();
+            }
+            auto [it, inserted] = ids.try_emplace(name, static_cast<std::uint32_t>(names.size()));
+            if (inserted) {
+                names.push_back(name);
+            }
+            groupOfFile[file] = it->second;
+        }
+    }
+
+    std::vector<std::size_t> counts(names.size(), 0);
+    std::vector<std::vector<Accumulator>> accumulators(aggregates.size(), std::vector<Accumulator>(names.size()));
+    std::vector<std::uint32_t> groups(rows.size());
+    for (std::size_t i = 0; i < rows.size(); ++i) {
+        groups[i] = group == "kind" ? store.function(rows[i]) : groupOfFile[store.file(rows[i])];
+        ++counts[groups[i]];
+    }
+    // Column by column, as for the conditions
+    for (std::size_t a = 0; a < aggregates.size(); ++a) {
+        if (aggregates[a].kind == Aggregate::Kind::COUNT) {
+            continue;
+        }
+        auto& accumulator = accumulators[a];
+        const double* reals = store.reals(aggregates[a].metric);
+        const std::int32_t* integers = store.integers(aggregates[a].metric);
+        for (std::size_t i = 0; i < rows.size(); ++i) {
+            accumulator[groups[i]].add(reals ? reals[rows[i]] : integers[rows[i]]);
+        }
+    }
+    auto result = [&](std::size_t a, std::uint32_t g) {
+        const Accumulator& accumulator = accumulators[a][g];
+        bool empty = accumulator.count == 0;
+        switch (aggregates[a].kind) {
+            case Aggregate::Kind::COUNT: return static_cast<double>(counts[g]);
+            case Aggregate::Kind::SUM: return accumulator.sum;
+            case Aggregate::Kind::AVERAGE: return empty ? std::nan("") : accumulator.sum / accumulator.count;
+            case Aggregate::Kind::MIN: return empty ? std::nan("") : accumulator.min;
+            case Aggregate::Kind::MAX: return empty ? std::nan("") : accumulator.max;
+        }
+        return 0.0;
+    };
+
+    std::vector<std::pair<double, std::uint32_t>> pairs;
+    for (std::uint32_t g = 0; g < names.size(); ++g) {
+        if (counts[g] > 0) {
+            pairs.emplace_back(result(sortAggregate, g), g);
+        }
+    }
+    sortPairs(pairs, ascending, options.queryLimit);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    out << group;
+    for (const auto& aggregate : aggregates) {
+        out << "," << aggregate.name;
+    }
+    out << "\n";
+    for (const auto& pair : pairs) {
+        writeCsvField(out, names[pair.second]);
+        for (std::size_t a = 0; a < aggregates.size(); ++a) {
+            if (aggregates[a].kind == Aggregate::Kind::COUNT) {
+                out << "," << counts[pair.second];
+            } else {
+                out << "," << result(a, pair.second);
+            }
+        }
+        out << "\n";
+    }
+    std::clog << "Query: " << matched << " of " << store.rows() << " rows matched in "
+              << std::chrono::duration<double, std::milli>(elapsed).count() << " ms, " << pairs.size() << " groups\n";
+    return EXIT_SUCCESS;
+}
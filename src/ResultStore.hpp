@@ -0,0 +1,147 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#ifndef RESULT_STORE_HPP
+#define RESULT_STORE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "CodeMetrics.hpp"
+#include "CodeUtils.hpp"
+#include "ReportWriter.hpp"
+
+/**
+ * @brief Metric columns of a result store, in the order of HalsteadMetrics.
+ */
+enum class StoreMetric {
+    UNIQUE_OPERATORS, UNIQUE_OPERANDS, OPERATORS, OPERANDS, VOLUME, DIFFICULTY, EFFORT, TIME, BUGS,
+    CONDITIONS, CYCLOMATIC, LINES, MAINTAINABILITY, COUNT
+};
+
+/**
+ * @brief Reads the name of a metric column, as in the header of --history.
+ *
+ * @param name One of n1, n2, N1, N2, volume, difficulty, effort, time, bugs, conditions, cyclomatic, lines and maintainability.
+ * @param metric Set to the column when the name is known.
+ * @return bool Whether the name is known.
+ */
+bool parseStoreMetric(std::string_view name, StoreMetric& metric);
+
+/**
+ * @class ResultStoreBuilder
+ *
+ * @brief Collects the file and function reports of a run as rows of a result store.
+ *
+ * @details Rows are gathered as the reports are written, one per report of a file or function;
+ * the global, directory and estimated reports are left out. Which rows there are follows the
+ * reports asked for: -f gives the function rows, -a the file rows.
+ */
+class ResultStoreBuilder {
+public:
+    /// @param inputs The input files, to find the path of each report from its unit.
+    explicit ResultStoreBuilder(const std::vector<std::filesystem::path>& inputs);
+
+    /// Adds the row of a report; called in input order
+    void add(const ReportRecord& record);
+
+    /**
+     * @brief Writes the rows as a result store.
+     *
+     * @param path The file to write; it is replaced only once complete.
+     * @param error Set to the reason when the store cannot be written.
+     * @return bool Whether the store was written.
+     */
+    bool save(const std::filesystem::path& path, std::string& error) const;
+
+private:
+    const std::vector<std::filesystem::path>& inputs_;
+    std::vector<std::uint32_t> fileOfUnit_; // Store file of each input, once it has a row
+    std::vector<std::string> paths_;
+    std::vector<std::uint8_t> kinds_;
+    std::vector<std::uint32_t> files_;
+    std::vector<std::uint64_t> nameEnds_;
+    std::string names_;
+    std::vector<HalsteadMetrics> metrics_; // By row; the columns are only laid out on save
+};
+
+/**
+ * @class ResultStore
+ *
+ * @brief A result store mapped into memory, read in place.
+ *
+ * @details Each metric is a column of its own, 32-bit integers or doubles, so a query only
+ * touches the columns it filters, sorts or aggregates on. Rows also carry their kind, the file
+ * they belong to and, for functions, a name; paths are kept once per file.
+ */
+class ResultStore {
+public:
+    ResultStore() = default;
+    ~ResultStore();
+
+    ResultStore(const ResultStore&) = delete;
+    ResultStore& operator=(const ResultStore&) = delete;
+
+    /**
+     * @brief Maps a store written by ResultStoreBuilder.
+     *
+     * @param path The file of the store.
+     * @param error Set to the reason when the file cannot be mapped or is not a store.
+     * @return bool Whether the store is open.
+     */
+    bool open(const std::filesystem::path& path, std::string& error);
+
+    std::size_t rows() const { return rows_; }
+    std::size_t files() const { return fileCount_; }
+
+    /// Whether the row is a function; otherwise it is a file
+    bool function(std::size_t row) const { return kinds_[row] != 0; }
+    std::uint32_t file(std::size_t row) const { return files_[row]; }
+    std::string_view name(std::size_t row) const;
+    std::string_view path(std::uint32_t file) const;
+
+    /// Column of an integer metric, or nullptr for a real one
+    const std::int32_t* integers(StoreMetric metric) const;
+    /// Column of a real metric, or nullptr for an integer one
+    const double* reals(StoreMetric metric) const;
+    double value(StoreMetric metric, std::size_t row) const;
+
+private:
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+    std::size_t rows_ = 0;
+    std::size_t fileCount_ = 0;
+    const std::uint8_t* kinds_ = nullptr;
+    const std::uint32_t* files_ = nullptr;
+    const std::uint64_t* nameEnds_ = nullptr;
+    const std::uint64_t* pathEnds_ = nullptr;
+    const char* names_ = nullptr;
+    const char* paths_ = nullptr;
+    const char* columns_[static_cast<std::size_t>(StoreMetric::COUNT)] = {};
+};
+
+/// Writes a field of a CSV line, quoted as needed
+void writeCsvField(std::ostream& out, std::string_view text);
+
+/// Whether a path lies under a directory given as a path prefix; an empty prefix or "." holds every path
+bool pathWithin(std::string_view path, std::string_view prefix);
+
+/**
+ * @brief Filters, sorts and aggregates the rows of the result store given with --query.
+ *
+ * @param options The settings; where, within, kind, sortBy, groupBy, aggregates and limit shape the query.
+ * @param out The stream the CSV result is written to.
+ * @return int EXIT_SUCCESS, or EXIT_FAILURE when the store cannot be read or the query is malformed.
+ *
+ * @details Conditions are applied column by column over a selection of row numbers, so each
+ * one reads a single column. Without --group, the selected rows are written, sorted when asked
+ * to; with it, one line per group with its aggregates. A line on the log gives the rows
+ * matched and the time taken.
+ */
+int runQuery(const ProgramOptions& options, std::ostream& out = std::cout);
+
+#endif // RESULT_STORE_HPP
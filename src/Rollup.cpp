@@ -0,0 +1,81 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#include "Rollup.hpp"
+
+#include <utility>
+
+#include "CodeUtils.hpp"
+
+namespace {
+
+// Unique tokens of a statistics object, the cost of merging it into another
+CodeStatistics::StatSize tableSize(const CodeStatistics& stats) {
+    return stats.getUniqueOperands() + stats.getUniqueOperators() + stats.getCSSetSize(CodeStatistics::StatsCategory::CONDITION);
+}
+
+} // namespace
+
+// Merges a file into the node of its directory, creating the missing ancestors
+void DirectoryRollup::add(const std::filesystem::path& file, const CodeStatistics& stats, int linesOfCode) {
+    std::filesystem::path directory = std::filesystem::absolute(file).lexically_normal().parent_path();
+    if (!last_ || directory != lastDirectory_) {
+        Node* node = &root_;
+        for (const auto& component : directory) {
+            auto& child = node->children[component.string()];
+            if (!child) {
+                child = std::make_unique<Node>();
+                child->path = node->path / component;
+            }
+            node = child.get();
+        }
+        last_ = node;
+        lastDirectory_ = directory;
+    }
+
+    last_->stats += stats;
+    last_->linesOfCode += linesOfCode;
+    ++last_->directFiles;
+}
+
+// Merges every child into node, computing the metrics of each one before it is dropped
+void DirectoryRollup::fold(Node& node) {
+    node.files = node.directFiles;
+    for (auto& [name, child] : node.children) {
+        fold(*child);
+        // Merging the smaller table into the larger one keeps the total work near-linear
+        if (tableSize(child->stats) > tableSize(node.stats)) {
+            std::swap(node.stats, child->stats);
+        }
+        node.stats += child->stats;
+        child->stats = CodeStatistics();
+        node.linesOfCode += child->linesOfCode;
+        node.files += child->files;
+    }
+    MetricsCalculator metrics(node.stats, node.linesOfCode);
+    node.metrics = metrics.getMetrics();
+    node.summary = summarize(node.stats);
+}
+
+// Submits the reports of node and its descendants, parents first
+void DirectoryRollup::submit(const Node& node, ReportWriter& writer, std::size_t unit, const std::filesystem::path& base) const {
+    std::string title = "Directory Metrics: " + node.path.lexically_proximate(base).string()
+                      + " (" + std::to_string(node.files) + (node.files == 1 ? " file)" : " files)");
+    writer.submit({unit, false, std::move(title), &CYAN, node.metrics, node.summary, {}, {}});
+    for (const auto& [name, child] : node.children) {
+        submit(*child, writer, unit, base);
+    }
+}
+
+// Folds the tree below the deepest directory holding every file and reports it
+void DirectoryRollup::report(ReportWriter& writer, std::size_t unit) {
+    Node* top = &root_;
+    while (top->directFiles == 0 && top->children.size() == 1) {
+        top = top->children.begin()->second.get();
+    }
+    if (top->directFiles == 0 && top->children.empty()) {
+        return; // No file was added
+    }
+
+    fold(*top);
+    submit(*top, writer, unit, std::filesystem::current_path());
+}
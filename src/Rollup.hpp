@@ -0,0 +1,68 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#ifndef ROLLUP_HPP
+#define ROLLUP_HPP
+
+#include <cstddef>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "bison-flex/codestatistics.hh"
+#include "CodeMetrics.hpp"
+#include "ReportWriter.hpp"
+
+/**
+ * @class DirectoryRollup
+ *
+ * @brief Metrics of every directory above the analysed files, gathered in the same pass.
+ *
+ * @details Each file is merged only into the directory that holds it. When the run ends, the
+ * tree is folded bottom-up and every directory is merged once into its parent, the smaller
+ * token tables into the larger, so the cost follows the number of directories and tokens
+ * rather than the number of files times the depth of the tree.
+ */
+class DirectoryRollup {
+public:
+    /**
+     * @brief Adds the statistics of a file to the directory that holds it.
+     *
+     * @param file The path of the file, as given on the command line.
+     * @param stats The statistics of the file.
+     * @param linesOfCode The lines of code of the file.
+     */
+    void add(const std::filesystem::path& file, const CodeStatistics& stats, int linesOfCode);
+
+    /**
+     * @brief Folds the tree and submits one report per directory, in tree order.
+     *
+     * @param writer The writer the reports are submitted to.
+     * @param unit The unit the reports belong to; none of them closes it.
+     *
+     * @details Directories above the deepest one that holds every file are left out, since
+     * their metrics would be the same. The statistics are released as they are folded.
+     */
+    void report(ReportWriter& writer, std::size_t unit);
+
+private:
+    struct Node {
+        std::filesystem::path path;
+        std::map<std::string, std::unique_ptr<Node>> children; // Sorted, for the tree order
+        CodeStatistics stats;
+        int linesOfCode = 0;
+        std::size_t files = 0;       // Under this directory, at any depth, once folded
+        std::size_t directFiles = 0; // Held by this directory itself
+        HalsteadMetrics metrics{};
+        StatisticsSummary summary{};
+    };
+
+    void fold(Node& node);
+    void submit(const Node& node, ReportWriter& writer, std::size_t unit, const std::filesystem::path& base) const;
+
+    Node root_;
+    Node* last_ = nullptr; // Directory of the previous file, as consecutive files often share one
+    std::filesystem::path lastDirectory_;
+};
+
+#endif // ROLLUP_HPP
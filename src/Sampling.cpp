@@ -0,0 +1,332 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#include "Sampling.hpp"
+#include "BatchMetrics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <random>
+#include <sstream>
+
+namespace {
+
+constexpr double Z95 = 1.96; // Two-sided 95% normal quantile
+
+constexpr StatsCategory OperatorCategories[] = {
+    StatsCategory::KEYWORD, StatsCategory::OPERATOR, StatsCategory::APIKEYWORD,
+    StatsCategory::APILLKEYWORD, StatsCategory::CUSTOMKEYWORD
+};
+constexpr StatsCategory OperandCategories[] = {
+    StatsCategory::CONSTANT, StatsCategory::IDENTIFIER, StatsCategory::CSPECIFIER, StatsCategory::TYPE
+};
+
+// Index of the extra quantities after the category counts
+constexpr std::size_t QuantityN1 = CodeStatistics::NumCategories;
+constexpr std::size_t QuantityN2 = QuantityN1 + 1;
+constexpr std::size_t QuantityConditions = QuantityN1 + 2;
+constexpr std::size_t QuantityLines = QuantityN1 + 3;
+
+unsigned int toCount(double value) {
+    return static_cast<unsigned int>(std::llround(std::max(value, 0.0)));
+}
+
+} // namespace
+
+// Cuts the inputs into size strata and draws from each in proportion to its bytes
+SamplePlan planSample(const std::vector<std::int64_t>& sizes, double fraction, std::uint64_t seed, std::size_t strata) {
+    SamplePlan plan;
+    plan.stratumOf.assign(sizes.size(), -1);
+    plan.chosen.assign(sizes.size(), false);
+
+    std::vector<std::size_t> units;
+    for (std::size_t unit = 0; unit < sizes.size(); ++unit) {
+        if (sizes[unit] >= 0) {
+            units.push_back(unit);
+        }
+    }
+    plan.population = units.size();
+    if (units.empty()) {
+        return plan;
+    }
+    std::stable_sort(units.begin(), units.end(), [&](std::size_t a, std::size_t b) { return sizes[a] < sizes[b]; });
+
+    // Strata with the same number of files, from the smallest files to the largest
+    const std::size_t count = std::min(std::max<std::size_t>(strata, 1), units.size());
+    std::vector<std::vector<std::size_t>> members(count);
+    plan.strata.resize(count);
+    std::uint64_t totalBytes = 0;
+    for (std::size_t i = 0; i < units.size(); ++i) {
+        std::size_t h = i * count / units.size();
+        members[h].push_back(units[i]);
+        plan.stratumOf[units[i]] = static_cast<int>(h);
+        plan.strata[h].files++;
+        plan.strata[h].bytes += static_cast<std::uint64_t>(sizes[units[i]]);
+        totalBytes += static_cast<std::uint64_t>(sizes[units[i]]);
+    }
+
+    // Allocation in proportion to bytes, with at least two files per stratum for its variance
+    const double clamped = std::min(std::max(fraction, 0.0), 1.0);
+    const auto target = std::max<std::size_t>(1, static_cast<std::size_t>(std::ceil(clamped * units.size())));
+    std::vector<double> desired(count);
+    std::size_t assigned = 0;
+    for (std::size_t h = 0; h < count; ++h) {
+        auto& stratum = plan.strata[h];
+        desired[h] = totalBytes > 0 ? target * static_cast<double>(stratum.bytes) / totalBytes
+                                    : target * static_cast<double>(stratum.files) / units.size();
+        stratum.sampled = std::min(stratum.files, std::max(std::min<std::size_t>(2, stratum.files),
+                                                           static_cast<std::size_t>(desired[h])));
+        assigned += stratum.sampled;
+    }
+    while (assigned < target) {
+        std::size_t best = count;
+        for (std::size_t h = 0; h < count; ++h) {
+            if (plan.strata[h].sampled < plan.strata[h].files &&
+                (best == count || desired[h] - plan.strata[h].sampled > desired[best] - plan.strata[best].sampled)) {
+                best = h;
+            }
+        }
+        if (best == count) {
+            break;
+        }
+        plan.strata[best].sampled++;
+        ++assigned;
+    }
+
+    // Simple random sampling without replacement inside each stratum
+    std::mt19937_64 rng(seed);
+    for (std::size_t h = 0; h < count; ++h) {
+        auto& pool = members[h];
+        for (std::size_t i = 0; i < plan.strata[h].sampled; ++i) {
+            std::uniform_int_distribution<std::size_t> pick(i, pool.size() - 1);
+            std::swap(pool[i], pool[pick(rng)]);
+            plan.chosen[pool[i]] = true;
+        }
+    }
+    plan.sampled = assigned;
+    return plan;
+}
+
+SampleEstimator::SampleEstimator(const SamplePlan& plan)
+    : plan_(plan), rows_(plan.strata.size())
+{
+}
+
+// Records the totals and the token incidence of a sampled file
+void SampleEstimator::add(std::size_t unit, const CodeStatistics& stats, int linesOfCode, std::uint64_t bytes) {
+    int stratum = unit < plan_.stratumOf.size() ? plan_.stratumOf[unit] : -1;
+    if (stratum < 0) {
+        return;
+    }
+
+    Row row{static_cast<double>(bytes), {}};
+    for (std::size_t i = 0; i < CodeStatistics::NumCategories; ++i) {
+        row.values[i] = static_cast<double>(stats.getCounterValue(static_cast<StatsCategory>(i)));
+    }
+    row.values[QuantityN1] = static_cast<double>(stats.getOperators());
+    row.values[QuantityN2] = static_cast<double>(stats.getOperands());
+    row.values[QuantityConditions] = static_cast<double>(stats.getCounterValue(StatsCategory::CONDITION));
+    row.values[QuantityLines] = static_cast<double>(linesOfCode);
+    rows_[static_cast<std::size_t>(stratum)].push_back(row);
+
+    std::string key;
+    stats.forEachToken([this, &key, stratum](StatsCategory category, std::string_view token, CodeStatistics::StatSize) {
+        key.assign(token.data(), token.size());
+        Incidence& incidence = incidence_[static_cast<std::size_t>(category)][key];
+        if (incidence.files++ == 0) {
+            incidence.stratum = static_cast<std::uint32_t>(stratum);
+        }
+    });
+    ++files_;
+}
+
+// Takes a sampled file that was skipped out of its stratum
+void SampleEstimator::exclude(std::size_t unit, std::uint64_t bytes) {
+    int stratum = unit < plan_.stratumOf.size() ? plan_.stratumOf[unit] : -1;
+    if (stratum < 0) {
+        return;
+    }
+    auto& entry = plan_.strata[static_cast<std::size_t>(stratum)];
+    entry.files--;
+    entry.bytes -= std::min(entry.bytes, bytes);
+    entry.sampled--;
+    plan_.stratumOf[unit] = -1;
+    plan_.population--;
+    plan_.sampled--;
+}
+
+// Separate ratio estimator of a population total, with its 95% interval
+Interval SampleEstimator::total(std::size_t quantity) const {
+    double estimate = 0, variance = 0, observed = 0;
+    double sampleBytes = 0, sampleValue = 0;
+    std::uint64_t unsampledBytes = 0;
+
+    for (std::size_t h = 0; h < rows_.size(); ++h) {
+        const auto& rows = rows_[h];
+        const auto& stratum = plan_.strata[h];
+        if (rows.empty()) {
+            unsampledBytes += stratum.bytes;
+            continue;
+        }
+
+        double sx = 0, sy = 0;
+        for (const auto& row : rows) {
+            sx += row.bytes;
+            sy += row.values[quantity];
+        }
+        sampleBytes += sx;
+        sampleValue += sy;
+        observed += sy;
+
+        const double m = static_cast<double>(rows.size());
+        const double files = static_cast<double>(stratum.files);
+        const bool ratio = sx > 0;
+        const double r = ratio ? sy / sx : sy / m;
+        estimate += ratio ? r * static_cast<double>(stratum.bytes) : r * files;
+
+        if (rows.size() > 1 && rows.size() < stratum.files) {
+            double residuals = 0;
+            for (const auto& row : rows) {
+                double e = row.values[quantity] - (ratio ? r * row.bytes : r);
+                residuals += e * e;
+            }
+            variance += files * files * (1 - m / files) * (residuals / (m - 1)) / m;
+        }
+    }
+
+    // Strata whose sampled files were all skipped use the ratio of the whole sample
+    if (unsampledBytes > 0 && sampleBytes > 0) {
+        estimate += sampleValue / sampleBytes * static_cast<double>(unsampledBytes);
+    }
+
+    const double halfWidth = Z95 * std::sqrt(variance);
+    return {estimate, std::max(estimate - halfWidth, observed), estimate + halfWidth};
+}
+
+// Chao2 richness with finite-population correction and log-normal interval; the sampling
+// fraction is the one the singletons see, through the fractions of their strata
+Interval SampleEstimator::uniques(std::size_t category) const {
+    const auto& incidence = incidence_[category];
+    const double observed = static_cast<double>(incidence.size());
+    const double t = static_cast<double>(files_);
+    if (files_ < 2) {
+        return {observed, observed, observed};
+    }
+
+    double q1 = 0, q2 = 0, unseenSingletons = 0;
+    for (const auto& [token, entry] : incidence) {
+        if (entry.files == 1) {
+            const auto& stratum = plan_.strata[entry.stratum];
+            double p = stratum.files > 0 ? static_cast<double>(stratum.sampled) / stratum.files : 1;
+            q1 += 1;
+            unseenSingletons += p > 0 ? (1 - p) / p : 0;
+        }
+        q2 += entry.files == 2;
+    }
+    const double q = q1 > 0 ? q1 / (q1 + unseenSingletons) : plan_.population > 0 ? t / plan_.population : 1;
+    if (q >= 1) {
+        return {observed, observed, observed};
+    }
+
+    const double a = (t - 1) / t;
+    const double fpc = q / (1 - q) * q1;
+    double unseen, variance;
+    if (q2 > 0) {
+        unseen = q1 * q1 / (2 * q2 / a + fpc);
+        double r = q1 / q2;
+        variance = q2 * (a / 2 * r * r + a * a * r * r * r + a * a / 4 * r * r * r * r);
+    } else {
+        unseen = q1 * (q1 - 1) / (2 / a + fpc);
+        variance = a * q1 * (q1 - 1) / 2 + a * a * q1 * std::pow(2 * q1 - 1, 2) / 4
+                 - a * a * std::pow(q1, 4) / (4 * (observed + unseen));
+    }
+    variance = std::max(variance * (1 - q), 0.0);
+
+    Interval interval{observed + unseen, observed + unseen, observed + unseen};
+    if (unseen > 0 && variance > 0) {
+        double k = std::exp(Z95 * std::sqrt(std::log(1 + variance / (unseen * unseen))));
+        interval.low = observed + unseen / k;
+        interval.high = observed + unseen * k;
+    }
+    return interval;
+}
+
+// Extrapolates every global value and derives the metrics from the point estimates
+SampleEstimate SampleEstimator::estimate() const {
+    SampleEstimate result;
+    result.sampled = files_;
+    result.population = plan_.population;
+
+    std::array<Interval, CodeStatistics::NumCategories> unique;
+    for (std::size_t i = 0; i < CodeStatistics::NumCategories; ++i) {
+        result.summary.counts[i] = toCount(total(i).estimate);
+        unique[i] = uniques(i);
+        result.summary.uniques[i] = toCount(unique[i].estimate);
+    }
+    auto sumUniques = [&unique](const auto& categories) {
+        Interval sum;
+        for (StatsCategory category : categories) {
+            const auto& interval = unique[static_cast<std::size_t>(category)];
+            sum.estimate += interval.estimate;
+            sum.low += interval.low;
+            sum.high += interval.high;
+        }
+        return sum;
+    };
+    result.n1 = sumUniques(OperatorCategories);
+    result.n2 = sumUniques(OperandCategories);
+    result.N1 = total(QuantityN1);
+    result.N2 = total(QuantityN2);
+    result.conditions = total(QuantityConditions);
+    result.linesOfCode = total(QuantityLines);
+
+    result.summary.operators = toCount(result.N1.estimate);
+    result.summary.operands = toCount(result.N2.estimate);
+    result.summary.uniqueOperators = toCount(result.n1.estimate);
+    result.summary.uniqueOperands = toCount(result.n2.estimate);
+
+    MetricsCalculator calculator(toCount(result.n1.estimate), toCount(result.n2.estimate),
+                                 toCount(result.N1.estimate), toCount(result.N2.estimate),
+                                 static_cast<int>(toCount(result.conditions.estimate)),
+                                 static_cast<int>(toCount(result.linesOfCode.estimate)));
+    result.metrics = calculator.getMetrics();
+
+    // Volume and effort at every corner of the count intervals
+    MetricBatch corners;
+    corners.reserve(16);
+    for (int mask = 0; mask < 16; ++mask) {
+        auto pick = [mask](const Interval& interval, int bit) { return (mask >> bit) & 1 ? interval.high : interval.low; };
+        corners.add(pick(result.n1, 0), pick(result.n2, 1), pick(result.N1, 2), pick(result.N2, 3),
+                    result.conditions.estimate, result.linesOfCode.estimate);
+    }
+    corners.compute();
+    auto bounds = [](const std::vector<double>& column, double estimate) {
+        auto [low, high] = std::minmax_element(column.begin(), column.end());
+        return Interval{estimate, std::min(*low, estimate), std::max(*high, estimate)};
+    };
+    result.volume = bounds(corners.volume, result.metrics.volume);
+    result.effort = bounds(corners.effort, result.metrics.effort);
+    return result;
+}
+
+// Writes one line per estimated value with its interval
+void writeIntervals(std::ostream& out, const SampleEstimate& estimate) {
+    const int nameWidth = 45; // Column width for metric names
+    const int valueWidth = 15; // Column width for metric values
+
+    auto formatInterval = [&](const std::string& name, const Interval& interval) {
+        std::ostringstream ss;
+        ss << std::fixed << std::setprecision(2);
+        ss << std::left << std::setw(nameWidth) << name << " "
+           << std::right << std::setw(valueWidth) << interval.estimate
+           << " [" << interval.low << ", " << interval.high << "]\n";
+        return ss.str();
+    };
+
+    out << "Sampled " << estimate.sampled << " of " << estimate.population << " files, 95% confidence intervals:\n"
+        << std::string(80, '-') << "\n"
+        << formatInterval("n1 (unique operators)", estimate.n1) << formatInterval("n2 (unique operands)", estimate.n2)
+        << formatInterval("N1 (total # operators)", estimate.N1) << formatInterval("N2 (total # operands)", estimate.N2)
+        << formatInterval("Volume", estimate.volume) << formatInterval("Effort", estimate.effort)
+        << std::string(80, '-') << "\n";
+}
@@ -0,0 +1,149 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#ifndef SAMPLING_HPP
+#define SAMPLING_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bison-flex/codestatistics.hh"
+#include "CodeMetrics.hpp"
+
+/**
+ * @struct SamplePlan
+ *
+ * @brief Files chosen for a sampled run, and the strata they were drawn from.
+ *
+ * @details Inputs are sorted by size and cut into strata holding the same number of files.
+ * The sample is spread over the strata in proportion to their bytes, so strata of large
+ * files, which hold most of the code, get most of the sample.
+ */
+struct SamplePlan {
+    struct Stratum {
+        std::size_t files = 0;   ///< Files in the population.
+        std::uint64_t bytes = 0; ///< Bytes in the population.
+        std::size_t sampled = 0; ///< Files drawn from it.
+    };
+
+    std::vector<Stratum> strata;
+    std::vector<int> stratumOf; ///< Stratum of each unit, -1 when it is not part of the population.
+    std::vector<bool> chosen;   ///< Whether each unit is in the sample.
+    std::size_t population = 0; ///< Files in the population.
+    std::size_t sampled = 0;    ///< Files in the sample.
+};
+
+/**
+ * @brief Draws a stratified random sample of the inputs.
+ *
+ * @param sizes The size of each unit, or -1 for units that cannot be analysed.
+ * @param fraction The fraction of files to analyse, in (0, 1].
+ * @param seed The seed of the random generator, so a sample can be reproduced.
+ * @param strata The number of size strata.
+ * @return SamplePlan The chosen files.
+ */
+SamplePlan planSample(const std::vector<std::int64_t>& sizes, double fraction, std::uint64_t seed, std::size_t strata = 8);
+
+/**
+ * @struct Interval
+ *
+ * @brief An estimate with its 95% confidence interval.
+ */
+struct Interval {
+    double estimate = 0;
+    double low = 0;
+    double high = 0;
+};
+
+/**
+ * @struct SampleEstimate
+ *
+ * @brief Global values extrapolated from a sample.
+ */
+struct SampleEstimate {
+    Interval n1, n2, N1, N2, conditions, linesOfCode;
+    Interval volume, effort; ///< Bounds over the corners of the n1, n2, N1 and N2 intervals.
+    HalsteadMetrics metrics;    ///< Metrics of the point estimates, computed by MetricsCalculator.
+    StatisticsSummary summary;  ///< Estimated counts per category.
+    std::size_t sampled = 0;
+    std::size_t population = 0;
+};
+
+/**
+ * @class SampleEstimator
+ *
+ * @brief Extrapolates global metrics from the files of a sample.
+ *
+ * @details Totals (N1, N2, conditions, lines of code and the count of each category) use a
+ * separate ratio estimator per stratum, with file size as the auxiliary variable, since token
+ * counts grow with size. Unique counts (n1, n2) use Chao2 with the finite-population
+ * correction of Chao and Lin, on how many sampled files each token appears in, with Chao's
+ * log-normal confidence interval. Files of different strata are drawn with different
+ * probabilities, while the correction assumes one sampling fraction q for every file, so q is
+ * replaced with the fraction that makes q / (1 - q) times the singletons equal to their
+ * Horvitz-Thompson sum: each token seen in a single file counts (1 - p) / p, p being the
+ * fraction of its stratum that was sampled. With the same fraction in every stratum this is
+ * Chao and Lin's estimator; the doubletons are still counted unweighted. All intervals are
+ * at 95%.
+ */
+class SampleEstimator {
+public:
+    explicit SampleEstimator(const SamplePlan& plan);
+
+    /**
+     * @brief Adds an analysed file of the sample.
+     *
+     * @param unit The input position of the file.
+     * @param stats The statistics of the file.
+     * @param linesOfCode The lines of code of the file.
+     * @param bytes The size of the file.
+     */
+    void add(std::size_t unit, const c3ms::CodeStatistics& stats, int linesOfCode, std::uint64_t bytes);
+
+    /**
+     * @brief Removes a sampled file that could not be analysed from the population.
+     *
+     * @param unit The input position of the file.
+     * @param bytes The size of the file.
+     *
+     * @details Files skipped by the budgets or the sniffer are only detected when sampled, so
+     * the unsampled ones like them stay in the population and inflate the estimates slightly.
+     */
+    void exclude(std::size_t unit, std::uint64_t bytes);
+
+    SampleEstimate estimate() const;
+
+private:
+    // Per-file values: category counts, then N1, N2, conditions and lines of code
+    static constexpr std::size_t Quantities = c3ms::CodeStatistics::NumCategories + 4;
+    struct Row {
+        double bytes;
+        std::array<double, Quantities> values;
+    };
+
+    Interval total(std::size_t quantity) const;
+    Interval uniques(std::size_t category) const;
+
+    SamplePlan plan_;
+    std::vector<std::vector<Row>> rows_; // Per stratum
+    struct Incidence {
+        std::uint32_t files = 0;   // Sampled files the token appears in
+        std::uint32_t stratum = 0; // Stratum of the first of them
+    };
+    std::array<std::unordered_map<std::string, Incidence>, c3ms::CodeStatistics::NumCategories> incidence_;
+    std::size_t files_ = 0;
+};
+
+/**
+ * @brief Writes the confidence intervals of a sampled run.
+ *
+ * @param out The stream the intervals are written to.
+ * @param estimate The estimate to write.
+ */
+void writeIntervals(std::ostream& out, const SampleEstimate& estimate);
+
+#endif // SAMPLING_HPP
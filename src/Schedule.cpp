@@ -0,0 +1,96 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#include "Schedule.hpp"
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+// One "seconds<TAB>path" line per file; blank lines are allowed
+bool CostModel::load(const std::filesystem::path& path, std::string& error) {
+    std::ifstream in(path);
+    if (!in) {
+        if (errno == ENOENT) {
+            return true;
+        }
+        error = std::strerror(errno);
+        return false;
+    }
+    std::string line;
+    for (std::size_t number = 1; std::getline(in, line); ++number) {
+        if (line.empty()) {
+            continue;
+        }
+        auto tab = line.find('\t');
+        double seconds = 0;
+        std::size_t used = 0;
+        try {
+            seconds = std::stod(line.substr(0, tab), &used);
+        } catch (const std::exception&) {
+            used = 0;
+        }
+        if (tab == std::string::npos || tab == 0 || used != tab || !std::isfinite(seconds) || seconds < 0 || tab + 1 == line.size()) {
+            error = "malformed timing on line " + std::to_string(number);
+            return false;
+        }
+        seconds_[line.substr(tab + 1)] = seconds;
+    }
+    return true;
+}
+
+std::vector<double> CostModel::estimate(const std::vector<std::filesystem::path>& inputs, const std::vector<std::size_t>& units, std::size_t& timed) const {
+    std::vector<double> costs(units.size());
+    std::vector<double> bytes(units.size());
+    std::vector<bool> known(units.size(), false);
+    double timedSeconds = 0, timedBytes = 0;
+    timed = 0;
+    for (std::size_t i = 0; i < units.size(); ++i) {
+        const auto& file = inputs[units[i]];
+        std::error_code error;
+        auto size = std::filesystem::file_size(file, error);
+        bytes[i] = error ? 0 : static_cast<double>(size);
+        auto it = seconds_.find(file.string());
+        if (it != seconds_.end()) {
+            known[i] = true;
+            costs[i] = it->second;
+            timedSeconds += it->second;
+            timedBytes += bytes[i];
+            ++timed;
+        }
+    }
+    // Seconds per byte of the timed files; sizes alone when nothing is timed
+    double rate = timed == 0 ? 1 : timedBytes > 0 ? timedSeconds / timedBytes : 0;
+    for (std::size_t i = 0; i < units.size(); ++i) {
+        if (!known[i]) {
+            costs[i] = bytes[i] * rate;
+        }
+    }
+    return costs;
+}
+
+// Written next to its place and renamed there; paths with a newline cannot be written and are left out
+bool CostModel::save(const std::filesystem::path& path, std::string& error) const {
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    std::ofstream out(temporary, std::ios::trunc);
+    out << std::setprecision(6);
+    for (const auto& [file, seconds] : seconds_) {
+        if (file.find('\n') == std::string::npos) {
+            out << seconds << '\t' << file << '\n';
+        }
+    }
+    out.close();
+    if (!out) {
+        error = std::strerror(errno);
+        return false;
+    }
+    std::error_code renameError;
+    std::filesystem::rename(temporary, path, renameError);
+    if (renameError) {
+        error = renameError.message();
+        return false;
+    }
+    return true;
+}
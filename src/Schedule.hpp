@@ -0,0 +1,59 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#ifndef SCHEDULE_HPP
+#define SCHEDULE_HPP
+
+#include <cstddef>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * @class CostModel
+ *
+ * @brief Estimates what each file costs to analyse, from the time it took in earlier runs or else from its size.
+ *
+ * @details Timings are kept in a text file, one line per file with the seconds it took, a tab
+ * and its path as given on the command line. A file without a timing is estimated from its
+ * size at the rate of the timed files, seconds per byte, so timed and untimed files compare;
+ * when no file is timed, the size alone is the cost.
+ */
+class CostModel {
+public:
+    /**
+     * @brief Reads the timings of earlier runs.
+     *
+     * @param path The timings file; a missing file holds no timings.
+     * @param error Set to the reason when the file cannot be read or is malformed.
+     * @return bool Whether the timings were read.
+     */
+    bool load(const std::filesystem::path& path, std::string& error);
+
+    /**
+     * @brief Estimates the cost of some files.
+     *
+     * @param inputs The input files.
+     * @param units The input positions of the files to estimate.
+     * @param timed Set to how many of them have a timing.
+     * @return The cost of each unit, in seconds when any file is timed and in bytes otherwise.
+     */
+    std::vector<double> estimate(const std::vector<std::filesystem::path>& inputs, const std::vector<std::size_t>& units, std::size_t& timed) const;
+
+    /// Keeps the time a file took, replacing any earlier one
+    void record(const std::filesystem::path& file, double seconds) { seconds_[file.string()] = seconds; }
+
+    /**
+     * @brief Writes every timing, those loaded and those recorded.
+     *
+     * @param path The file to write; it is replaced only once complete.
+     * @param error Set to the reason when the file cannot be written.
+     * @return bool Whether the file was written.
+     */
+    bool save(const std::filesystem::path& path, std::string& error) const;
+
+private:
+    std::map<std::string, double> seconds_; // By path, so the file is written in a stable order
+};
+
+#endif // SCHEDULE_HPP
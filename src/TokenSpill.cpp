@@ -0,0 +1,256 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#include "TokenSpill.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <string_view>
+
+#include "bison-flex/varint.hh"
+
+using c3ms::CodeStatistics;
+using StatsCategory = CodeStatistics::StatsCategory;
+
+namespace {
+
+constexpr std::size_t MaxFanIn = 64;          // Runs merged at once; each holds a stream buffer
+constexpr std::size_t FlushBytes = 64 << 10;  // Run data gathered before it is written
+constexpr std::uint64_t MaxTokenBytes = 1 << 30;
+
+// Tokens one after another: the category as one byte, the length as a varint, then the text
+class RunWriter {
+public:
+    explicit RunWriter(const std::filesystem::path& path) : path_(path), out_(path, std::ios::binary | std::ios::trunc) {}
+
+    void add(std::size_t category, std::string_view token) {
+        buffer_.push_back(static_cast<char>(category));
+        c3ms::putVarint(buffer_, token.size());
+        buffer_.append(token);
+        ++tokens_;
+        if (buffer_.size() >= FlushBytes) {
+            flush();
+        }
+    }
+
+    bool finish(std::string& error) {
+        flush();
+        out_.close();
+        if (!out_) {
+            error = "cannot write " + path_.string() + ": " + std::strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    std::uint64_t tokens() const { return tokens_; }
+    std::uint64_t bytes() const { return bytes_; }
+
+private:
+    void flush() {
+        out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+        bytes_ += buffer_.size();
+        buffer_.clear();
+    }
+
+    std::filesystem::path path_;
+    std::ofstream out_;
+    std::string buffer_;
+    std::uint64_t tokens_ = 0;
+    std::uint64_t bytes_ = 0;
+};
+
+class RunReader {
+public:
+    explicit RunReader(const std::filesystem::path& path) : in_(path, std::ios::binary) {}
+
+    bool opened() const { return static_cast<bool>(in_); }
+    bool failed() const { return failed_; }
+
+    // Reads the next token; false at the end of the run, or with failed() set when it is malformed
+    bool next() {
+        int category = in_.get();
+        if (category == std::char_traits<char>::eof()) {
+            return false;
+        }
+        std::uint64_t size = 0;
+        if (static_cast<std::size_t>(category) >= CodeStatistics::NumCategories || !readSize(size)) {
+            failed_ = true;
+            return false;
+        }
+        this->category = static_cast<std::size_t>(category);
+        token.resize(size);
+        if (!in_.read(token.data(), static_cast<std::streamsize>(size))) {
+            failed_ = true;
+            return false;
+        }
+        return true;
+    }
+
+    std::size_t category = 0;
+    std::string token;
+
+private:
+    bool readSize(std::uint64_t& size) {
+        return c3ms::getVarint(in_, size) && size <= MaxTokenBytes;
+    }
+
+    std::ifstream in_;
+    bool failed_ = false;
+};
+
+} // namespace
+
+TokenSpill::TokenSpill(std::size_t budget, std::filesystem::path directory) : budget_(budget), directory_(std::move(directory)) {
+    if (directory_.empty()) {
+        std::error_code error;
+        directory_ = std::filesystem::temp_directory_path(error);
+        if (error) {
+            directory_ = ".";
+        }
+    }
+}
+
+TokenSpill::~TokenSpill() {
+    for (const auto& run : runs_) {
+        std::error_code error;
+        std::filesystem::remove(run, error);
+    }
+}
+
+// Named after the process, so runs with the same directory do not collide
+std::filesystem::path TokenSpill::nextRun() {
+    return directory_ / ("c3ms-spill-" + std::to_string(::getpid()) + "-" + std::to_string(created_++) + ".run");
+}
+
+bool TokenSpill::check(CodeStatistics& stats, std::string& error) {
+    return stats.memoryUsage().used <= budget_ / 2 || spill(stats, error);
+}
+
+// Writes every category in order, each sorted, so the run is sorted by category and token
+bool TokenSpill::spill(CodeStatistics& stats, std::string& error) {
+    auto path = nextRun();
+    runs_.push_back(path);
+    RunWriter writer(path);
+    std::vector<std::string_view> tokens;
+    for (std::size_t i = 0; i < CodeStatistics::NumCategories; ++i) {
+        tokens.clear();
+        stats.forEachToken(static_cast<StatsCategory>(i), [&tokens](std::string_view token, CodeStatistics::StatSize) {
+            tokens.push_back(token);
+        });
+        std::sort(tokens.begin(), tokens.end());
+        for (auto token : tokens) {
+            writer.add(i, token);
+        }
+    }
+    if (!writer.finish(error)) {
+        return false;
+    }
+    ++report_.runs;
+    report_.tokens += writer.tokens();
+    report_.bytes += writer.bytes();
+    stats.dropTokens();
+    return true;
+}
+
+// A k-way merge through a heap of the readers, by their current token; equal tokens come out
+// one after another, so each is written or counted once
+bool TokenSpill::mergeRuns(const std::vector<std::filesystem::path>& inputs, const std::filesystem::path* output,
+                           std::array<std::size_t, CodeStatistics::NumCategories>* uniques, std::string& error) {
+    std::vector<std::unique_ptr<RunReader>> readers;
+    for (const auto& input : inputs) {
+        readers.push_back(std::make_unique<RunReader>(input));
+        if (!readers.back()->opened()) {
+            error = "cannot read " + input.string() + ": " + std::strerror(errno);
+            return false;
+        }
+    }
+    auto later = [&readers](std::size_t a, std::size_t b) {
+        const RunReader& x = *readers[a];
+        const RunReader& y = *readers[b];
+        return x.category != y.category ? x.category > y.category : x.token > y.token;
+    };
+    std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(later)> heap(later);
+    auto advance = [&](std::size_t i) {
+        if (readers[i]->next()) {
+            heap.push(i);
+        } else if (readers[i]->failed()) {
+            error = inputs[i].string() + " is damaged";
+            return false;
+        }
+        return true;
+    };
+    for (std::size_t i = 0; i < readers.size(); ++i) {
+        if (!advance(i)) {
+            return false;
+        }
+    }
+
+    std::unique_ptr<RunWriter> writer;
+    if (output) {
+        writer = std::make_unique<RunWriter>(*output);
+    }
+    std::size_t lastCategory = CodeStatistics::NumCategories;
+    std::string last;
+    while (!heap.empty()) {
+        std::size_t i = heap.top();
+        heap.pop();
+        const RunReader& reader = *readers[i];
+        if (reader.category != lastCategory || reader.token != last) {
+            if (uniques) {
+                ++(*uniques)[reader.category];
+            }
+            if (writer) {
+                writer->add(reader.category, reader.token);
+            }
+            lastCategory = reader.category;
+            last = reader.token;
+        }
+        if (!advance(i)) {
+            return false;
+        }
+    }
+    return !writer || writer->finish(error);
+}
+
+// Runs beyond the fan-in are merged into longer ones first, oldest first
+bool TokenSpill::merge(CodeStatistics& stats, StatisticsSummary& summary, std::string& error) {
+    if (!spill(stats, error)) {
+        return false;
+    }
+    summary = summarize(stats);
+    while (runs_.size() > MaxFanIn) {
+        std::vector<std::filesystem::path> group(runs_.begin(), runs_.begin() + MaxFanIn);
+        auto merged = nextRun();
+        runs_.erase(runs_.begin(), runs_.begin() + MaxFanIn);
+        runs_.push_back(merged);
+        if (!mergeRuns(group, &merged, nullptr, error)) {
+            runs_.insert(runs_.end(), group.begin(), group.end());
+            return false;
+        }
+        for (const auto& run : group) {
+            std::error_code removeError;
+            std::filesystem::remove(run, removeError);
+        }
+        ++report_.passes;
+    }
+
+    std::array<std::size_t, CodeStatistics::NumCategories> uniques{};
+    if (!mergeRuns(runs_, nullptr, &uniques, error)) {
+        return false;
+    }
+    ++report_.passes;
+
+    auto unique = [&uniques](StatsCategory category) { return uniques[static_cast<std::size_t>(category)]; };
+    summary.uniques = uniques;
+    summary.uniqueOperators = unique(StatsCategory::KEYWORD) + unique(StatsCategory::OPERATOR) + unique(StatsCategory::APIKEYWORD)
+                            + unique(StatsCategory::APILLKEYWORD) + unique(StatsCategory::CUSTOMKEYWORD);
+    summary.uniqueOperands = unique(StatsCategory::CONSTANT) + unique(StatsCategory::IDENTIFIER) + unique(StatsCategory::CSPECIFIER)
+                           + unique(StatsCategory::TYPE);
+    return true;
+}
@@ -0,0 +1,93 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#ifndef TOKEN_SPILL_HPP
+#define TOKEN_SPILL_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "bison-flex/codestatistics.hh"
+#include "CodeMetrics.hpp"
+
+/**
+ * @class TokenSpill
+ *
+ * @brief Keeps the token tables of the global statistics under a memory budget by spilling them to disk.
+ *
+ * @details Once the tables take more than the budget, their tokens are written to a temporary
+ * file as a run sorted by category and token, and the tables start over; the counters stay in
+ * memory, so the totals are exact all along. At the end the runs are merged k at a time, each
+ * token seen once however many runs hold it, to give the exact number of unique tokens of
+ * every category. When there are more runs than can be merged at once, they are first merged
+ * into fewer, longer runs.
+ *
+ * The arena of the tables grows by doubling, so they are spilled once they use half the
+ * budget, which keeps what the arena holds within it. A file whose own tokens take more than
+ * the budget still goes over it for as long as it is being added.
+ */
+class TokenSpill {
+public:
+    /**
+     * @brief What was spilled and merged.
+     */
+    struct Report {
+        std::size_t runs = 0;        ///< Runs written while analysing, the last one at the merge included.
+        std::uint64_t tokens = 0;    ///< Tokens written to those runs.
+        std::uint64_t bytes = 0;     ///< Bytes written to those runs.
+        std::size_t passes = 0;      ///< Merge passes, the last one counting the unique tokens.
+    };
+
+    /**
+     * @param budget The most memory the token tables may hold, in bytes.
+     * @param directory Where the runs are written; the system temporary directory when empty.
+     */
+    TokenSpill(std::size_t budget, std::filesystem::path directory);
+
+    /// Removes the runs left
+    ~TokenSpill();
+
+    TokenSpill(const TokenSpill&) = delete;
+    TokenSpill& operator=(const TokenSpill&) = delete;
+
+    /**
+     * @brief Spills the token tables of the statistics if they take more than the budget.
+     *
+     * @param stats The global statistics; their tables are emptied when spilled.
+     * @param error Set to the reason when a run cannot be written.
+     * @return bool Whether the tables are within the budget again.
+     */
+    bool check(c3ms::CodeStatistics& stats, std::string& error);
+
+    /// Whether any tokens were spilled, so the tables alone no longer give the unique counts
+    bool spilled() const { return !runs_.empty(); }
+
+    /**
+     * @brief Spills what is left of the tables and merges every run.
+     *
+     * @param stats The global statistics; their tables are emptied.
+     * @param summary Set to the counts of the statistics, with the unique tokens of every run.
+     * @param error Set to the reason when a run cannot be written or read.
+     * @return bool Whether the summary is complete.
+     */
+    bool merge(c3ms::CodeStatistics& stats, StatisticsSummary& summary, std::string& error);
+
+    const Report& report() const { return report_; }
+
+private:
+    bool spill(c3ms::CodeStatistics& stats, std::string& error);
+    std::filesystem::path nextRun();
+    bool mergeRuns(const std::vector<std::filesystem::path>& inputs, const std::filesystem::path* output,
+                   std::array<std::size_t, c3ms::CodeStatistics::NumCategories>* uniques, std::string& error);
+
+    std::size_t budget_;
+    std::filesystem::path directory_;
+    std::vector<std::filesystem::path> runs_;
+    std::size_t created_ = 0;
+    Report report_;
+};
+
+#endif // TOKEN_SPILL_HPP
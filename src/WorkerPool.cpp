@@ -0,0 +1,569 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#include "WorkerPool.hpp"
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+// Unit and size of its result, sent back by a worker
+struct Reply {
+    std::uint64_t unit;
+    std::uint64_t size;
+};
+
+// What the parent asks of the launcher: a worker on the memory of a slot, or the status of a dead one.
+// The launcher answers with the pid and the worker's socket, or the status, or -errno
+struct Request {
+    enum Kind : std::int64_t { Spawn, Reap };
+    Kind kind;
+    std::int64_t value;
+};
+
+bool sendAll(int fd, const void* data, std::size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t sent = ::send(fd, p, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        p += sent;
+        size -= static_cast<std::size_t>(sent);
+    }
+    return true;
+}
+
+// False at the end of the stream, when the other side is gone
+bool receiveAll(int fd, void* data, std::size_t size) {
+    char* p = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t received = ::recv(fd, p, size, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        p += received;
+        size -= static_cast<std::size_t>(received);
+    }
+    return true;
+}
+
+// One message on the launcher's socket, with a descriptor when fd is not negative
+bool sendMessage(int socket, const void* data, std::size_t size, int fd) {
+    iovec buffer{const_cast<void*>(data), size};
+    msghdr message{};
+    message.msg_iov = &buffer;
+    message.msg_iovlen = 1;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    if (fd >= 0) {
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        cmsghdr* header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(header), &fd, sizeof(int));
+    }
+    ssize_t sent;
+    do {
+        sent = ::sendmsg(socket, &message, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    return sent == static_cast<ssize_t>(size);
+}
+
+// False when the other side is gone; fd is set to the descriptor that came along, or -1
+bool receiveMessage(int socket, void* data, std::size_t size, int& fd) {
+    iovec buffer{data, size};
+    msghdr message{};
+    message.msg_iov = &buffer;
+    message.msg_iovlen = 1;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    ssize_t received;
+    do {
+        received = ::recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+    fd = -1;
+    for (cmsghdr* header = CMSG_FIRSTHDR(&message); received > 0 && header; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+            std::memcpy(&fd, CMSG_DATA(header), sizeof(int));
+        }
+    }
+    if (received != static_cast<ssize_t>(size) && fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    return received == static_cast<ssize_t>(size);
+}
+
+// What waitpid() said about a worker, for the report of its unit
+std::string describe(int status) {
+    if (WIFSIGNALED(status)) {
+        return "the worker analysing it was killed by signal " + std::to_string(WTERMSIG(status))
+             + " (" + strsignal(WTERMSIG(status)) + ")";
+    }
+    if (WIFEXITED(status)) {
+        return "the worker analysing it exited with status " + std::to_string(WEXITSTATUS(status));
+    }
+    return "the worker analysing it stopped";
+}
+
+// Serves units until the parent closes the socket; never returns
+[[noreturn]] void serve(int channel, int memory, const WorkerPool::Task& task) {
+    WorkerPool::Output output(memory);
+    std::uint64_t unit = 0;
+    while (receiveAll(channel, &unit, sizeof(unit))) {
+        output.clear();
+        try {
+            task(static_cast<std::size_t>(unit), output);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            _exit(EXIT_FAILURE);
+        }
+        Reply reply{unit, output.size()};
+        if (!sendAll(channel, &reply, sizeof(reply))) {
+            break;
+        }
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+// Forks workers and reaps them for the parent until it closes the socket; never returns.
+// Forked before the parent starts any thread, so the workers are forked from one thread too
+[[noreturn]] void launch(int control, const std::vector<int>& memories, const std::function<WorkerPool::Task()>& start) {
+    Request request;
+    int unused = -1;
+    while (receiveMessage(control, &request, sizeof(request), unused)) {
+        std::int64_t reply = 0;
+        int channel = -1;
+        if (request.kind == Request::Spawn && request.value >= 0 && static_cast<std::size_t>(request.value) < memories.size()) {
+            int sockets[2];
+            if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0) {
+                reply = -errno;
+            } else {
+                pid_t pid = ::fork();
+                if (pid == 0) {
+                    ::close(control);
+                    ::close(sockets[0]);
+                    serve(sockets[1], memories[static_cast<std::size_t>(request.value)], start());
+                }
+                reply = pid < 0 ? -errno : pid;
+                ::close(sockets[1]);
+                channel = pid < 0 ? -1 : sockets[0];
+                if (pid < 0) {
+                    ::close(sockets[0]);
+                }
+            }
+        } else if (request.kind == Request::Reap) {
+            int status = 0;
+            pid_t pid;
+            do {
+                pid = ::waitpid(static_cast<pid_t>(request.value), &status, 0);
+            } while (pid < 0 && errno == EINTR);
+            reply = pid < 0 ? -errno : status;
+        } else {
+            reply = -EINVAL;
+        }
+        // Once sent, the parent holds the only end of the worker's socket
+        bool sent = sendMessage(control, &reply, sizeof(reply), channel);
+        if (channel >= 0) {
+            ::close(channel);
+        }
+        if (!sent) {
+            break;
+        }
+    }
+    // The workers end as the parent closes their sockets
+    while (::wait(nullptr) > 0 || errno == EINTR) {
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+} // namespace
+
+// The memory only grows, since the parent may still hold a larger view of it
+void WorkerPool::Output::grow(std::size_t more) {
+    struct stat info;
+    std::size_t held = ::fstat(memory_, &info) == 0 ? static_cast<std::size_t>(info.st_size) : 0;
+    std::size_t capacity = std::max<std::size_t>({size_ + more, capacity_ * 2, held, 1 << 20});
+    if (capacity > held && ::ftruncate(memory_, static_cast<off_t>(capacity)) != 0) {
+        throw std::runtime_error(std::string("cannot grow the shared memory: ") + std::strerror(errno));
+    }
+    void* mapping = data_ ? ::mremap(data_, capacity_, capacity, MREMAP_MAYMOVE)
+                          : ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, memory_, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error(std::string("cannot map the shared memory: ") + std::strerror(errno));
+    }
+    data_ = static_cast<char*>(mapping);
+    capacity_ = capacity;
+}
+
+WorkerPool::Output::~Output() {
+    if (data_) {
+        ::munmap(data_, capacity_);
+    }
+}
+
+// Creates the shared memory of every worker and forks the launcher, then has it fork the workers
+WorkerPool::WorkerPool(std::size_t workers, std::function<Task()> start) : workers_(std::max<std::size_t>(workers, 1)) {
+    std::vector<int> memories;
+    for (auto& worker : workers_) {
+        worker.memory = ::memfd_create("c3ms-worker", MFD_CLOEXEC);
+        if (worker.memory < 0) {
+            throw std::runtime_error(std::string("cannot create shared memory: ") + std::strerror(errno));
+        }
+        memories.push_back(worker.memory);
+    }
+    int sockets[2];
+    if (::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) != 0) {
+        throw std::runtime_error(std::string("cannot start the worker launcher: ") + std::strerror(errno));
+    }
+    launcherPid_ = ::fork();
+    if (launcherPid_ == 0) {
+        ::close(sockets[0]);
+        launch(sockets[1], memories, start);
+    }
+    ::close(sockets[1]);
+    if (launcherPid_ < 0) {
+        ::close(sockets[0]);
+        throw std::runtime_error(std::string("cannot start the worker launcher: ") + std::strerror(errno));
+    }
+    launcher_ = sockets[0];
+    for (auto& worker : workers_) {
+        spawn(worker);
+        if (worker.pid < 0) {
+            throw std::runtime_error(std::string("cannot start a worker: ") + std::strerror(errno));
+        }
+    }
+}
+
+// Closing a socket is the signal for its worker to exit, and closing the launcher's for it to
+// reap them and exit
+WorkerPool::~WorkerPool() {
+    for (auto& worker : workers_) {
+        if (worker.channel >= 0) {
+            ::close(worker.channel);
+        }
+    }
+    if (launcher_ >= 0) {
+        ::close(launcher_);
+    }
+    if (launcherPid_ > 0) {
+        ::waitpid(launcherPid_, nullptr, 0);
+    }
+    for (auto& worker : workers_) {
+        if (worker.view) {
+            ::munmap(const_cast<char*>(worker.view), worker.mapped);
+        }
+        ::close(worker.memory);
+    }
+}
+
+// Has the launcher fork a worker on a new socket; its shared memory is kept from the worker it replaces
+void WorkerPool::spawn(Worker& worker) {
+    Request request{Request::Spawn, static_cast<std::int64_t>(&worker - workers_.data())};
+    std::int64_t reply = -EPIPE;
+    int channel = -1;
+    if (!sendMessage(launcher_, &request, sizeof(request), -1) || !receiveMessage(launcher_, &reply, sizeof(reply), channel)) {
+        reply = -EPIPE;
+    }
+    if (reply <= 0 || channel < 0) {
+        if (channel >= 0) {
+            ::close(channel);
+        }
+        errno = reply < 0 ? static_cast<int>(-reply) : EPROTO;
+        worker.pid = -1;
+        return;
+    }
+    worker.pid = static_cast<pid_t>(reply);
+    worker.channel = channel;
+    worker.busy = false;
+}
+
+// The workers are children of the launcher, so it is the one to wait for them
+bool WorkerPool::reap(pid_t pid, int& status) {
+    Request request{Request::Reap, pid};
+    std::int64_t reply = -EPIPE;
+    int unused = -1;
+    if (!sendMessage(launcher_, &request, sizeof(request), -1) || !receiveMessage(launcher_, &reply, sizeof(reply), unused) || reply < 0) {
+        return false;
+    }
+    status = static_cast<int>(reply);
+    return true;
+}
+
+// Hands queued or assigned units to the idle workers
+void WorkerPool::dispatch() {
+    for (auto& worker : workers_) {
+        if (worker.busy || worker.pid < 0) {
+            continue;
+        }
+        std::size_t unit = 0;
+        if (!next(worker, unit)) {
+            return;
+        }
+        keep(worker);
+        worker.unit = unit;
+        worker.busy = true;
+        worker.started = Clock::now();
+        if (!started_) {
+            started_ = true;
+            firstStart_ = worker.started;
+        }
+        std::uint64_t message = unit;
+        if (!sendAll(worker.channel, &message, sizeof(message))) {
+            bury(worker);
+        }
+    }
+}
+
+// The queue comes first, then the worker's own units, largest first, then the smallest unit
+// of the worker with the most work left
+bool WorkerPool::next(Worker& worker, std::size_t& unit) {
+    if (!queue_.empty()) {
+        unit = queue_.front();
+        queue_.pop_front();
+        return true;
+    }
+    Worker* owner = &worker;
+    if (worker.assigned.empty()) {
+        owner = nullptr;
+        for (auto& other : workers_) {
+            if (!other.assigned.empty() && (!owner || other.backlog > owner->backlog)) {
+                owner = &other;
+            }
+        }
+        if (!owner) {
+            return false;
+        }
+        unit = owner->assigned.back();
+        owner->assigned.pop_back();
+        ++steals_;
+    } else {
+        unit = worker.assigned.front();
+        worker.assigned.pop_front();
+    }
+    auto cost = costs_.find(unit);
+    owner->backlog = owner->assigned.empty() ? 0 : owner->backlog - cost->second;
+    costs_.erase(cost);
+    return true;
+}
+
+// Waits until at least one busy worker replies or dies
+void WorkerPool::wait() {
+    std::vector<pollfd> fds;
+    std::vector<Worker*> polled;
+    for (auto& worker : workers_) {
+        if (worker.busy) {
+            fds.push_back({worker.channel, POLLIN, 0});
+            polled.push_back(&worker);
+        }
+    }
+    if (::poll(fds.data(), fds.size(), -1) < 0) {
+        return; // Interrupted; the caller waits again
+    }
+    for (std::size_t i = 0; i < fds.size(); ++i) {
+        if (fds[i].revents != 0) {
+            receive(*polled[i]);
+        }
+    }
+}
+
+// Maps the worker's shared memory far enough for its result, which stays there until taken
+void WorkerPool::receive(Worker& worker) {
+    Reply reply;
+    if (!receiveAll(worker.channel, &reply, sizeof(reply)) || reply.unit != worker.unit) {
+        bury(worker);
+        return;
+    }
+    if (reply.size > worker.mapped) {
+        if (worker.view) {
+            ::munmap(const_cast<char*>(worker.view), worker.mapped);
+        }
+        void* mapping = ::mmap(nullptr, reply.size, PROT_READ, MAP_SHARED, worker.memory, 0);
+        worker.view = mapping == MAP_FAILED ? nullptr : static_cast<const char*>(mapping);
+        worker.mapped = worker.view ? reply.size : 0;
+        if (!worker.view) {
+            settle(worker, {false, std::string("cannot map the result: ") + std::strerror(errno)});
+            return;
+        }
+    }
+    settle(worker, {true, {}, &worker, reply.size});
+    worker.holding = true;
+}
+
+// Keeps the outcome of the worker's unit until it is taken, and the time the unit took
+void WorkerPool::settle(Worker& worker, Outcome outcome) {
+    worker.finished = Clock::now();
+    double seconds = std::chrono::duration<double>(worker.finished - worker.started).count();
+    worker.busySeconds += seconds;
+    if (outcome.ok) {
+        timings_[worker.unit] = seconds;
+    }
+    outcomes_[worker.unit] = std::move(outcome);
+    worker.busy = false;
+    ++settled_;
+}
+
+// The worker is about to write over its memory, so a result not taken yet is copied out of it
+void WorkerPool::keep(Worker& worker) {
+    if (!worker.holding) {
+        return;
+    }
+    Outcome& outcome = outcomes_.at(worker.unit);
+    outcome.data.assign(worker.view, outcome.size);
+    outcome.holder = nullptr;
+    worker.holding = false;
+}
+
+// The caller is done with the result it was last given
+void WorkerPool::release() {
+    if (lent_) {
+        lent_->holding = false;
+        lent_ = nullptr;
+    }
+}
+
+// A result still in its worker's memory is read from there, and that worker gets no unit until the next call
+bool WorkerPool::hand(std::unordered_map<std::size_t, Outcome>::iterator it, std::string_view& result, std::string& failure) {
+    Outcome& outcome = it->second;
+    bool ok = outcome.ok;
+    if (!ok) {
+        failure = std::move(outcome.data);
+    } else if (outcome.holder) {
+        result = std::string_view(outcome.holder->view, outcome.size);
+        lent_ = outcome.holder;
+    } else {
+        taken_ = std::move(outcome.data);
+        result = taken_;
+    }
+    outcomes_.erase(it);
+    --outstanding_;
+    return ok;
+}
+
+// Records the unit of a dead worker as failed and starts another one
+void WorkerPool::bury(Worker& worker) {
+    ::close(worker.channel);
+    worker.channel = -1;
+    int status = 0;
+    std::string cause = reap(worker.pid, status) ? describe(status) : "the worker analysing it was lost";
+    if (worker.busy) {
+        settle(worker, {false, std::move(cause)});
+    }
+    ++restarts_;
+    spawn(worker);
+}
+
+void WorkerPool::submit(std::size_t unit) {
+    release();
+    queue_.push_back(unit);
+    ++outstanding_;
+    dispatch();
+}
+
+// Greedy largest-first: each unit goes to the worker with the least work so far, ties to the earlier unit
+void WorkerPool::assign(const std::vector<std::size_t>& units, const std::vector<double>& costs) {
+    release();
+    std::vector<std::size_t> order(units.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&costs](std::size_t a, std::size_t b) { return costs[a] > costs[b]; });
+    for (std::size_t i : order) {
+        auto lightest = std::min_element(workers_.begin(), workers_.end(),
+                                         [](const Worker& a, const Worker& b) { return a.backlog < b.backlog; });
+        lightest->assigned.push_back(units[i]);
+        lightest->backlog += costs[i];
+        costs_[units[i]] = costs[i];
+    }
+    outstanding_ += units.size();
+    dispatch();
+}
+
+// Results arrive in any order and wait here until taken
+bool WorkerPool::take(std::size_t unit, std::string_view& result, std::string& failure) {
+    release();
+    while (true) {
+        auto it = outcomes_.find(unit);
+        if (it != outcomes_.end()) {
+            return hand(it, result, failure);
+        }
+        dispatch();
+        bool busy = std::any_of(workers_.begin(), workers_.end(), [](const Worker& worker) { return worker.busy; });
+        if (!busy) {
+            auto queued = std::find(queue_.begin(), queue_.end(), unit);
+            if (queued != queue_.end()) {
+                queue_.erase(queued);
+            }
+            failure = "no worker could be started";
+            --outstanding_;
+            return false;
+        }
+        wait();
+    }
+}
+
+// Whichever outcome is there; when every worker is gone, the units left fail one at a time
+bool WorkerPool::takeNext(std::size_t& unit, std::string_view& result, std::string& failure) {
+    release();
+    while (true) {
+        if (!outcomes_.empty()) {
+            unit = outcomes_.begin()->first;
+            return hand(outcomes_.begin(), result, failure);
+        }
+        dispatch();
+        bool busy = std::any_of(workers_.begin(), workers_.end(), [](const Worker& worker) { return worker.busy; });
+        if (!busy) {
+            // Nothing can finish any more, so the count ends at 0 even when no unit is left to fail
+            if (next(workers_.front(), unit)) {
+                --outstanding_;
+                failure = "no worker could be started";
+            } else {
+                unit = NoUnit;
+                outstanding_ = 0;
+                failure = "no unit was left to take";
+            }
+            return false;
+        }
+        wait();
+    }
+}
+
+// Workers that never finished a unit were idle from the start
+WorkerPool::Report WorkerPool::report() const {
+    Report report;
+    report.units = settled_;
+    report.steals = steals_;
+    if (!started_) {
+        return report;
+    }
+    auto end = firstStart_;
+    for (const auto& worker : workers_) {
+        end = std::max(end, worker.finished);
+    }
+    report.seconds = std::chrono::duration<double>(end - firstStart_).count();
+    for (const auto& worker : workers_) {
+        report.busySeconds += worker.busySeconds;
+        report.tailSeconds += std::chrono::duration<double>(end - std::max(firstStart_, worker.finished)).count();
+    }
+    report.idleSeconds = std::max(0.0, report.seconds * static_cast<double>(workers_.size()) - report.busySeconds);
+    return report;
+}
@@ -0,0 +1,220 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+#ifndef WORKERPOOL_HPP
+#define WORKERPOOL_HPP
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class WorkerPool
+ *
+ * @brief Analyses units in forked worker processes, so a crash only loses the unit it hit.
+ *
+ * @details Each worker owns a shared memory region, a memfd mapped by both processes. A
+ * worker encodes the result of its unit straight into that region and only sends the unit
+ * and the size of the result over a socket; the parent decodes it from its own view of the
+ * region, so a result is never copied. Every worker holds one unit at a time, so when one
+ * dies the unit it held is known: it is reported as failed, with the signal or exit status,
+ * and a new worker takes its place.
+ *
+ * Units can also be assigned up front with their estimated costs: the largest go first, each
+ * to the worker with the least work assigned so far, and a worker whose own units are done
+ * steals the smallest unit left to the worker with the most work. The results are then taken
+ * in the order they finish, and the pool keeps the time each unit took.
+ *
+ * The pool must be created before the program starts any thread. It forks a launcher process
+ * right away, and every worker, replacements included, is forked by that single-threaded
+ * launcher, so no worker inherits a lock another thread held. The workers see the program as
+ * it was when the pool was created, only touch the state the task gives them, and end with
+ * _exit(), leaving the parent's buffered output alone.
+ */
+class WorkerPool {
+public:
+    /**
+     * @class Output
+     *
+     * @brief The result of a unit, written by its worker straight into the shared memory.
+     *
+     * @details Grows like a string; the memory only ever grows, since the parent may still
+     * hold a larger view of it from the worker this one replaced.
+     */
+    class Output {
+    public:
+        explicit Output(int memory) : memory_(memory) {}
+        ~Output();
+
+        Output(const Output&) = delete;
+        Output& operator=(const Output&) = delete;
+
+        void push_back(char c) {
+            if (size_ == capacity_) {
+                grow(1);
+            }
+            data_[size_++] = c;
+        }
+
+        void append(const char* data, std::size_t size) {
+            if (size > capacity_ - size_) {
+                grow(size);
+            }
+            std::memcpy(data_ + size_, data, size);
+            size_ += size;
+        }
+
+        std::size_t size() const { return size_; }
+        void clear() { size_ = 0; }
+
+    private:
+        /// @throws std::runtime_error When the memory cannot be grown.
+        void grow(std::size_t more);
+
+        int memory_;
+        char* data_ = nullptr;
+        std::size_t size_ = 0;
+        std::size_t capacity_ = 0;
+    };
+
+    /// Analyses a unit in a worker and encodes the result into the output
+    using Task = std::function<void(std::size_t unit, Output& result)>;
+
+    /// The unit takeNext() sets when there was none left to take
+    static constexpr std::size_t NoUnit = static_cast<std::size_t>(-1);
+
+    /**
+     * @param workers The number of worker processes.
+     * @param start Called once in each new worker to build its task and per-process state.
+     *
+     * @throws std::runtime_error When the shared memory, the launcher or the first workers cannot be created.
+     */
+    WorkerPool(std::size_t workers, std::function<Task()> start);
+
+    /// Stops the workers once their current units are done
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /**
+     * @brief What the run cost the workers, for units queued or assigned since the pool started.
+     */
+    struct Report {
+        std::size_t units = 0;      ///< Units with a result or a failure.
+        std::size_t steals = 0;     ///< Units a worker took from the units assigned to another one.
+        double seconds = 0;         ///< From the first unit handed out to the last one finished.
+        double busySeconds = 0;     ///< Time the workers spent on units, all of them together.
+        double idleSeconds = 0;     ///< Time the workers spent waiting over that wall time, all of them together.
+        double tailSeconds = 0;     ///< The part of the idle time after a worker's last unit, while others were still busy.
+    };
+
+    /// Queues a unit; units are handed to the workers in the order they are queued
+    void submit(std::size_t unit);
+
+    /**
+     * @brief Assigns units to the workers by their estimated costs, largest first.
+     *
+     * @param units The units.
+     * @param costs The estimated cost of each unit, in any consistent measure.
+     */
+    void assign(const std::vector<std::size_t>& units, const std::vector<double>& costs);
+
+    /**
+     * @brief Waits for the result of a queued unit.
+     *
+     * @param unit The unit, which must have been queued and not taken yet.
+     * @param result Set to the encoded result, which stays valid until the next call to the pool.
+     * @param failure Set to what happened to the worker when it died on the unit.
+     * @return bool Whether the unit has a result; false when its worker died.
+     */
+    bool take(std::size_t unit, std::string_view& result, std::string& failure);
+
+    /**
+     * @brief Waits for the next unit to finish, whichever it is.
+     *
+     * @param unit Set to the unit, or to NoUnit when none was left; outstanding() is then 0.
+     * @param result Set to the encoded result, which stays valid until the next call to the pool.
+     * @param failure Set to what happened to the worker when it died on the unit.
+     * @return bool Whether the unit has a result; false when its worker died.
+     */
+    bool takeNext(std::size_t& unit, std::string_view& result, std::string& failure);
+
+    /// Units queued or assigned and not taken yet
+    std::size_t outstanding() const { return outstanding_; }
+
+    std::size_t size() const { return workers_.size(); }
+
+    /// The cost of the run so far
+    Report report() const;
+
+    /// Seconds each unit with a result took in its worker
+    const std::unordered_map<std::size_t, double>& timings() const { return timings_; }
+
+    /// Workers that died and were replaced
+    std::size_t restarts() const { return restarts_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Worker {
+        pid_t pid = -1;
+        int channel = -1;   // Socket carrying units to the worker, and result sizes back
+        int memory = -1;    // memfd holding the result
+        const char* view = nullptr; // Parent's mapping of the memfd
+        std::size_t mapped = 0;
+        bool busy = false;
+        bool holding = false; // The memfd holds the result of unit, not taken yet or lent to the caller
+        std::size_t unit = 0;
+        std::deque<std::size_t> assigned; // Largest first; others steal from the back
+        double backlog = 0;               // Estimated cost of the assigned units
+        Clock::time_point started;
+        Clock::time_point finished;
+        double busySeconds = 0;
+    };
+
+    struct Outcome {
+        bool ok = false;
+        std::string data;         // What happened to the worker, or a result copied out of its memory
+        Worker* holder = nullptr; // Worker whose memory still holds the result
+        std::size_t size = 0;     // Of the result in the holder's memory
+    };
+
+    void spawn(Worker& worker);
+    bool reap(pid_t pid, int& status);
+    void dispatch();
+    void wait();
+    void receive(Worker& worker);
+    void bury(Worker& worker);
+    void settle(Worker& worker, Outcome outcome);
+    void keep(Worker& worker);
+    void release();
+    bool hand(std::unordered_map<std::size_t, Outcome>::iterator it, std::string_view& result, std::string& failure);
+    bool next(Worker& worker, std::size_t& unit);
+
+    int launcher_ = -1; // Socket to the process that forks the workers
+    pid_t launcherPid_ = -1;
+    std::vector<Worker> workers_;
+    std::deque<std::size_t> queue_;
+    std::unordered_map<std::size_t, Outcome> outcomes_;
+    std::unordered_map<std::size_t, double> costs_; // Of the assigned units not handed out yet
+    std::unordered_map<std::size_t, double> timings_;
+    Worker* lent_ = nullptr; // Worker whose memory holds the result the caller was last given
+    std::string taken_;      // Or the result itself, when it had been copied out
+    std::size_t outstanding_ = 0;
+    std::size_t settled_ = 0;
+    std::size_t steals_ = 0;
+    bool started_ = false;
+    Clock::time_point firstStart_;
+    std::size_t restarts_ = 0;
+};
+
+#endif // WORKERPOOL_HPP
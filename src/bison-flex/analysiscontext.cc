@@ -0,0 +1,180 @@
+#include "analysiscontext.hh"
+#include "chunkedparser.hh"
+#include "parser.hh"
+#include "scanner.hh"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace c3ms
+{
+    AnalysisContext::AnalysisContext(std::ostream* diagnostics)
+        : scanner_(std::make_unique<CodeScanner>()),
+          parser_(std::make_unique<CodeParser>(*this)),
+          diagnostics_(diagnostics),
+          viewStream_(&viewBuffer_),
+          segmentStream_(&segmentBuffer_)
+    {
+        // scanner_->set_debug(true);
+    }
+
+    AnalysisContext::~AnalysisContext() = default;
+
+    int AnalysisContext::parse(std::istream &iss, CodeStatistics& stats)
+    {
+        stats_ = &stats;
+        stats.setTokenSink(options_.sink);
+        report_.unterminated = false;
+        scanner_->reset(&iss, firstLine_);
+        parser_->parse();
+        // A comment or an #include still open at the end of the input
+        if (!scanner_->at_top_level()) {
+            report_.unterminated = true;
+        }
+        stats.setTokenSink(nullptr);
+        stats_ = nullptr;
+        return stats.getError();
+    }
+
+    int AnalysisContext::line() const
+    {
+        return scanner_->lineno();
+    }
+
+    int AnalysisContext::parse_buffer(std::string_view code, CodeStatistics& stats)
+    {
+        if (options_.chunker && !options_.sink && options_.chunker->splits(code.size())) {
+            if (options_.preprocessor) {
+                // Chunks are cut from contiguous text, so the active branches are copied once
+                stripped_ = options_.preprocessor->strip(code, filtered_);
+                report_ = ScanReport{filtered_.skippedBytes, filtered_.skippedRegions};
+                return options_.chunker->parse(*this, stripped_, stats);
+            }
+            report_ = ScanReport{};
+            return options_.chunker->parse(*this, code, stats);
+        }
+
+        if (options_.preprocessor) {
+            options_.preprocessor->filter(code, filtered_);
+            report_.skippedBytes = filtered_.skippedBytes;
+            report_.skippedRegions = filtered_.skippedRegions;
+            segmentBuffer_.reset(&filtered_.segments);
+            segmentStream_.clear();
+            return parse(segmentStream_, stats);
+        }
+
+        report_ = ScanReport{};
+        return parse_view(code, stats);
+    }
+
+    int AnalysisContext::parse_view(std::string_view code, CodeStatistics& stats, int firstLine)
+    {
+        viewBuffer_.reset(code);
+        viewStream_.clear();
+        firstLine_ = firstLine;
+        int errors = parse(viewStream_, stats);
+        firstLine_ = 1;
+        return errors;
+    }
+
+    int AnalysisContext::parse_file(const std::string &path, CodeStatistics& stats)
+    {
+        return parse_buffer(read_file(path), stats);
+    }
+
+    std::string_view AnalysisContext::read_file(const std::string& path)
+    {
+        // An unreadable file is analysed as an empty one, as std::ifstream used to do, but a
+        // read that fails partway is reported rather than taken for the whole file
+        if (!load(path)) {
+            if (diagnostics_) {
+                *diagnostics_ << "Warning: cannot read " << path << ": " << std::strerror(errno) << std::endl;
+            }
+            fileBuffer_.clear();
+        }
+        return fileBuffer_;
+    }
+
+    bool AnalysisContext::load(const std::string& path)
+    {
+        return read_file_into(path, fileBuffer_);
+    }
+
+    bool read_file_into(const std::string& path, std::string& buffer)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            return false;
+        }
+        // The whole file is read front to back, so the kernel may read ahead further than usual
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        // Size the buffer from fstat, plus one byte to detect EOF in a single read
+        struct stat st;
+        std::size_t capacity = 4096;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            capacity = static_cast<std::size_t>(st.st_size) + 1;
+        }
+        if (buffer.size() < capacity) {
+            buffer.resize(capacity);
+        }
+
+        std::size_t size = 0;
+        for (;;) {
+            if (size == buffer.size()) {
+                buffer.resize(buffer.size() * 2);
+            }
+            ssize_t n = ::read(fd, &buffer[size], buffer.size() - size);
+            if (n == 0) {
+                break;
+            }
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                int error = errno;
+                ::close(fd);
+                buffer.clear();
+                errno = error;
+                return false;
+            }
+            size += static_cast<std::size_t>(n);
+        }
+        ::close(fd);
+
+        // Shrinking keeps the capacity for the next file
+        buffer.resize(size);
+        return true;
+    }
+
+    ContextPool::Lease ContextPool::acquire()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!idle_.empty()) {
+                auto context = std::move(idle_.back());
+                idle_.pop_back();
+                return Lease(*this, std::move(context));
+            }
+        }
+        return Lease(*this, std::make_unique<AnalysisContext>(diagnostics_));
+    }
+
+    void ContextPool::release(std::unique_ptr<AnalysisContext> context)
+    {
+        context->options() = ScanOptions{};
+        context->reset_cancel();
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle_.push_back(std::move(context));
+    }
+
+    ContextPool& ContextPool::global()
+    {
+        static ContextPool pool;
+        return pool;
+    }
+}
@@ -0,0 +1,223 @@
+#ifndef __ANALYSISCONTEXT_HH_
+#define __ANALYSISCONTEXT_HH_
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <streambuf>
+#include <istream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "codestatistics.hh"
+#include "preprocessor.hh"
+
+namespace c3ms
+{
+    /// Forward declarations of classes
+    class CodeParser;
+    class CodeScanner;
+    class ChunkedParser;
+    class TokenSink;
+
+    /**
+     * @brief Read-only stream buffer over a block of memory.
+     *
+     * @details Lets the scanner read an in-memory buffer through its std::istream
+     * interface without copying it into a std::string or std::istringstream.
+     */
+    class ViewStreamBuf : public std::streambuf
+    {
+        public:
+            void reset(std::string_view view) {
+                char* begin = const_cast<char*>(view.data());
+                setg(begin, begin, begin + view.size());
+            }
+    };
+
+    /**
+     * @brief Read-only stream buffer over a sequence of memory segments.
+     *
+     * @details Presents the segments left by the Preprocessor as one stream, without
+     * joining them into a single buffer.
+     */
+    class SegmentStreamBuf : public std::streambuf
+    {
+        public:
+            void reset(const std::vector<std::string_view>* segments) {
+                segments_ = segments;
+                next_ = 0;
+                setg(nullptr, nullptr, nullptr);
+            }
+
+        protected:
+            int_type underflow() override {
+                while (segments_ && next_ < segments_->size()) {
+                    std::string_view segment = (*segments_)[next_++];
+                    if (!segment.empty()) {
+                        char* begin = const_cast<char*>(segment.data());
+                        setg(begin, begin, begin + segment.size());
+                        return traits_type::to_int_type(*begin);
+                    }
+                }
+                return traits_type::eof();
+            }
+
+        private:
+            const std::vector<std::string_view>* segments_ = nullptr;
+            std::size_t next_ = 0;
+    };
+
+    /**
+     * @brief Settings of an AnalysisContext; they stay in place until the context returns to its pool.
+     */
+    struct ScanOptions {
+        const Preprocessor* preprocessor = nullptr; ///< Drops inactive conditional branches when set
+        TokenSink* sink = nullptr;                   ///< Sees every classification made while parsing
+        ChunkedParser* chunker = nullptr;            ///< Lexes large buffers in parallel chunks when set, and no sink is
+    };
+
+    /**
+     * @brief Work saved by the Preprocessor in the last run of an AnalysisContext, and how that run ended.
+     */
+    struct ScanReport {
+        std::size_t skippedBytes = 0;
+        std::size_t skippedRegions = 0;
+        bool unterminated = false; ///< The input ended inside a comment, an #include, a call or a condition
+    };
+
+    /**
+     * @brief Scanner, parser and input buffers used to analyse one unit of code.
+     *
+     * @details A context is independent of the CodeStatistics it fills, so it can be
+     * reused for any number of files or functions. The flex buffer, the file buffer and
+     * the parser stack keep their capacity between runs.
+     */
+    class AnalysisContext
+    {
+        public:
+            explicit AnalysisContext(std::ostream* diagnostics = &std::cerr);
+            ~AnalysisContext();
+
+            AnalysisContext(const AnalysisContext&) = delete;
+            AnalysisContext& operator=(const AnalysisContext&) = delete;
+
+            int parse(std::istream& iss, CodeStatistics& stats);
+            int parse_buffer(std::string_view code, CodeStatistics& stats);
+            int parse_file(const std::string& path, CodeStatistics& stats);
+
+            /// Reads a file into the context's buffer; the view is valid until the next read
+            std::string_view read_file(const std::string& path);
+
+            /// Makes a running parse stop at its next token; safe to call from any thread
+            void cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+            void reset_cancel() { cancelled_.store(false, std::memory_order_relaxed); }
+            bool cancelled() const {
+                return cancelled_.load(std::memory_order_relaxed) || (owner_ && owner_->cancelled());
+            }
+
+            /// Makes this context stop whenever owner is cancelled too, or follow nobody with nullptr
+            void follow(const AnalysisContext* owner) { owner_ = owner; }
+
+            /// Statistics being filled by the current run
+            CodeStatistics& stats() { return *stats_; }
+
+            /// Line the scanner is on
+            int line() const;
+
+            /// Stream for scanner and parser diagnostics, or nullptr to stay silent
+            std::ostream* diagnostics() const { return diagnostics_; }
+
+            ScanOptions& options() { return options_; }
+            const ScanReport& report() const { return report_; }
+
+            /// Called by the scanner when a call or a condition is cut short by the end of the input
+            void mark_unterminated() { report_.unterminated = true; }
+
+        private:
+            bool load(const std::string& path);
+
+            /// Scans a buffer as it is, numbering its lines from firstLine
+            int parse_view(std::string_view code, CodeStatistics& stats, int firstLine = 1);
+
+            std::unique_ptr<CodeScanner> scanner_;
+            std::unique_ptr<CodeParser> parser_;
+            CodeStatistics* stats_ = nullptr;
+            std::ostream* diagnostics_;
+
+            std::string fileBuffer_;
+            ViewStreamBuf viewBuffer_;
+            std::istream viewStream_;
+
+            ScanOptions options_;
+            ScanReport report_;
+            std::atomic<bool> cancelled_{false};
+            const AnalysisContext* owner_ = nullptr;
+            int firstLine_ = 1;
+            std::string stripped_;
+            Preprocessor::Result filtered_;
+            SegmentStreamBuf segmentBuffer_;
+            std::istream segmentStream_;
+
+            friend class CodeParser;
+            friend class ChunkedParser;
+    };
+
+    /**
+     * @brief Reads a whole file into buffer, reusing its capacity.
+     *
+     * @return bool False with errno set when the file cannot be opened, leaving buffer as it
+     * was, or when a read fails, leaving buffer empty.
+     */
+    bool read_file_into(const std::string& path, std::string& buffer);
+
+    /**
+     * @brief Thread-safe pool of idle analysis contexts.
+     *
+     * @details Contexts created by a pool report their diagnostics to the stream the
+     * pool was built with; the global pool uses std::cerr.
+     */
+    class ContextPool
+    {
+        public:
+            explicit ContextPool(std::ostream* diagnostics = &std::cerr) : diagnostics_(diagnostics) {}
+
+            /**
+             * @brief RAII handle that gives a context back to its pool on destruction.
+             */
+            class Lease
+            {
+                public:
+                    Lease(ContextPool& pool, std::unique_ptr<AnalysisContext> context)
+                        : pool_(&pool), context_(std::move(context)) {}
+                    ~Lease() { if (context_) pool_->release(std::move(context_)); }
+
+                    Lease(Lease&&) noexcept = default;
+                    Lease& operator=(Lease&&) = delete;
+
+                    AnalysisContext& operator*() { return *context_; }
+                    AnalysisContext* operator->() { return context_.get(); }
+
+                private:
+                    ContextPool* pool_;
+                    std::unique_ptr<AnalysisContext> context_;
+            };
+
+            Lease acquire();
+
+            /// Takes a context back, restoring its default options
+            void release(std::unique_ptr<AnalysisContext> context);
+
+            /// Pool shared by CodeStatistics::parse* helpers
+            static ContextPool& global();
+
+        private:
+            std::ostream* diagnostics_;
+            std::mutex mutex_;
+            std::vector<std::unique_ptr<AnalysisContext>> idle_;
+    };
+}
+
+#endif /* !__ANALYSISCONTEXT_HH_ */
@@ -0,0 +1,52 @@
+#include "arena.hh"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace c3ms
+{
+    void Arena::release()
+    {
+        usage_.releases++;
+        usage_.used = 0;
+        if (blocks_.empty()) {
+            return;
+        }
+        // Coalesce, so the next use of the same size fits in a single block
+        if (blocks_.size() > 1) {
+            std::unique_ptr<std::byte[]> block(new std::byte[usage_.reserved]);
+            blocks_.clear();
+            blocks_.push_back(std::move(block));
+            usage_.blocks++;
+        }
+        cursor_ = blocks_.front().get();
+        end_ = cursor_ + usage_.reserved;
+    }
+
+    void* Arena::do_allocate(std::size_t bytes, std::size_t alignment)
+    {
+        auto address = reinterpret_cast<std::uintptr_t>(cursor_);
+        std::size_t padding = (alignment - address % alignment) % alignment;
+        if (!cursor_ || padding + bytes > static_cast<std::size_t>(end_ - cursor_)) {
+            grow(bytes + alignment);
+            address = reinterpret_cast<std::uintptr_t>(cursor_);
+            padding = (alignment - address % alignment) % alignment;
+        }
+        std::byte* result = cursor_ + padding;
+        cursor_ = result + bytes;
+        usage_.used += padding + bytes;
+        usage_.highWater = std::max(usage_.highWater, usage_.used);
+        return result;
+    }
+
+    void Arena::grow(std::size_t size)
+    {
+        // Each block at least doubles what the arena holds
+        size = std::max({size, blockSize_, usage_.reserved});
+        blocks_.emplace_back(new std::byte[size]);
+        cursor_ = blocks_.back().get();
+        end_ = cursor_ + size;
+        usage_.reserved += size;
+        usage_.blocks++;
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef __ARENA_HH_
+#define __ARENA_HH_
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+namespace c3ms
+{
+    /**
+     * @brief Monotonic memory resource for the token tables of a CodeStatistics.
+     *
+     * @details Allocation bumps a pointer through a few growing blocks and deallocation does
+     * nothing, so everything is given back at once by release(). When the memory released
+     * spanned several blocks they are replaced by one block of their combined size, so a run
+     * over files of similar size stops calling malloc after the first few files.
+     */
+    class Arena : public std::pmr::memory_resource
+    {
+        public:
+            /**
+             * @brief Counters for the memory report.
+             */
+            struct Usage {
+                std::size_t used = 0;      ///< Bytes handed out since the last release
+                std::size_t highWater = 0; ///< Most bytes handed out between two releases
+                std::size_t reserved = 0;  ///< Bytes held in blocks
+                std::size_t blocks = 0;    ///< Blocks taken from the heap over the arena's life
+                std::size_t releases = 0;
+            };
+
+            /// The first block is allocated on first use; later ones double what the arena holds,
+            /// so a small table costs a small block
+            explicit Arena(std::size_t blockSize = 1 << 10) : blockSize_(blockSize) {}
+            Arena(const Arena&) = delete;
+            Arena& operator=(const Arena&) = delete;
+
+            /// Makes all memory reusable; whatever was allocated from the arena is gone
+            void release();
+            const Usage& usage() const { return usage_; }
+
+        private:
+            void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+            void do_deallocate(void*, std::size_t, std::size_t) override {}
+            bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+            void grow(std::size_t size);
+
+            std::vector<std::unique_ptr<std::byte[]>> blocks_;
+            std::size_t blockSize_;
+            std::byte* cursor_ = nullptr;
+            std::byte* end_ = nullptr;
+            Usage usage_;
+    };
+}
+
+#endif /* !__ARENA_HH_ */
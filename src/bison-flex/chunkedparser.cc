@@ -0,0 +1,173 @@
+#include "chunkedparser.hh"
+
+#include <algorithm>
+#include <cctype>
+#include <thread>
+
+namespace c3ms
+{
+    ChunkedParser::ChunkedParser(const Options& options) : options_(options)
+    {
+        if (options_.threads == 0) {
+            options_.threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        options_.minChunk = std::max<std::size_t>(options_.minChunk, 1);
+    }
+
+    ChunkedParser::~ChunkedParser() = default;
+
+    bool ChunkedParser::splits(std::size_t size) const
+    {
+        return options_.threads > 1 && size / options_.minChunk >= 2;
+    }
+
+    std::vector<std::pair<std::size_t, int>> ChunkedParser::boundaries(std::string_view code, std::size_t chunks)
+    {
+        std::vector<std::pair<std::size_t, int>> cuts{{0, 1}};
+        if (chunks < 2) {
+            return cuts;
+        }
+
+        // Rough model of the scanner: enough to avoid cuts that will be rejected, not to be exact
+        enum class State { CODE, BLOCK_COMMENT, LINE_COMMENT, STRING, CHARACTER };
+        State state = State::CODE;
+        std::size_t target = code.size() / chunks;
+        int depth = 0;
+        int line = 1;
+        char last = 0; // Last character of code outside comments and blanks
+
+        for (std::size_t i = 0; i < code.size(); ++i) {
+            char c = code[i];
+            char next = i + 1 < code.size() ? code[i + 1] : 0;
+            if (c == '\n') {
+                ++line;
+            }
+
+            switch (state) {
+                case State::BLOCK_COMMENT:
+                    if (c == '*' && next == '/') {
+                        state = State::CODE;
+                        ++i;
+                    }
+                    continue;
+                case State::STRING:
+                case State::CHARACTER:
+                    if (c == '\\') {
+                        line += next == '\n';
+                        ++i;
+                    } else if (c == (state == State::STRING ? '"' : '\'')) {
+                        state = State::CODE;
+                        last = c;
+                    }
+                    continue;
+                case State::LINE_COMMENT:
+                    if (c != '\n') {
+                        continue;
+                    }
+                    state = State::CODE;
+                    break;
+                case State::CODE:
+                    break;
+            }
+
+            if (c == '\n') {
+                // A line ending in ';', '{' or '}' cannot be continued by a token of the next one
+                bool safe = depth == 0 && (last == ';' || last == '{' || last == '}');
+                if (safe && i + 1 >= target && i + 1 < code.size()) {
+                    cuts.emplace_back(i + 1, line);
+                    if (cuts.size() == chunks) {
+                        break;
+                    }
+                    target = cuts.size() * code.size() / chunks;
+                }
+            } else if (c == '/' && next == '*') {
+                state = State::BLOCK_COMMENT;
+                ++i;
+            } else if (c == '/' && next == '/') {
+                state = State::LINE_COMMENT;
+                ++i;
+            } else if (c == '"') {
+                state = State::STRING;
+            } else if (c == '\'') {
+                state = State::CHARACTER;
+            } else if (!std::isspace(static_cast<unsigned char>(c))) {
+                if (c == '(') {
+                    ++depth;
+                } else if (c == ')' && depth > 0) {
+                    --depth;
+                } else if (c == '{' || c == '}') {
+                    depth = 0; // An unbalanced macro must not rule out the rest of the buffer
+                }
+                last = c;
+            }
+        }
+        return cuts;
+    }
+
+    int ChunkedParser::parse(AnalysisContext& owner, std::string_view code, CodeStatistics& stats)
+    {
+        auto cuts = boundaries(code, std::min(options_.threads, code.size() / options_.minChunk));
+        if (cuts.size() < 2) {
+            return owner.parse_view(code, stats);
+        }
+        ++report_.buffers;
+        while (helpers_.size() < cuts.size()) {
+            helpers_.push_back(std::make_unique<Helper>());
+        }
+
+        auto scan = [&](std::size_t k) {
+            Helper& helper = *helpers_[k];
+            std::size_t begin = cuts[k].first;
+            std::size_t end = k + 1 < cuts.size() ? cuts[k + 1].first : code.size();
+            helper.diagnostics.str("");
+            helper.diagnostics.clear();
+            helper.stats.reset();
+            helper.context.follow(&owner);
+            helper.errors = helper.context.parse_view(code.substr(begin, end - begin), helper.stats, cuts[k].second);
+            helper.context.follow(nullptr);
+        };
+
+        // The calling thread takes the first chunk
+        std::vector<std::thread> workers;
+        workers.reserve(cuts.size() - 1);
+        for (std::size_t k = 1; k < cuts.size(); ++k) {
+            workers.emplace_back(scan, k);
+        }
+        scan(0);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        if (owner.cancelled()) {
+            return stats.getError();
+        }
+
+        // Keep chunks in order up to the first that may end in the middle of a token. Errors
+        // count as such, since an unmatched quote may open a literal closed in the next chunk.
+        // The last chunk ends where the buffer does, so whatever state it ends in is the real one.
+        std::size_t kept = 0;
+        for (; kept < cuts.size(); ++kept) {
+            Helper& helper = *helpers_[kept];
+            bool last = kept + 1 == cuts.size();
+            if (!last && (helper.errors > 0 || helper.context.report().unterminated)) {
+                break;
+            }
+            stats.append(helper.stats);
+            stats.setError(std::min(127, stats.getError() + helper.errors));
+            if (auto* out = owner.diagnostics()) {
+                *out << helper.diagnostics.str();
+            }
+            if (last) {
+                owner.report_.unterminated = helper.context.report().unterminated;
+            }
+        }
+        report_.chunks += kept;
+        if (kept == cuts.size()) {
+            return stats.getError();
+        }
+
+        // The rejected chunk starts where the serial scan would, so only it and the rest are scanned again
+        ++report_.fallbacks;
+        std::size_t begin = cuts[kept].first;
+        return owner.parse_view(code.substr(begin), stats, cuts[kept].second);
+    }
+}
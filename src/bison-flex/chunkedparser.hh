@@ -0,0 +1,85 @@
+#ifndef __CHUNKEDPARSER_HH_
+#define __CHUNKEDPARSER_HH_
+
+#include <cstddef>
+#include <memory>
+#include <sstream>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "analysiscontext.hh"
+#include "codestatistics.hh"
+
+namespace c3ms
+{
+    /**
+     * @brief Lexes a large buffer as several chunks in parallel, with the result of a single scan.
+     *
+     * @details The buffer is cut after newlines that a quick pre-scan finds outside comments,
+     * string and character literals and parentheses, on lines ending in ';', '{' or '}', where
+     * no token can continue on the next line. Each chunk is scanned on its own context into its
+     * own statistics, which are then appended in order. The cut is speculative: a chunk that
+     * ends inside a comment, an #include or a call, or that has errors, may have been cut
+     * through a token, so everything from that chunk on is scanned again serially.
+     */
+    class ChunkedParser
+    {
+        public:
+            struct Options {
+                std::size_t threads = 1;           ///< Chunks scanned at once, 0 for one per core
+                std::size_t minChunk = 1 << 20;    ///< Buffers shorter than two chunks are scanned serially
+            };
+
+            /**
+             * @brief Work done since the parser was built, for tuning the chunk size.
+             */
+            struct Report {
+                std::size_t buffers = 0;   ///< Buffers split into chunks
+                std::size_t chunks = 0;    ///< Chunks whose results were kept
+                std::size_t fallbacks = 0; ///< Buffers finished serially after a rejected chunk
+            };
+
+            explicit ChunkedParser(const Options& options);
+            ~ChunkedParser();
+
+            ChunkedParser(const ChunkedParser&) = delete;
+            ChunkedParser& operator=(const ChunkedParser&) = delete;
+
+            /// Whether a buffer of this size is worth splitting
+            bool splits(std::size_t size) const;
+
+            /**
+             * @brief Scans code into stats, as owner.parse_buffer() would without a chunker.
+             *
+             * @details Diagnostics go to the owner's stream, in order and with the lines of the
+             * whole buffer. Cancelling owner stops every chunk.
+             */
+            int parse(AnalysisContext& owner, std::string_view code, CodeStatistics& stats);
+
+            /**
+             * @brief Offsets at which code may be cut into at most chunks pieces, with the line each piece starts on.
+             *
+             * @details The first offset is 0; the end of the buffer is not included.
+             */
+            static std::vector<std::pair<std::size_t, int>> boundaries(std::string_view code, std::size_t chunks);
+
+            const Report& report() const { return report_; }
+
+        private:
+            struct Helper {
+                Helper() { stats.trackInsertions(true); }
+
+                std::ostringstream diagnostics; // Held back until the chunk is known to be kept
+                AnalysisContext context{&diagnostics};
+                CodeStatistics stats;
+                int errors = 0;
+            };
+
+            Options options_;
+            Report report_;
+            std::vector<std::unique_ptr<Helper>> helpers_;
+    };
+}
+
+#endif /* !__CHUNKEDPARSER_HH_ */
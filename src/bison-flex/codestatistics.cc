@@ -1,46 +1,106 @@
 #include "codestatistics.hh"
-#include "parser.hh"
-#include "scanner.hh"
+#include "analysiscontext.hh"
+#include "tokenstream.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
 
 namespace c3ms
 {
     CodeStatistics::CodeStatistics()
-        : scanner_(std::make_shared<CodeScanner>()),
-          parser_(std::make_shared<CodeParser>(*this)),
-          error_(0)
     {
-        // No need for any other initialization
-        // scanner_->set_debug(true);
+        // Scanner and parser live in pooled AnalysisContext objects
+    }
+
+    CodeStatistics::CodeStatistics(const CodeStatistics& other) : CodeStatistics()
+    {
+        *this = other;
+    }
+
+    CodeStatistics::CodeStatistics(CodeStatistics&& other) : CodeStatistics()
+    {
+        *this = std::move(other);
+    }
+
+    CodeStatistics& CodeStatistics::operator=(const CodeStatistics& other)
+    {
+        if (this != &other) {
+            // Copies get their own arena; adding to empty statistics copies every token
+            reset();
+            *this += other;
+            error_ = other.error_;
+            sink_ = other.sink_;
+        }
+        return *this;
+    }
+
+    CodeStatistics& CodeStatistics::operator=(CodeStatistics&& other)
+    {
+        if (this != &other) {
+            // pmr allocators do not follow a move, so the sets are rebuilt on the arena taken from
+            // other. The old sets are destroyed first, while the arena holding them is still alive
+            // (it goes to other, which releases it below)
+            std::swap(arena_, other.arena_);
+            for (std::size_t i = 0; i < NumCategories; ++i) {
+                auto category = static_cast<StatsCategory>(i);
+                CSSet& set = getCSSetReference(category);
+                std::destroy_at(&set);
+                ::new (&set) CSSet(std::move(other.getCSSetReference(category)));
+                getCounterReference(category) = other.getCounterReference(category);
+            }
+            // The nodes moved with the arena, so the insertion order stays valid
+            insertions_ = std::move(other.insertions_);
+            error_ = other.error_;
+            sink_ = other.sink_;
+            other.reset();
+        }
+        return *this;
     }
+
     int CodeStatistics::parse()
     {
-        scanner_->switch_streams(&std::cin, &std::cerr);
-        parser_->parse();
-        return error_;
+        auto context = ContextPool::global().acquire();
+        return context->parse(std::cin, *this);
     }
 
     int CodeStatistics::parse(std::istream &iss)
     {
-        scanner_->switch_streams(&iss, &std::cerr);
-        parser_->parse();
-        return error_;
+        auto context = ContextPool::global().acquire();
+        return context->parse(iss, *this);
     }
 
     int CodeStatistics::parse_file(const std::string &path)
     {
-        std::ifstream s(path.c_str(), std::ifstream::in);
-        scanner_->switch_streams(&s, &std::cerr);
-        parser_->parse();
-        s.close();
-        return error_;
+        auto context = ContextPool::global().acquire();
+        return context->parse_file(path, *this);
     }
 
-    void CodeStatistics::category(StatsCategory counter, std::string_view p) {
-        getCounterReference(counter)++;
+    int CodeStatistics::parse_buffer(std::string_view code)
+    {
+        auto context = ContextPool::global().acquire();
+        return context->parse_buffer(code, *this);
+    }
+
+    void CodeStatistics::category(StatsCategory counter, std::string_view p, StatSize occurrences) {
+        if (sink_) {
+            for (StatSize i = 0; i < occurrences; ++i) {
+                sink_->token(counter, p);
+            }
+        }
+        getCounterReference(counter) += occurrences;
         auto& setRef = getCSSetReference(counter);
-        auto [it, inserted] = setRef.insert({std::string(p), {1, counter}});
-        if (!inserted) {
-            it->second.first++;
+        // Look up through a reusable key so known tokens never allocate
+        key_.assign(p.data(), p.size());
+        auto it = setRef.find(key_);
+        if (it != setRef.end()) {
+            it->second.first += occurrences;
+            return;
+        }
+        // New nodes and their keys are taken from the arena
+        auto inserted = setRef.try_emplace(key_, occurrences, counter).first;
+        if (trackInsertions_) {
+            insertions_.push_back(&*inserted);
         }
     }
 
@@ -91,8 +151,19 @@ namespace c3ms
         return getCounterValue(StatsCategory::KEYWORD) + getCounterValue(StatsCategory::OPERATOR) + getCounterValue(StatsCategory::APIKEYWORD) + getCounterValue(StatsCategory::APILLKEYWORD) + getCounterValue(StatsCategory::CUSTOMKEYWORD);
     }
 
-    void CodeStatistics::decOperator() { nOperators_--; }
-    void CodeStatistics::addCondition() { nConditions_++; }
+    void CodeStatistics::decOperator() {
+        if (sink_) {
+            sink_->decOperator();
+        }
+        nOperators_--;
+    }
+
+    void CodeStatistics::addCondition() {
+        if (sink_) {
+            sink_->condition();
+        }
+        nConditions_++;
+    }
 
     void CodeStatistics::reset()
     {
@@ -109,17 +180,21 @@ namespace c3ms
         nAPIKeywords_ = 0;
         nAPILLKeywords_ = 0;
         nCustomKeywords_ = 0;
-        // Reset all sets
-        typesSet_.clear();
-        constantsSet_.clear();
-        identifiersSet_.clear();
-        cSpecifiersSet_.clear();
-        keywordsSet_.clear();
-        operatorsSet_.clear();
-        conditionsSet_.clear();
-        apiKeywordsSet_.clear();
-        apiLLKeywordsSet_.clear();
-        customKeywordsSet_.clear();
+        dropTokens();
+    }
+
+    void CodeStatistics::dropTokens()
+    {
+        // Everything the sets hold lives in the arena, so their destructors free nothing; they
+        // run before the release, while the nodes are still there. Empty sets allocate nothing,
+        // so they are rebuilt before the release too and stay valid if it throws
+        insertions_.clear();
+        for (std::size_t i = 0; i < NumCategories; ++i) {
+            CSSet& set = getCSSetReference(static_cast<StatsCategory>(i));
+            std::destroy_at(&set);
+            ::new (&set) CSSet(arena_.get());
+        }
+        arena_->release();
     }
 
     void CodeStatistics::printMetrics(std::ostringstream& result, const CSSet& set, const int nameWidth, const int valueWidth) const {
@@ -251,11 +326,13 @@ namespace c3ms
         nAPILLKeywords_ += rhs.nAPILLKeywords_;
         nCustomKeywords_ += rhs.nCustomKeywords_;
 
-        auto combineCSSets = [](CSSet& lhsSet, const CSSet& rhsSet) {
+        auto combineCSSets = [this](CSSet& lhsSet, const CSSet& rhsSet) {
             for (const auto& element : rhsSet) {
-                auto [it, inserted] = lhsSet.insert({element.first, {element.second.first, element.second.second}});
+                auto [it, inserted] = lhsSet.try_emplace(element.first, element.second.first, element.second.second);
                 if (!inserted) {
                     it->second.first += element.second.first;
+                } else if (trackInsertions_) {
+                    insertions_.push_back(&*it);
                 }
             }
         };
@@ -274,6 +351,26 @@ namespace c3ms
         return *this;
     }
 
+    CodeStatistics& CodeStatistics::append(const CodeStatistics& rhs) {
+        for (std::size_t i = 0; i < NumCategories; ++i) {
+            auto category = static_cast<StatsCategory>(i);
+            getCounterReference(category) += rhs.getCounterValue(category);
+        }
+
+        // Replaying rhs's insertions gives every set the same insertion sequence as one scan
+        for (const auto* element : rhs.insertions_) {
+            auto& setRef = getCSSetReference(element->second.second);
+            auto [it, inserted] = setRef.try_emplace(element->first, element->second.first, element->second.second);
+            if (!inserted) {
+                it->second.first += element->second.first;
+            } else if (trackInsertions_) {
+                insertions_.push_back(&*it);
+            }
+        }
+
+        return *this;
+    }
+
     CodeStatistics operator+(CodeStatistics lhs, const CodeStatistics& rhs) {
         lhs += rhs;
         return lhs;
@@ -295,6 +392,61 @@ namespace c3ms
         }
     }
 
+    void CodeStatistics::forEachToken(const std::function<void(StatsCategory, std::string_view, StatSize)>& visit) const {
+        for (const CSSet* set : {&typesSet_, &constantsSet_, &identifiersSet_, &cSpecifiersSet_, &keywordsSet_,
+                                 &operatorsSet_, &conditionsSet_, &apiKeywordsSet_, &apiLLKeywordsSet_, &customKeywordsSet_}) {
+            for (const auto& element : *set) {
+                visit(element.second.second, element.first, element.second.first);
+            }
+        }
+    }
+
+    void CodeStatistics::forEachToken(StatsCategory category, const std::function<void(std::string_view, StatSize)>& visit) const {
+        for (const auto& element : getCSSetReference(category)) {
+            visit(element.first, element.second.first);
+        }
+    }
+
+    bool CodeStatistics::deserialize(std::string_view data) {
+        reset();
+        std::uint64_t value = 0;
+        bool valid = getVarint(data, value);
+        error_ = static_cast<int>(value);
+        for (std::size_t i = 0; valid && i < NumCategories; ++i) {
+            valid = getVarint(data, value);
+            getCounterReference(static_cast<StatsCategory>(i)) = value;
+        }
+        for (std::size_t i = 0; valid && i < NumCategories; ++i) {
+            auto category = static_cast<StatsCategory>(i);
+            CSSet& set = getCSSetReference(category);
+            std::uint64_t tokens = 0;
+            valid = getVarint(data, tokens);
+            if (valid) {
+                set.reserve(std::min<std::uint64_t>(tokens, data.size()));
+            }
+            for (; valid && tokens > 0; --tokens) {
+                std::uint64_t size = 0, occurrences = 0;
+                valid = getVarint(data, size) && size <= data.size();
+                if (valid) {
+                    key_.assign(data.data(), size);
+                    data.remove_prefix(size);
+                    valid = getVarint(data, occurrences);
+                }
+                if (valid) {
+                    auto inserted = set.try_emplace(key_, occurrences, category).first;
+                    if (trackInsertions_) {
+                        insertions_.push_back(&*inserted);
+                    }
+                }
+            }
+        }
+        if (!valid || !data.empty()) {
+            reset();
+            return false;
+        }
+        return true;
+    }
+
     CodeStatistics::CSSet& CodeStatistics::getCSSetReference(StatsCategory set) {
         switch (set) {
             case StatsCategory::TYPE: return typesSet_;
@@ -311,6 +463,10 @@ namespace c3ms
         }
     }
 
+    const CodeStatistics::CSSet& CodeStatistics::getCSSetReference(StatsCategory set) const {
+        return const_cast<CodeStatistics*>(this)->getCSSetReference(set);
+    }
+
     std::string CodeStatistics::toString(StatsCategory category) const {
         switch (category) {
             case StatsCategory::TYPE: return "Type";
@@ -9,6 +9,12 @@
 #include <string_view>
 #include <iomanip>
 #include <memory>
+#include <vector>
+#include <functional>
+#include <memory_resource>
+
+#include "arena.hh"
+#include "varint.hh"
 
 
 namespace c3ms
@@ -17,13 +23,14 @@ namespace c3ms
     class CodeParser;
     class CodeScanner;
     class location;
+    class TokenSink;
 
     class CodeStatistics
     {
         public:
             enum class StatsCategory;
             using StatSize = std::size_t;
-            using CSSet = std::unordered_map<std::string, std::pair<StatSize, StatsCategory>>;
+            using CSSet = std::pmr::unordered_map<std::pmr::string, std::pair<StatSize, StatsCategory>>;
 
             /**
              * @brief Enum class representing different categories for code statistics.
@@ -41,15 +48,23 @@ namespace c3ms
                 CUSTOMKEYWORD,  // Custom Keywords
             };
 
+            /// Number of StatsCategory values, for tables indexed by category
+            static constexpr std::size_t NumCategories = 10;
+
             // Constructors and Destructor
             CodeStatistics();
+            CodeStatistics(const CodeStatistics& other);
+            CodeStatistics(CodeStatistics&& other);
+            CodeStatistics& operator=(const CodeStatistics& other);
+            CodeStatistics& operator=(CodeStatistics&& other);
 
             // Public Member Functions
             int parse();
             int parse(std::istream& iss);
             int parse_file(const std::string& path);
+            int parse_buffer(std::string_view code);
 
-            void category(StatsCategory counter, std::string_view p);
+            void category(StatsCategory counter, std::string_view p, StatSize occurrences = 1);
             StatSize getCounterValue(StatsCategory set) const;
             StatSize getCSSetSize(StatsCategory set) const;
 
@@ -64,9 +79,19 @@ namespace c3ms
              * @brief Resets the code statistics.
              * 
              * This function resets the code statistics to their initial values.
+             * The sets allocate from an arena owned by this object, so their nodes
+             * are dropped by releasing the arena instead of being freed one by one.
              */
             void reset();
 
+            /**
+             * @brief Empties the token tables and keeps the counters and the error count.
+             *
+             * @details For statistics whose tokens are kept somewhere else, such as spilled to
+             * disk, so the totals stay exact while the tables start over.
+             */
+            void dropTokens();
+
             void printMetrics(std::ostringstream& result, const CSSet& set, int nameWidth, int valueWidth) const;
             void printHeader(std::ostringstream& result, std::string_view left_header, std::string_view right_header, int nameWidth, int valueWidth, int totalWidth) const;
             std::string printOperators() const;
@@ -78,20 +103,57 @@ namespace c3ms
             // Overloaded Operators
             CodeStatistics& operator+=(const CodeStatistics& rhs);
 
+            /**
+             * @brief Adds rhs as if its code had been scanned right after ours.
+             *
+             * @details New tokens are inserted in the order rhs first saw them, so the sets end up
+             * identical to a single scan of both inputs, iteration order included. rhs must have
+             * tracked its insertions since its last reset().
+             */
+            CodeStatistics& append(const CodeStatistics& rhs);
+
+            /// Remembers the order in which new tokens are inserted, for append(); off by default
+            void trackInsertions(bool enabled) { trackInsertions_ = enabled; }
+
+            /// Calls visit(category, token, occurrences) once per unique token of every category
+            void forEachToken(const std::function<void(StatsCategory, std::string_view, StatSize)>& visit) const;
+
+            /// Calls visit(token, occurrences) once per unique token of one category
+            void forEachToken(StatsCategory category, const std::function<void(std::string_view, StatSize)>& visit) const;
+
+            /**
+             * @brief Appends a compact binary form of the counters and token tables to out.
+             *
+             * @details Numbers are varints and each unique token is written once, so the form
+             * is about the size of the text of the tables. The token sink is not part of it.
+             *
+             * @param out Anything with push_back(char) and append(const char*, size), such as a std::string.
+             */
+            template <typename Out>
+            void serialize(Out& out) const;
+
+            /// Replaces the statistics with a serialize()d form; when it is malformed, returns false and leaves them reset
+            bool deserialize(std::string_view data);
+
+            /// Usage of the arena holding the sets, for the memory report
+            const Arena::Usage& memoryUsage() const { return arena_->usage(); }
+
             // Get and Set Methods for error_
             int getError() const { return error_; }
             void setError(int value) { error_ = value; }
 
+            /// Sink that sees every token, condition and decOperator() while set; not owned
+            void setTokenSink(TokenSink* sink) { sink_ = sink; }
+
         private:
             // Private Member Functions
             StatSize& getCounterReference(StatsCategory counter);
             CSSet& getCSSetReference(StatsCategory set);
+            const CSSet& getCSSetReference(StatsCategory set) const;
             std::string toString(StatsCategory category) const;
 
             // Member Variables
-            std::shared_ptr<CodeScanner> scanner_;
-            std::shared_ptr<CodeParser> parser_;
-            int error_;
+            int error_ = 0;
 
             StatSize nTypes_ = 0;
             StatSize nConstants_ = 0;
@@ -104,21 +166,51 @@ namespace c3ms
             StatSize nAPILLKeywords_ = 0;
             StatSize nCustomKeywords_ = 0;
 
-            CSSet typesSet_;
-            CSSet constantsSet_;
-            CSSet identifiersSet_;
-            CSSet cSpecifiersSet_;
-            CSSet keywordsSet_;
-            CSSet operatorsSet_;
-            CSSet conditionsSet_;
-            CSSet apiKeywordsSet_;
-            CSSet apiLLKeywordsSet_;
-            CSSet customKeywordsSet_;
+            // Declared before the sets, which allocate from it
+            std::unique_ptr<Arena> arena_ = std::make_unique<Arena>();
+
+            CSSet typesSet_{arena_.get()};
+            CSSet constantsSet_{arena_.get()};
+            CSSet identifiersSet_{arena_.get()};
+            CSSet cSpecifiersSet_{arena_.get()};
+            CSSet keywordsSet_{arena_.get()};
+            CSSet operatorsSet_{arena_.get()};
+            CSSet conditionsSet_{arena_.get()};
+            CSSet apiKeywordsSet_{arena_.get()};
+            CSSet apiLLKeywordsSet_{arena_.get()};
+            CSSet customKeywordsSet_{arena_.get()};
+
+            std::pmr::string key_; // Reused lookup key, on the default heap
+            TokenSink* sink_ = nullptr;
+
+            // Nodes in insertion order while tracking. The vector is on the default heap, but the nodes
+            // it points to live in the arena, so reset() clears it along with them
+            bool trackInsertions_ = false;
+            std::vector<const CSSet::value_type*> insertions_;
 
             // Friends of CodeStatistics
             friend class CodeParser;
             friend class CodeScanner;
     };
+
+    template <typename Out>
+    void CodeStatistics::serialize(Out& out) const
+    {
+        putVarint(out, static_cast<std::uint32_t>(error_));
+        for (std::size_t i = 0; i < NumCategories; ++i) {
+            putVarint(out, getCounterValue(static_cast<StatsCategory>(i)));
+        }
+        // The counters are written apart, since decOperator() and addCondition() move them away from the sets
+        for (const CSSet* set : {&typesSet_, &constantsSet_, &identifiersSet_, &cSpecifiersSet_, &keywordsSet_,
+                                 &operatorsSet_, &conditionsSet_, &apiKeywordsSet_, &apiLLKeywordsSet_, &customKeywordsSet_}) {
+            putVarint(out, set->size());
+            for (const auto& element : *set) {
+                putVarint(out, element.first.size());
+                out.append(element.first.data(), element.first.size());
+                putVarint(out, element.second.first);
+            }
+        }
+    }
 }
 
 #endif /* !CODESTATISTICS_HH_ */
\ No newline at end of file
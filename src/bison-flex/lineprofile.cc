@@ -0,0 +1,111 @@
+#include "lineprofile.hh"
+#include "analysiscontext.hh"
+
+#include <algorithm>
+
+namespace c3ms
+{
+    namespace
+    {
+        // Categories counted as operators, as in CodeStatistics::getOperators()
+        bool isOperator(CodeStatistics::StatsCategory category)
+        {
+            using SC = CodeStatistics::StatsCategory;
+            return category == SC::KEYWORD || category == SC::OPERATOR || category == SC::APIKEYWORD
+                || category == SC::APILLKEYWORD || category == SC::CUSTOMKEYWORD;
+        }
+    }
+
+    void LineProfile::begin(const AnalysisContext* context)
+    {
+        context_ = context;
+        lines_.clear();
+        tokens_.clear();
+        operators_.clear();
+        symbols_.clear();
+    }
+
+    // Lines only move forward; a line the scanner reports out of order counts as the last one
+    LineProfile::Line& LineProfile::current()
+    {
+        std::size_t line = context_ ? static_cast<std::size_t>(std::max(context_->line(), 1)) : 1;
+        if (line > lines_.size()) {
+            Line next;
+            next.end = static_cast<std::uint32_t>(tokens_.size());
+            lines_.resize(line, next);
+        }
+        return lines_.back();
+    }
+
+    // Tokens of the condition category are neither operators nor operands, so they are not kept
+    void LineProfile::token(CodeStatistics::StatsCategory category, std::string_view text)
+    {
+        Line& line = current();
+        if (category == CodeStatistics::StatsCategory::CONDITION) {
+            return;
+        }
+        key_.assign(1, static_cast<char>(category));
+        key_.append(text.data(), text.size());
+        auto inserted = symbols_.try_emplace(key_, static_cast<std::uint32_t>(operators_.size()));
+        if (inserted.second) {
+            operators_.push_back(isOperator(category));
+        }
+        std::uint32_t symbol = inserted.first->second;
+        tokens_.push_back(symbol);
+        line.end = static_cast<std::uint32_t>(tokens_.size());
+        if (operators_[symbol]) {
+            ++line.operators;
+        } else {
+            ++line.operands;
+        }
+    }
+
+    void LineProfile::condition()
+    {
+        ++current().conditions;
+    }
+
+    void LineProfile::decOperator()
+    {
+        --current().operators;
+    }
+
+    // Each line enters the range once and leaves it once, so all ranges take one pass over the tokens
+    void LineProfile::forEachWindow(std::size_t size, const std::function<void(const Window&)>& visit) const
+    {
+        if (lines_.empty() || size == 0) {
+            return;
+        }
+        size = std::min(size, lines_.size());
+        std::vector<std::uint32_t> seen(operators_.size(), 0);
+        Window window;
+        auto move = [&](std::size_t index, int step) {
+            const Line& line = lines_[index];
+            std::uint32_t first = index == 0 ? 0 : lines_[index - 1].end;
+            for (std::uint32_t i = first; i < line.end; ++i) {
+                std::uint32_t symbol = tokens_[i];
+                bool unique = step > 0 ? seen[symbol]++ == 0 : --seen[symbol] == 0;
+                if (unique) {
+                    std::size_t& count = operators_[symbol] ? window.uniqueOperators : window.uniqueOperands;
+                    count = step > 0 ? count + 1 : count - 1;
+                }
+            }
+            window.operators += step * static_cast<std::int64_t>(line.operators);
+            window.operands += step * static_cast<std::int64_t>(line.operands);
+            window.conditions += step * static_cast<std::int64_t>(line.conditions);
+        };
+        for (std::size_t i = 0; i < size; ++i) {
+            move(i, 1);
+        }
+        for (std::size_t first = 0; ; ++first) {
+            window.firstLine = static_cast<int>(first + 1);
+            window.lastLine = static_cast<int>(first + size);
+            visit(window);
+            if (first + size == lines_.size()) {
+                break;
+            }
+            move(first, -1);
+            move(first + size, 1);
+        }
+    }
+}
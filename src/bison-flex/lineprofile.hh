@@ -0,0 +1,80 @@
+#ifndef __LINEPROFILE_HH_
+#define __LINEPROFILE_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "codestatistics.hh"
+#include "tokenstream.hh"
+
+namespace c3ms
+{
+    class AnalysisContext;
+
+    /**
+     * @brief Operator, operand and condition counts of every line of a scan, gathered as a token sink.
+     *
+     * @details Lines are taken from the context's scanner when each token is classified, as
+     * the token stream does. Every line keeps its counts and the end of its tokens in one
+     * array; the tokens themselves are interned by category and text into a second one, so
+     * the unique operators and operands of any range of lines can be counted again without
+     * another scan.
+     */
+    class LineProfile : public TokenSink
+    {
+        public:
+            /// Counts of one line; decOperator() takes back an operator of the line it is called on
+            struct Line {
+                std::int32_t operators = 0;
+                std::uint32_t operands = 0;
+                std::uint32_t conditions = 0;
+                std::uint32_t end = 0;      ///< End of the line's tokens
+            };
+
+            /// Counts of a range of lines
+            struct Window {
+                int firstLine = 1;
+                int lastLine = 1;
+                std::size_t uniqueOperators = 0;
+                std::size_t uniqueOperands = 0;
+                std::int64_t operators = 0;
+                std::int64_t operands = 0;
+                std::int64_t conditions = 0;
+            };
+
+            /// Starts a new profile, taking lines from the context's scanner
+            void begin(const AnalysisContext* context);
+
+            void token(CodeStatistics::StatsCategory category, std::string_view text) override;
+            void condition() override;
+            void decOperator() override;
+
+            /// Counts of every line up to the last one with a token; the first line is at 0
+            const std::vector<Line>& lines() const { return lines_; }
+
+            /**
+             * @brief Calls visit with every range of size lines, from the first line on.
+             *
+             * @details The range slides one line at a time, with unique tokens counted as lines
+             * enter and leave it. A profile of fewer lines gives a single range of all of them.
+             */
+            void forEachWindow(std::size_t size, const std::function<void(const Window&)>& visit) const;
+
+        private:
+            Line& current();
+
+            const AnalysisContext* context_ = nullptr;
+            std::vector<Line> lines_;
+            std::vector<std::uint32_t> tokens_;     // Symbol of each token, line after line
+            std::vector<bool> operators_;           // Whether each symbol is an operator
+            std::unordered_map<std::string, std::uint32_t> symbols_;
+            std::string key_;
+    };
+}
+
+#endif /* !__LINEPROFILE_HH_ */
@@ -2,8 +2,9 @@
 
 #include "parser.hh"
 #include "scanner.hh"
+#include "analysiscontext.hh"
 
-#define yylex stats.scanner_->yylex
+#define yylex ctx.scanner_->yylex
 %}
 
 %code requires
@@ -11,6 +12,11 @@
   #include <iostream>
   #include "codestatistics.hh"
   #include "location.hh"
+
+  namespace c3ms
+  {
+    class AnalysisContext;
+  }
 }
 
 %code provides
@@ -37,10 +43,16 @@
 %debug
 %define api.namespace {c3ms}
 %define api.parser.class {CodeParser}
-%parse-param {CodeStatistics &stats}
-%lex-param {CodeStatistics &stats}
+%parse-param {AnalysisContext &ctx}
+%lex-param {AnalysisContext &ctx}
 %define parse.error verbose
 
+/* Buffers scanned in chunks number their lines from where the chunk starts */
+%initial-action
+{
+  @$.initialize(nullptr, ctx.firstLine_);
+}
+
 %union
 {
  /* YYLTYPE */
@@ -66,7 +78,10 @@ namespace c3ms
 {
     void CodeParser::error(const location& l, const std::string& m)
     {
-        std::cerr << l << ": " << m << std::endl;
+        if (auto* out = ctx.diagnostics()) {
+            *out << l << ": " << m << std::endl;
+        }
+        CodeStatistics& stats = ctx.stats();
         int currentError = stats.getError();
   		stats.setError(currentError == 127 ? 127 : currentError + 1);
     }
@@ -0,0 +1,723 @@
+#include "preprocessor.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <optional>
+
+namespace c3ms
+{
+    namespace
+    {
+        using Macro = Preprocessor::Macro;
+        using MacroState = Preprocessor::Macro::State;
+        using Value = std::optional<long long>;
+
+        // Arithmetic of the #if evaluator. A result that overflows long long is unknown rather than
+        // undefined behaviour, so the condition is left to the compiler like an unsupported one.
+        constexpr long long valueMax = std::numeric_limits<long long>::max();
+        constexpr long long valueMin = std::numeric_limits<long long>::min();
+
+        Value add(long long a, long long b)
+        {
+            bool overflows = b > 0 ? a > valueMax - b : a < valueMin - b;
+            return overflows ? std::nullopt : Value(a + b);
+        }
+
+        Value subtract(long long a, long long b)
+        {
+            bool overflows = b < 0 ? a > valueMax + b : a < valueMin + b;
+            return overflows ? std::nullopt : Value(a - b);
+        }
+
+        Value multiply(long long a, long long b)
+        {
+            bool overflows = false;
+            if (a > 0) {
+                overflows = b > 0 ? a > valueMax / b : b < valueMin / a;
+            } else if (a < 0) {
+                overflows = b > 0 ? a < valueMin / b : b < 0 && a < valueMax / b;
+            }
+            return overflows ? std::nullopt : Value(a * b);
+        }
+
+        Value divide(long long a, long long b)
+        {
+            return b == 0 || (a == valueMin && b == -1) ? std::nullopt : Value(a / b);
+        }
+
+        Value modulo(long long a, long long b)
+        {
+            return b == 0 || (a == valueMin && b == -1) ? std::nullopt : Value(a % b);
+        }
+
+        Value negate(long long a)
+        {
+            return a == valueMin ? std::nullopt : Value(-a);
+        }
+
+        // Block of newlines standing in for dropped lines
+        const std::string& newlines()
+        {
+            static const std::string block(4096, '\n');
+            return block;
+        }
+
+        bool isIdentStart(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; }
+        bool isIdentChar(char c) { return isIdentStart(c) || (c >= '0' && c <= '9'); }
+        bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+        /**
+         * @brief Macro table of one buffer: local definitions over the configured ones.
+         */
+        class MacroScope
+        {
+            public:
+                explicit MacroScope(const std::unordered_map<std::string, Macro>& global) : global_(global) {}
+
+                Macro lookup(std::string_view name)
+                {
+                    auto local = local_.find(name);
+                    if (local != local_.end()) {
+                        return local->second;
+                    }
+                    key_.assign(name.data(), name.size());
+                    auto global = global_.find(key_);
+                    return global == global_.end() ? Macro{} : global->second;
+                }
+
+                void set(std::string_view name, Macro macro) { local_[name] = macro; }
+
+            private:
+                const std::unordered_map<std::string, Macro>& global_;
+                std::unordered_map<std::string_view, Macro> local_;
+                std::string key_;
+        };
+
+        /**
+         * @brief Recursive-descent evaluator of #if expressions.
+         *
+         * @details Supports integers, defined(), macros with a known value, parentheses, unary
+         * ! - + ~, arithmetic, comparisons, && and ||. Anything else, or any macro whose value is
+         * unknown, makes the result unknown, except where && and || short-circuit it.
+         */
+        class Expression
+        {
+            public:
+                Expression(std::string_view text, MacroScope& macros)
+                    : p_(text.data()), end_(text.data() + text.size()), macros_(macros) {}
+
+                Value evaluate()
+                {
+                    Value value = logicalOr();
+                    skipSpace();
+                    if (failed_ || p_ != end_) {
+                        return std::nullopt;
+                    }
+                    return value;
+                }
+
+            private:
+                void skipSpace()
+                {
+                    while (p_ < end_) {
+                        if (*p_ == ' ' || *p_ == '\t' || *p_ == '\r' || *p_ == '\n' || *p_ == '\\') {
+                            ++p_;
+                        } else if (*p_ == '/' && p_ + 1 < end_ && p_[1] == '/') {
+                            p_ = end_;
+                        } else if (*p_ == '/' && p_ + 1 < end_ && p_[1] == '*') {
+                            const char* close = p_ + 2;
+                            while (close + 1 < end_ && !(close[0] == '*' && close[1] == '/')) {
+                                ++close;
+                            }
+                            p_ = close + 1 < end_ ? close + 2 : end_;
+                        } else {
+                            break;
+                        }
+                    }
+                }
+
+                bool accept(std::string_view op)
+                {
+                    skipSpace();
+                    if (static_cast<std::size_t>(end_ - p_) >= op.size() && std::memcmp(p_, op.data(), op.size()) == 0) {
+                        p_ += op.size();
+                        return true;
+                    }
+                    return false;
+                }
+
+                Value logicalOr()
+                {
+                    Value value = logicalAnd();
+                    while (accept("||")) {
+                        Value rhs = logicalAnd();
+                        if ((value && *value) || (rhs && *rhs)) {
+                            value = 1;
+                        } else if (value && rhs) {
+                            value = 0;
+                        } else {
+                            value = std::nullopt;
+                        }
+                    }
+                    return value;
+                }
+
+                Value logicalAnd()
+                {
+                    Value value = equality();
+                    while (accept("&&")) {
+                        Value rhs = equality();
+                        if ((value && !*value) || (rhs && !*rhs)) {
+                            value = 0;
+                        } else if (value && rhs) {
+                            value = 1;
+                        } else {
+                            value = std::nullopt;
+                        }
+                    }
+                    return value;
+                }
+
+                Value equality()
+                {
+                    Value value = relational();
+                    for (;;) {
+                        if (accept("==")) {
+                            value = combine(value, relational(), [](long long a, long long b) { return Value(a == b); });
+                        } else if (accept("!=")) {
+                            value = combine(value, relational(), [](long long a, long long b) { return Value(a != b); });
+                        } else {
+                            return value;
+                        }
+                    }
+                }
+
+                Value relational()
+                {
+                    Value value = additive();
+                    for (;;) {
+                        if (accept("<=")) {
+                            value = combine(value, additive(), [](long long a, long long b) { return Value(a <= b); });
+                        } else if (accept(">=")) {
+                            value = combine(value, additive(), [](long long a, long long b) { return Value(a >= b); });
+                        } else if (accept("<")) {
+                            value = combine(value, additive(), [](long long a, long long b) { return Value(a < b); });
+                        } else if (accept(">")) {
+                            value = combine(value, additive(), [](long long a, long long b) { return Value(a > b); });
+                        } else {
+                            return value;
+                        }
+                    }
+                }
+
+                Value additive()
+                {
+                    Value value = multiplicative();
+                    for (;;) {
+                        if (accept("+")) {
+                            value = combine(value, multiplicative(), add);
+                        } else if (accept("-")) {
+                            value = combine(value, multiplicative(), subtract);
+                        } else {
+                            return value;
+                        }
+                    }
+                }
+
+                Value multiplicative()
+                {
+                    Value value = unary();
+                    for (;;) {
+                        if (accept("*")) {
+                            value = combine(value, unary(), multiply);
+                        } else if (accept("/")) {
+                            value = combine(value, unary(), divide);
+                        } else if (accept("%")) {
+                            value = combine(value, unary(), modulo);
+                        } else {
+                            return value;
+                        }
+                    }
+                }
+
+                Value unary()
+                {
+                    skipSpace();
+                    if (p_ < end_ && *p_ == '!' && !(p_ + 1 < end_ && p_[1] == '=')) {
+                        ++p_;
+                        Value value = unary();
+                        return value ? Value(!*value) : std::nullopt;
+                    }
+                    if (accept("-")) {
+                        Value value = unary();
+                        return value ? negate(*value) : std::nullopt;
+                    }
+                    if (accept("+")) {
+                        return unary();
+                    }
+                    if (accept("~")) {
+                        Value value = unary();
+                        return value ? Value(~*value) : std::nullopt;
+                    }
+                    return primary();
+                }
+
+                Value primary()
+                {
+                    skipSpace();
+                    if (p_ >= end_) {
+                        failed_ = true;
+                        return std::nullopt;
+                    }
+                    if (accept("(")) {
+                        Value value = logicalOr();
+                        if (!accept(")")) {
+                            failed_ = true;
+                        }
+                        return value;
+                    }
+                    if (isDigit(*p_)) {
+                        return number();
+                    }
+                    if (isIdentStart(*p_)) {
+                        std::string_view name = identifier();
+                        if (name == "defined") {
+                            bool paren = accept("(");
+                            skipSpace();
+                            std::string_view macro = identifier();
+                            if (macro.empty() || (paren && !accept(")"))) {
+                                failed_ = true;
+                                return std::nullopt;
+                            }
+                            return definedValue(macros_.lookup(macro));
+                        }
+                        if (name == "true" || name == "false") {
+                            return Value(name == "true");
+                        }
+                        skipSpace();
+                        if (p_ < end_ && *p_ == '(') {
+                            failed_ = true; // Function-like macro invocation
+                            return std::nullopt;
+                        }
+                        Macro macro = macros_.lookup(name);
+                        if (macro.state == MacroState::VALUE) {
+                            return macro.value;
+                        }
+                        if (macro.state == MacroState::UNDEFINED) {
+                            return 0;
+                        }
+                        return std::nullopt;
+                    }
+                    failed_ = true;
+                    return std::nullopt;
+                }
+
+                // A literal over the range of long long is read to its end but its value is unknown
+                Value number()
+                {
+                    long long value = 0;
+                    bool overflows = false;
+                    auto append = [&](int base, int digit) {
+                        overflows = overflows || value > (valueMax - digit) / base;
+                        value = overflows ? 0 : value * base + digit;
+                    };
+                    if (*p_ == '0' && p_ + 1 < end_ && (p_[1] == 'x' || p_[1] == 'X')) {
+                        p_ += 2;
+                        for (; p_ < end_; ++p_) {
+                            char c = *p_;
+                            int digit = isDigit(c) ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+                            if (digit < 0) {
+                                break;
+                            }
+                            append(16, digit);
+                        }
+                    } else {
+                        int base = *p_ == '0' ? 8 : 10;
+                        for (; p_ < end_ && isDigit(*p_); ++p_) {
+                            append(base, *p_ - '0');
+                        }
+                    }
+                    // Integer suffixes
+                    while (p_ < end_ && (*p_ == 'u' || *p_ == 'U' || *p_ == 'l' || *p_ == 'L')) {
+                        ++p_;
+                    }
+                    if (p_ < end_ && (isIdentChar(*p_) || *p_ == '.' || *p_ == '\'')) {
+                        failed_ = true; // Floating point or digit separators
+                    }
+                    return overflows ? std::nullopt : Value(value);
+                }
+
+                std::string_view identifier()
+                {
+                    const char* begin = p_;
+                    if (p_ < end_ && isIdentStart(*p_)) {
+                        while (p_ < end_ && isIdentChar(*p_)) {
+                            ++p_;
+                        }
+                    }
+                    return std::string_view(begin, static_cast<std::size_t>(p_ - begin));
+                }
+
+                template <typename Op>
+                static Value combine(Value lhs, Value rhs, Op op)
+                {
+                    return lhs && rhs ? op(*lhs, *rhs) : std::nullopt;
+                }
+
+                static Value definedValue(const Macro& macro)
+                {
+                    switch (macro.state) {
+                        case MacroState::VALUE:
+                        case MacroState::OPAQUE: return 1;
+                        case MacroState::UNDEFINED: return 0;
+                        default: return std::nullopt;
+                    }
+                }
+
+                const char* p_;
+                const char* end_;
+                MacroScope& macros_;
+                bool failed_ = false;
+        };
+
+        // Macro state given by the body of a #define or by -DNAME=VALUE
+        Macro defineFrom(std::string_view body, MacroScope& macros)
+        {
+            Value value = Expression(body, macros).evaluate();
+            return value ? Macro{MacroState::VALUE, *value} : Macro{MacroState::OPAQUE, 0};
+        }
+
+        std::string_view trimLeft(std::string_view text)
+        {
+            std::size_t i = 0;
+            while (i < text.size() && (text[i] == ' ' || text[i] == '\t')) {
+                ++i;
+            }
+            return text.substr(i);
+        }
+
+        std::string_view leadingIdentifier(std::string_view text)
+        {
+            std::size_t i = 0;
+            if (!text.empty() && isIdentStart(text[0])) {
+                while (i < text.size() && isIdentChar(text[i])) {
+                    ++i;
+                }
+            }
+            return text.substr(0, i);
+        }
+
+        // Updates the block comment state over a line, skipping string and character literals
+        void trackComments(const char* p, const char* end, bool& inComment)
+        {
+            while (p < end) {
+                if (inComment) {
+                    const char* close = p;
+                    while (close + 1 < end && !(close[0] == '*' && close[1] == '/')) {
+                        ++close;
+                    }
+                    if (close + 1 >= end) {
+                        return;
+                    }
+                    inComment = false;
+                    p = close + 2;
+                    continue;
+                }
+                char c = *p;
+                if (c == '/' && p + 1 < end && p[1] == '/') {
+                    return;
+                }
+                if (c == '/' && p + 1 < end && p[1] == '*') {
+                    inComment = true;
+                    p += 2;
+                    continue;
+                }
+                if (c == '"' || c == '\'') {
+                    for (++p; p < end && *p != c && *p != '\n'; ++p) {
+                        if (*p == '\\') {
+                            ++p;
+                        }
+                    }
+                }
+                ++p;
+            }
+        }
+
+        /**
+         * @brief One line of the buffer, with the directive it holds if any.
+         */
+        struct Line {
+            const char* start;
+            const char* end;        // Past its newline, the continuation lines of a directive included
+            bool directive;
+            std::string_view name;  // Name of the directive
+            std::string_view rest;  // What follows the name
+        };
+
+        // Reads the line at p, updating the block comment state; directives start a line outside
+        // block comments
+        Line readLine(const char* p, const char* end, bool& inComment)
+        {
+            const void* newline = std::memchr(p, '\n', static_cast<std::size_t>(end - p));
+            Line line{p, newline ? static_cast<const char*>(newline) + 1 : end, false, {}, {}};
+
+            const char* q = p;
+            if (!inComment) {
+                while (q < line.end && (*q == ' ' || *q == '\t')) {
+                    ++q;
+                }
+            }
+            if (inComment || q >= line.end || *q != '#') {
+                trackComments(line.start, line.end, inComment);
+                return line;
+            }
+
+            // Join continuation lines of the directive
+            for (;;) {
+                const char* last = line.end;
+                if (last > line.start && last[-1] == '\n') --last;
+                if (last > line.start && last[-1] == '\r') --last;
+                if (last == line.start || last[-1] != '\\' || line.end == end) {
+                    break;
+                }
+                newline = std::memchr(line.end, '\n', static_cast<std::size_t>(end - line.end));
+                line.end = newline ? static_cast<const char*>(newline) + 1 : end;
+            }
+            trackComments(line.start, line.end, inComment);
+
+            std::string_view text(q + 1, static_cast<std::size_t>(line.end - q - 1));
+            text = trimLeft(text);
+            line.directive = true;
+            line.name = leadingIdentifier(text);
+            line.rest = trimLeft(text.substr(line.name.size()));
+            return line;
+        }
+
+        /**
+         * @brief Whether the #elif branches of a chain whose #if was false can be resolved in turn.
+         *
+         * @details Reads ahead from the line after the #if to the first #elif that is true or to the
+         * #endif. Each #elif is evaluated with the macros as they stand; a #define or #undef
+         * before it may change them, so it then counts as unresolved. The filter drops the #if
+         * before it reaches its #elif lines, so a chain that mixes resolved and unresolved
+         * conditions has to be kept whole from the start.
+         */
+        bool chainResolves(const char* p, const char* end, bool inComment, MacroScope& macros)
+        {
+            int depth = 0;
+            bool redefined = false;
+            while (p < end) {
+                Line line = readLine(p, end, inComment);
+                p = line.end;
+                if (!line.directive) {
+                    continue;
+                }
+                if (line.name == "if" || line.name == "ifdef" || line.name == "ifndef") {
+                    ++depth;
+                } else if (line.name == "endif") {
+                    if (depth-- == 0) {
+                        return true;
+                    }
+                } else if (line.name == "elif" && depth == 0) {
+                    Value value = redefined ? std::nullopt : Expression(line.rest, macros).evaluate();
+                    if (!value) {
+                        return false;
+                    }
+                    if (*value != 0) {
+                        return true;
+                    }
+                } else if (line.name == "define" || line.name == "undef") {
+                    redefined = true;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * @brief One #if ... #endif chain being filtered.
+         */
+        struct Frame {
+            bool parentActive; // The enclosing region is kept
+            bool passthrough;  // A condition could not be resolved: every branch and directive is kept
+            bool taken;        // A branch of the chain was already kept
+            bool active;       // The current branch is kept
+        };
+    }
+
+    void Preprocessor::define(std::string_view definition)
+    {
+        std::size_t equals = definition.find('=');
+        std::string name(definition.substr(0, equals));
+        if (equals == std::string_view::npos) {
+            macros_[name] = Macro{Macro::State::VALUE, 1}; // -DNAME means NAME=1
+            return;
+        }
+        MacroScope scope(macros_);
+        macros_[name] = defineFrom(definition.substr(equals + 1), scope);
+    }
+
+    void Preprocessor::undefine(std::string_view name)
+    {
+        macros_[std::string(name)] = Macro{Macro::State::UNDEFINED, 0};
+    }
+
+    void Preprocessor::filter(std::string_view code, Result& result) const
+    {
+        result.clear();
+
+        const char* p = code.data();
+        const char* const end = p + code.size();
+        const char* runStart = p;        // Start of the run of kept lines
+        std::size_t droppedNewlines = 0; // Newlines owed for the dropped lines
+        bool dropping = false;
+        bool inComment = false;
+        int passthroughFrames = 0;
+        std::vector<Frame> frames;
+        MacroScope macros(macros_);
+
+        auto active = [&frames] { return frames.empty() || frames.back().active; };
+
+        auto drop = [&](const char* lineStart, const char* lineEnd) {
+            if (!dropping) {
+                if (lineStart > runStart) {
+                    result.segments.emplace_back(runStart, static_cast<std::size_t>(lineStart - runStart));
+                }
+                dropping = true;
+                ++result.skippedRegions;
+            }
+            auto lines = static_cast<std::size_t>(std::count(lineStart, lineEnd, '\n'));
+            droppedNewlines += lines;
+            result.skippedBytes += static_cast<std::size_t>(lineEnd - lineStart) - lines;
+        };
+
+        auto flushNewlines = [&] {
+            const std::string& block = newlines();
+            while (droppedNewlines > 0) {
+                std::size_t size = std::min(droppedNewlines, block.size());
+                result.segments.emplace_back(block.data(), size);
+                droppedNewlines -= size;
+            }
+        };
+
+        auto keep = [&](const char* lineStart) {
+            if (dropping) {
+                flushNewlines();
+                dropping = false;
+                runStart = lineStart;
+            }
+        };
+
+        while (p < end) {
+            Line line = readLine(p, end, inComment);
+            const char* lineStart = line.start;
+            const char* lineEnd = line.end;
+            if (!line.directive) {
+                if (active()) {
+                    keep(lineStart);
+                } else {
+                    drop(lineStart, lineEnd);
+                }
+                p = lineEnd;
+                continue;
+            }
+            std::string_view name = line.name;
+            std::string_view rest = line.rest;
+
+            if (name == "if" || name == "ifdef" || name == "ifndef") {
+                if (!active()) {
+                    frames.push_back({false, false, true, false});
+                    drop(lineStart, lineEnd);
+                } else {
+                    Value value;
+                    if (name == "if") {
+                        value = Expression(rest, macros).evaluate();
+                    } else {
+                        Value defined = Expression("defined " + std::string(leadingIdentifier(rest)), macros).evaluate();
+                        value = (defined && name == "ifndef") ? Value(!*defined) : defined;
+                    }
+                    if (!value || (*value == 0 && !chainResolves(lineEnd, end, inComment, macros))) {
+                        frames.push_back({true, true, false, true});
+                        ++passthroughFrames;
+                        keep(lineStart);
+                    } else {
+                        bool on = *value != 0;
+                        frames.push_back({true, false, on, on});
+                        drop(lineStart, lineEnd);
+                    }
+                }
+            } else if ((name == "elif" || name == "else" || name == "endif") && !frames.empty()) {
+                Frame& frame = frames.back();
+                if (!frame.parentActive) {
+                    if (name == "endif") {
+                        frames.pop_back();
+                    }
+                    drop(lineStart, lineEnd);
+                } else if (name == "endif") {
+                    bool passthrough = frame.passthrough;
+                    frames.pop_back();
+                    if (passthrough) {
+                        --passthroughFrames;
+                        keep(lineStart);
+                    } else {
+                        drop(lineStart, lineEnd);
+                    }
+                } else if (frame.passthrough) {
+                    frame.active = true;
+                    keep(lineStart);
+                } else if (frame.taken) {
+                    frame.active = false;
+                    drop(lineStart, lineEnd);
+                } else if (name == "else") {
+                    frame.active = frame.taken = true;
+                    drop(lineStart, lineEnd);
+                } else {
+                    // chainResolves() saw this condition resolve when the #if was read
+                    Value value = Expression(rest, macros).evaluate();
+                    frame.active = frame.taken = value && *value != 0;
+                    drop(lineStart, lineEnd);
+                }
+            } else if (!active()) {
+                drop(lineStart, lineEnd);
+            } else {
+                // Track definitions; inside unresolved branches their state becomes unknown
+                if (name == "define" || name == "undef") {
+                    std::string_view macro = leadingIdentifier(rest);
+                    if (!macro.empty()) {
+                        std::string_view body = rest.substr(macro.size());
+                        if (passthroughFrames > 0) {
+                            macros.set(macro, Macro{});
+                        } else if (name == "undef") {
+                            macros.set(macro, Macro{Macro::State::UNDEFINED, 0});
+                        } else if (!body.empty() && body[0] == '(') {
+                            macros.set(macro, Macro{Macro::State::OPAQUE, 0}); // Function-like macro
+                        } else if (trimLeft(body).find_first_not_of(" \t\r\n") == std::string_view::npos) {
+                            macros.set(macro, Macro{Macro::State::OPAQUE, 0}); // Empty definition
+                        } else {
+                            macros.set(macro, defineFrom(body, macros));
+                        }
+                    }
+                }
+                keep(lineStart);
+            }
+            p = lineEnd;
+        }
+
+        if (dropping) {
+            flushNewlines();
+        } else if (end > runStart) {
+            result.segments.emplace_back(runStart, static_cast<std::size_t>(end - runStart));
+        }
+    }
+
+    std::string Preprocessor::strip(std::string_view code, Result& result) const
+    {
+        filter(code, result);
+        std::string text;
+        text.reserve(code.size() - result.skippedBytes);
+        for (const auto& segment : result.segments) {
+            text.append(segment.data(), segment.size());
+        }
+        return text;
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef __PREPROCESSOR_HH_
+#define __PREPROCESSOR_HH_
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace c3ms
+{
+    /**
+     * @brief Evaluates simple preprocessor conditionals and drops inactive regions.
+     *
+     * @details Works on the raw buffer, line by line, before the scanner sees it. A conditional
+     * is resolved when its expression only involves integers, defined() and macros whose state
+     * is known: given with -D/-U or defined and undefined earlier in the same buffer. Resolved
+     * directives and the branches they disable are replaced by their newlines, so line numbers
+     * are preserved but nothing in them is tokenized. Conditionals that cannot be resolved are
+     * kept as they are, and both of their branches are analysed. So is a whole chain whose #if
+     * is false when one of the #elif conditions the scanner would reach cannot be resolved,
+     * so the scanner never sees an #elif without its #if.
+     */
+    class Preprocessor
+    {
+        public:
+            /**
+             * @brief Outcome of filtering one buffer.
+             */
+            struct Result {
+                std::vector<std::string_view> segments; ///< Text to analyse, in order
+                std::size_t skippedBytes = 0;           ///< Bytes never handed to the scanner
+                std::size_t skippedRegions = 0;         ///< Contiguous regions dropped
+
+                void clear() { segments.clear(); skippedBytes = 0; skippedRegions = 0; }
+            };
+
+            /// Defines NAME, or NAME=VALUE when the definition contains '='
+            void define(std::string_view definition);
+            void undefine(std::string_view name);
+
+            /**
+             * @brief Splits a buffer into the segments that remain active.
+             *
+             * @details The segments point into code or into a static block of newlines, so the
+             * buffer must outlive them. Safe to call concurrently on the same Preprocessor.
+             */
+            void filter(std::string_view code, Result& result) const;
+
+            /// Filtered copy of the buffer, for callers that need contiguous text
+            std::string strip(std::string_view code, Result& result) const;
+
+            /**
+             * @brief State of a macro as far as conditionals are concerned.
+             */
+            struct Macro {
+                enum class State { UNKNOWN, UNDEFINED, VALUE, OPAQUE };
+                State state = State::UNKNOWN;
+                long long value = 0;
+            };
+
+        private:
+            std::unordered_map<std::string, Macro> macros_;
+    };
+}
+
+#endif /* !__PREPROCESSOR_HH_ */
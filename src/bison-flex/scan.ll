@@ -3,11 +3,13 @@
 #include "parser.hh"
 #include "scanner.hh"
 #include "codestatistics.hh"
+#include "analysiscontext.hh"
 #include <iostream>
 #include <string>
 #include <sstream>
 #include <vector>
 #include <cctype>
+#include <cstring>
 #include <algorithm>
 #include <set>
 #include <regex>
@@ -16,9 +18,7 @@
 #define STEP()			yylloc->step();
 #define COL(Col)		yylloc->columns(Col);
 #define LINE(Line)		yylloc->lines(Line);
-#define YY_USER_ACTION	COL(yyleng);
-
-int ParserLineno;
+#define YY_USER_ACTION	if (ctx.cancelled()) yyterminate(); COL(yyleng);
 
 typedef c3ms::CodeParser::token token;
 typedef c3ms::CodeParser::token_type token_type;
@@ -31,7 +31,7 @@ typedef c3ms::CodeStatistics CodeStatistics;
 // Import enum IDType from CodeStatistics
 typedef c3ms::CodeStatistics::StatsCategory SC;
 
-void trimSpaces(std::string& str);
+static void trimSpaces(std::string& str);
 
 %}
 
@@ -78,6 +78,7 @@ oneTBB_parallel_for				parallel_for
 
  /* The rules. */
 %{
+	CodeStatistics& stats = ctx.stats();
 	STEP();
 %}
 
@@ -90,7 +91,7 @@ oneTBB_parallel_for				parallel_for
 "/*"											{BEGIN(comment);}
 <comment>[^*\n]*								{/* eat anything that's not a '*' */}
 <comment>"*"+[^*/\n]*							{/* eat up '*'s not followed by '/'s */}
-<comment>\n										{ParserLineno++;}
+<comment>\n										{LINE(1);}
 <comment>"*"+"/"								{BEGIN(INITIAL);}
 
   /***************** C++ Print Handling (Ignore) *****************/
@@ -98,7 +99,11 @@ printf[\t ]*\( {
     // Ignorar todo dentro de los paréntesis de printf hasta llegar al cierre del paréntesis
     int paren_count = 1;
     while (paren_count > 0) {
-        char next_char = yyinput();
+        int next_char = yyinput();
+        if (next_char <= 0 || ctx.cancelled()) {
+            ctx.mark_unterminated();
+            break; // Truncated call: stop at the end of the input
+        }
         if (next_char == '(') {
             ++paren_count;
         } else if (next_char == ')') {
@@ -120,19 +125,23 @@ printf[\t ]*\( {
 "#"[ \t]*"include"[ \t]*     					 { stats.category(SC::KEYWORD, "include"); BEGIN(includestate); }
 "if constexpr"[\t ]* {
     // Captura el contenido dentro de los paréntesis de if constexpr
-    char next_char;
+    int next_char;
     std::string content;
     int paren_count = 1;
     yyinput(); // Consume el primer '('
     while (paren_count > 0) {
         next_char = yyinput();
+        if (next_char <= 0 || ctx.cancelled()) {
+            ctx.mark_unterminated();
+            break; // Truncated condition: stop at the end of the input
+        }
         if (next_char == '(') {
             ++paren_count;
         } else if (next_char == ')') {
             --paren_count;
         }
         if (paren_count > 0) {
-            content += next_char;
+            content += static_cast<char>(next_char);
         }
     }
 	// Categoriza la keyword y el contenido
@@ -309,20 +318,21 @@ try												{stats.category(SC::KEYWORD,yytext);}
 typeid											{stats.category(SC::KEYWORD,yytext);}
 typename										{stats.category(SC::KEYWORD,yytext);}
 using											{stats.category(SC::KEYWORD,yytext);}
-asm												{printf("asmisunsupported\n");}
+asm												{if (auto* out = ctx.diagnostics()) *out << *yylloc << " asm is unsupported" << std::endl;}
 vector    										{stats.category(SC::TYPE,yytext);}
 "template"[\t ]*"<"[\t ]*[a-zA-Z_][a-zA-Z0-9_]*[\t ]+[a-zA-Z_][a-zA-Z0-9_]*[\t ]*">" {
     char *token;
+    char *saveptr = nullptr;
     // Add the keyword "template"
 	stats.category(SC::KEYWORD, "template");
-    token = strtok(yytext, " \t<>");
+    token = strtok_r(yytext, " \t<>", &saveptr);
 	// Generics type, for example "typename" or "size_t"
-    token = strtok(NULL, " \t<>");
+    token = strtok_r(NULL, " \t<>", &saveptr);
     if (token) {
         stats.category(SC::TYPE, token);
     }
 	// Add the parameter name
-    token = strtok(NULL, " \t<>");
+    token = strtok_r(NULL, " \t<>", &saveptr);
     if (token) {
         stats.category(SC::IDENTIFIER, token);
     }
@@ -629,7 +639,9 @@ L?\"(\\.|[^\\"])*\"								{stats.category(SC::CONSTANT,yytext);/*STRING_LITERAL
 
   /***************** End of File Handling and Error Reporting *****************/
 .	{
-	std::cerr << *yylloc << " Unexpected token : " << *yytext << std::endl;
+	if (auto* out = ctx.diagnostics()) {
+		*out << *yylloc << " Unexpected token : " << *yytext << std::endl;
+	}
   int currentError = stats.getError();
   stats.setError(currentError == 127 ? 127 : currentError + 1);
 	STEP ();
@@ -637,7 +649,7 @@ L?\"(\\.|[^\\"])*\"								{stats.category(SC::CONSTANT,yytext);/*STRING_LITERAL
 
 %%
 
-void trimSpaces(std::string& str) {
+static void trimSpaces(std::string& str) {
 	str.erase(str.begin(), std::find_if(str.begin(), str.end(), [](unsigned char ch) {
 		return !std::isspace(ch);
 	}));
@@ -657,6 +669,15 @@ namespace c3ms
 	CodeScanner::CodeScanner() : c3msFlexLexer() {}
 	CodeScanner::~CodeScanner() {}
 	void CodeScanner::set_debug(bool b) { yy_flex_debug = b; }
+
+	// Rewind onto a new input, reusing the current flex buffer
+	void CodeScanner::reset(std::istream* in, int line) {
+		yyrestart(in);
+		BEGIN(INITIAL);
+		yylineno = line;
+	}
+
+	bool CodeScanner::at_top_level() const { return YY_START == INITIAL; }
 }
 
 #ifdef yylex
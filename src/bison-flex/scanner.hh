@@ -9,7 +9,7 @@
 #  define YY_DECL c3ms::CodeParser::token_type                         \
      c3ms::CodeScanner::yylex(c3ms::CodeParser::semantic_type* yylval,    \
                               c3ms::CodeParser::location_type* yylloc, \
-                              c3ms::CodeStatistics& stats)
+                              c3ms::AnalysisContext& ctx)
 # endif
 
 
@@ -31,9 +31,13 @@ namespace c3ms {
             virtual CodeParser::token_type yylex(
                 CodeParser::semantic_type* yylval,
                 CodeParser::location_type* yylloc,
-                CodeStatistics& stats);
+                AnalysisContext& ctx);
 
             void set_debug(bool b);
+            void reset(std::istream* in, int line = 1);
+
+            /// True unless the input ended inside a comment or an #include
+            bool at_top_level() const;
     };
 }
 
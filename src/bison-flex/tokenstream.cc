@@ -0,0 +1,241 @@
+#include "tokenstream.hh"
+#include "analysiscontext.hh"
+#include "varint.hh"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace c3ms
+{
+    namespace
+    {
+        constexpr char Magic[] = {'C', '3', 'T', 'S', 1};
+
+        // Opcodes; TOKEN and SYMBOL carry the category in their low nibble
+        enum Op : unsigned char {
+            TOKEN = 0x00,       // varint symbol id
+            SYMBOL = 0x10,      // string: defines the next symbol id and counts it
+            CONDITION = 0x20,
+            DECOPERATOR = 0x21,
+            LINE = 0x22,        // zigzag varint delta
+            UNIT = 0x23,        // string name
+            UNIT_END = 0x24,    // varint error, varint lines of code
+            UNIT_SKIPPED = 0x25 // string name, string note
+        };
+
+        constexpr std::size_t FlushBytes = 1 << 20;
+    }
+
+    TokenStreamWriter::TokenStreamWriter(std::ostream& out) : out_(out)
+    {
+        buffer_.append(Magic, sizeof(Magic));
+    }
+
+    TokenStreamWriter::~TokenStreamWriter()
+    {
+        flush();
+    }
+
+    void TokenStreamWriter::beginUnit(std::string_view name, const AnalysisContext* context)
+    {
+        unitStart_ = buffer_.size();
+        unitSymbols_ = names_.size();
+        context_ = context;
+        line_ = 1;
+        buffer_.push_back(static_cast<char>(UNIT));
+        putString(name);
+    }
+
+    void TokenStreamWriter::endUnit(int error, int linesOfCode)
+    {
+        buffer_.push_back(static_cast<char>(UNIT_END));
+        putVarint(static_cast<std::uint64_t>(error));
+        putVarint(static_cast<std::uint64_t>(linesOfCode));
+        context_ = nullptr;
+        if (buffer_.size() >= FlushBytes) {
+            flush();
+        }
+    }
+
+    void TokenStreamWriter::abortUnit()
+    {
+        buffer_.resize(unitStart_);
+        while (names_.size() > unitSymbols_) {
+            symbols_.erase(symbols_.find(*names_.back()));
+            names_.pop_back();
+        }
+        context_ = nullptr;
+    }
+
+    void TokenStreamWriter::skipUnit(std::string_view name, std::string_view note)
+    {
+        buffer_.push_back(static_cast<char>(UNIT_SKIPPED));
+        putString(name);
+        putString(note);
+    }
+
+    void TokenStreamWriter::flush()
+    {
+        out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+        out_.flush();
+        buffer_.clear();
+        unitStart_ = 0;
+    }
+
+    void TokenStreamWriter::token(CodeStatistics::StatsCategory category, std::string_view text)
+    {
+        line();
+        auto categoryBits = static_cast<unsigned char>(category);
+        key_.assign(text.data(), text.size());
+        auto it = symbols_.find(key_);
+        if (it != symbols_.end()) {
+            buffer_.push_back(static_cast<char>(TOKEN | categoryBits));
+            putVarint(it->second);
+            return;
+        }
+        auto inserted = symbols_.emplace(key_, static_cast<std::uint32_t>(names_.size())).first;
+        names_.push_back(&inserted->first);
+        buffer_.push_back(static_cast<char>(SYMBOL | categoryBits));
+        putString(text);
+    }
+
+    void TokenStreamWriter::condition()
+    {
+        line();
+        buffer_.push_back(static_cast<char>(CONDITION));
+    }
+
+    void TokenStreamWriter::decOperator()
+    {
+        buffer_.push_back(static_cast<char>(DECOPERATOR));
+    }
+
+    void TokenStreamWriter::line()
+    {
+        if (!context_) {
+            return;
+        }
+        int current = context_->line();
+        if (current != line_) {
+            std::int64_t delta = current - line_;
+            buffer_.push_back(static_cast<char>(LINE));
+            putVarint((static_cast<std::uint64_t>(delta) << 1) ^ static_cast<std::uint64_t>(delta >> 63));
+            line_ = current;
+        }
+    }
+
+    void TokenStreamWriter::putVarint(std::uint64_t value)
+    {
+        c3ms::putVarint(buffer_, value);
+    }
+
+    void TokenStreamWriter::putString(std::string_view text)
+    {
+        putVarint(text.size());
+        buffer_.append(text.data(), text.size());
+    }
+
+    TokenStreamReader::TokenStreamReader(std::string_view data)
+        : p_(reinterpret_cast<const unsigned char*>(data.data())),
+          end_(p_ + data.size())
+    {
+        if (data.size() < sizeof(Magic) || std::memcmp(data.data(), Magic, sizeof(Magic)) != 0) {
+            throw std::runtime_error("not a C3MS token stream, or an unsupported version");
+        }
+        p_ += sizeof(Magic);
+    }
+
+    bool TokenStreamReader::next(Unit& unit, CodeStatistics& stats)
+    {
+        if (p_ == end_) {
+            return false;
+        }
+
+        unit = Unit{};
+        unsigned char op = *p_++;
+        if (op == UNIT_SKIPPED) {
+            unit.name = getString();
+            unit.note = getString();
+            return true;
+        }
+        if (op != UNIT) {
+            fail();
+        }
+        unit.name = getString();
+
+        for (;;) {
+            if (p_ == end_) {
+                fail();
+            }
+            op = *p_++;
+            unsigned kind = op & 0xF0;
+            unsigned category = op & 0x0F;
+            if ((kind == TOKEN || kind == SYMBOL) && category < CodeStatistics::NumCategories) {
+                std::uint64_t id;
+                if (kind == SYMBOL) {
+                    id = symbols_.size();
+                    symbols_.push_back(getString());
+                    counts_.resize(symbols_.size() * CodeStatistics::NumCategories, 0);
+                } else {
+                    id = getVarint();
+                    if (id >= symbols_.size()) {
+                        fail();
+                    }
+                }
+                auto slot = static_cast<std::uint32_t>(id * CodeStatistics::NumCategories + category);
+                if (counts_[slot]++ == 0) {
+                    touched_.push_back(slot);
+                }
+            } else if (op == CONDITION) {
+                stats.addCondition();
+            } else if (op == DECOPERATOR) {
+                stats.decOperator();
+            } else if (op == LINE) {
+                getVarint();
+            } else if (op == UNIT_END) {
+                unit.error = static_cast<int>(getVarint());
+                unit.linesOfCode = static_cast<int>(getVarint());
+                break;
+            } else {
+                fail();
+            }
+        }
+
+        // One insertion per distinct symbol and category
+        for (std::uint32_t slot : touched_) {
+            auto category = static_cast<CodeStatistics::StatsCategory>(slot % CodeStatistics::NumCategories);
+            stats.category(category, symbols_[slot / CodeStatistics::NumCategories], counts_[slot]);
+            counts_[slot] = 0;
+        }
+        touched_.clear();
+        stats.setError(unit.error);
+        return true;
+    }
+
+    std::uint64_t TokenStreamReader::getVarint()
+    {
+        std::string_view rest(reinterpret_cast<const char*>(p_), static_cast<std::size_t>(end_ - p_));
+        std::uint64_t value = 0;
+        if (!c3ms::getVarint(rest, value)) {
+            fail();
+        }
+        p_ = reinterpret_cast<const unsigned char*>(rest.data());
+        return value;
+    }
+
+    std::string_view TokenStreamReader::getString()
+    {
+        std::uint64_t size = getVarint();
+        if (size > static_cast<std::uint64_t>(end_ - p_)) {
+            fail();
+        }
+        std::string_view text(reinterpret_cast<const char*>(p_), static_cast<std::size_t>(size));
+        p_ += size;
+        return text;
+    }
+
+    void TokenStreamReader::fail() const
+    {
+        throw std::runtime_error("corrupt token stream");
+    }
+}
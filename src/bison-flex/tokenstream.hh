@@ -0,0 +1,118 @@
+#ifndef __TOKENSTREAM_HH_
+#define __TOKENSTREAM_HH_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "codestatistics.hh"
+
+namespace c3ms
+{
+    class AnalysisContext;
+
+    /**
+     * @brief Receives every classification the scanner makes, as it makes it.
+     */
+    class TokenSink
+    {
+        public:
+            virtual ~TokenSink() = default;
+
+            virtual void token(CodeStatistics::StatsCategory category, std::string_view text) = 0;
+            virtual void condition() = 0;
+            virtual void decOperator() = 0;
+    };
+
+    /**
+     * @brief Writes the classified token stream of a run in a compact binary format.
+     *
+     * @details The stream starts with the magic "C3TS" and a version byte, followed by units.
+     * Each token is a single opcode byte carrying its category and the varint id of an interned
+     * symbol; a symbol's text is written only the first time it appears in the stream. Line
+     * changes, conditions and decOperator() calls are opcodes of their own. A unit is buffered
+     * until it ends, so an abandoned unit leaves no trace in the output.
+     */
+    class TokenStreamWriter : public TokenSink
+    {
+        public:
+            explicit TokenStreamWriter(std::ostream& out);
+            ~TokenStreamWriter() override;
+
+            /// Starts a unit; lines are taken from the context's scanner when one is given
+            void beginUnit(std::string_view name, const AnalysisContext* context = nullptr);
+            void endUnit(int error, int linesOfCode);
+            /// Drops everything written since beginUnit()
+            void abortUnit();
+            /// Records a unit that was not analysed, with the reason
+            void skipUnit(std::string_view name, std::string_view note);
+            void flush();
+
+            void token(CodeStatistics::StatsCategory category, std::string_view text) override;
+            void condition() override;
+            void decOperator() override;
+
+        private:
+            void line();
+            void putVarint(std::uint64_t value);
+            void putString(std::string_view text);
+
+            std::ostream& out_;
+            std::string buffer_;
+            std::size_t unitStart_ = 0;
+            std::size_t unitSymbols_ = 0;
+            const AnalysisContext* context_ = nullptr;
+            int line_ = 1;
+
+            std::unordered_map<std::string, std::uint32_t> symbols_;
+            std::vector<const std::string*> names_; // Keys of symbols_, by id
+            std::string key_;
+    };
+
+    /**
+     * @brief Rebuilds CodeStatistics from a token stream without scanning any code.
+     *
+     * @details Tokens are counted per interned symbol in a flat table and added to the
+     * statistics once per distinct symbol when the unit ends, so replaying costs little more
+     * than reading the stream.
+     */
+    class TokenStreamReader
+    {
+        public:
+            /**
+             * @brief A unit read back from the stream.
+             */
+            struct Unit {
+                std::string name;
+                std::string note;     ///< Why the unit was skipped, empty when it was analysed
+                int error = 0;
+                int linesOfCode = 0;
+            };
+
+            /// The stream must outlive the reader; throws std::runtime_error on a bad header
+            explicit TokenStreamReader(std::string_view data);
+
+            /**
+             * @brief Reads the next unit, adding its tokens to stats.
+             *
+             * @return false at the end of the stream. Throws std::runtime_error on corrupt input.
+             */
+            bool next(Unit& unit, CodeStatistics& stats);
+
+        private:
+            std::uint64_t getVarint();
+            std::string_view getString();
+            void fail() const;
+
+            const unsigned char* p_;
+            const unsigned char* end_;
+            std::vector<std::string_view> symbols_;
+            std::vector<std::uint32_t> counts_;  // Per symbol and category
+            std::vector<std::uint32_t> touched_; // Slots of counts_ used by the current unit
+    };
+}
+
+#endif /* !__TOKENSTREAM_HH_ */
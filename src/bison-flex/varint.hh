@@ -0,0 +1,67 @@
+#ifndef __VARINT_HH_
+#define __VARINT_HH_
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <string_view>
+
+namespace c3ms
+{
+    /**
+     * @brief Appends an unsigned LEB128 varint: seven bits per byte, lowest first, with the
+     * high bit set on every byte but the last.
+     *
+     * @param out Anything with push_back(char), such as a std::string.
+     * @param value The value.
+     */
+    template <typename Out>
+    inline void putVarint(Out& out, std::uint64_t value)
+    {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    /**
+     * @brief Reads a varint written by putVarint() from the front of the data.
+     *
+     * @param data The data, advanced past the varint.
+     * @param value Set to the value.
+     * @return bool False when the data ends inside the varint or it runs past 64 bits.
+     */
+    inline bool getVarint(std::string_view& data, std::uint64_t& value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64 && !data.empty(); shift += 7) {
+            auto byte = static_cast<unsigned char>(data.front());
+            data.remove_prefix(1);
+            value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// The same, from a stream
+    inline bool getVarint(std::istream& in, std::uint64_t& value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            auto byte = in.get();
+            if (byte == std::char_traits<char>::eof()) {
+                return false;
+            }
+            value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+#endif /* !__VARINT_HH_ */
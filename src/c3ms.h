@@ -0,0 +1,76 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+/*
+ * C ABI of the C3MS analysis library (libc3ms_c).
+ *
+ * Every function is reentrant and may be called from several threads at once.
+ * Nothing is ever written to the console.
+ */
+
+#ifndef C3MS_H
+#define C3MS_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define C3MS_API __attribute__((visibility("default")))
+#else
+#define C3MS_API
+#endif
+
+/* Return codes */
+#define C3MS_OK             0
+#define C3MS_ERROR_ARGUMENT 1
+#define C3MS_ERROR_INTERNAL 2
+
+/* Flags for c3ms_analyze */
+#define C3MS_FUNCTION_METRICS 1u /* Also analyze every function of the buffer */
+
+/* Metrics of one analyzed unit (the whole buffer or one function) */
+typedef struct c3ms_metrics {
+    unsigned int n1;           /* Unique operators */
+    unsigned int n2;           /* Unique operands */
+    unsigned int N1;           /* Total operators */
+    unsigned int N2;           /* Total operands */
+    double volume;
+    double difficulty;
+    double effort;
+    double time_required;      /* Seconds */
+    double bugs;               /* Delivered bugs */
+    int conditions;
+    int cyclomatic_complexity;
+    int lines_of_code;
+    int maintainability_index;
+    int errors;                /* Unexpected tokens found by the scanner */
+} c3ms_metrics;
+
+/* Opaque analysis result, released with c3ms_result_free */
+typedef struct c3ms_result c3ms_result;
+
+/*
+ * Analyzes size bytes of source code at data. The buffer is not copied and is not
+ * needed once the call returns. On success *result owns the metrics.
+ */
+C3MS_API int c3ms_analyze(const char* data, size_t size, unsigned int flags, c3ms_result** result);
+
+/* Metrics of the whole buffer */
+C3MS_API const c3ms_metrics* c3ms_result_file(const c3ms_result* result);
+
+/* Number of functions analyzed, 0 unless C3MS_FUNCTION_METRICS was given */
+C3MS_API size_t c3ms_result_function_count(const c3ms_result* result);
+
+/* Name and metrics of a function, or NULL if index is out of range */
+C3MS_API const char* c3ms_result_function_name(const c3ms_result* result, size_t index);
+C3MS_API const c3ms_metrics* c3ms_result_function_metrics(const c3ms_result* result, size_t index);
+
+C3MS_API void c3ms_result_free(c3ms_result* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* C3MS_H */
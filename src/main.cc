@@ -1,8 +1,36 @@
+#include <csignal>
+#include <cstdlib>
+#include <deque>
 #include <iostream>
 #include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <utility>
+#include "bison-flex/analysiscontext.hh"
+#include "bison-flex/chunkedparser.hh"
 #include "bison-flex/codestatistics.hh"
+#include "bison-flex/lineprofile.hh"
+#include "bison-flex/tokenstream.hh"
+#include "ApiIndex.hpp"
+#include "Checkpoint.hpp"
+#include "Clones.hpp"
 #include "CodeMetrics.hpp"
 #include "CodeUtils.hpp"
+#include "ContentCache.hpp"
+#include "FunctionCache.hpp"
+#include "Heatmap.hpp"
+#include "History.hpp"
+#include "Hotspots.hpp"
+#include "InputGuard.hpp"
+#include "ReadAhead.hpp"
+#include "ReportWriter.hpp"
+#include "ResultStore.hpp"
+#include "Rollup.hpp"
+#include "Sampling.hpp"
+#include "Schedule.hpp"
+#include "TokenSpill.hpp"
+#include "WorkerPool.hpp"
 
 using namespace c3ms;
 
@@ -26,32 +54,116 @@ void printDebugInfo(const std::string& header, const CodeStatistics& stats, int
   }
 }
 
+// The report of a unit, with its API tokens when an index of them is built, and a note to print
+// before it, such as the hot lines
+ReportRecord makeReport(std::size_t unit, bool last, const std::string& title, const std::string& color, const HalsteadMetrics& metrics, const CodeStatistics& stats, bool apis, std::string note = {}) {
+    ReportRecord record{unit, last, title, &color, metrics, summarize(stats), std::move(note), {}};
+    if (apis) {
+        record.apis = collectApiTokens(stats);
+    }
+    return record;
+}
+
+// Queue a report for the writer thread, keeping a copy when the unit is being cached; with
+// --top the report only goes to the rankings. Without a writer, as in worker processes, the
+// report is only kept.
+void submitRecord(ReportWriter* writer, HotspotReport* hotspots, CachedUnit* capture, ReportRecord record) {
+    bool last = record.last;
+    std::size_t unit = record.unit;
+    if (hotspots) {
+        if (hotspots->admits(last, record.metrics, unit)) {
+            if (capture) {
+                capture->records.push_back(record);
+            }
+            hotspots->push(last, std::move(record));
+        }
+        if (last && writer) {
+            writer->skip(unit);
+        }
+        return;
+    }
+
+    if (capture) {
+        capture->records.push_back(record);
+    }
+    if (writer) {
+        writer->submit(std::move(record));
+    }
+}
+
+// Build and queue a report; with --top it is not even built when it cannot enter the rankings
+void submitReport(ReportWriter* writer, HotspotReport* hotspots, std::size_t unit, bool last, const std::string& title, const std::string& color, const MetricsCalculator& metrics, const CodeStatistics& stats, CachedUnit* capture, bool apis = false, std::string note = {}) {
+    HalsteadMetrics values = metrics.getMetrics();
+    if (hotspots && !hotspots->admits(last, values, unit)) {
+        if (last && writer) {
+            writer->skip(unit);
+        }
+        return;
+    }
+    submitRecord(writer, hotspots, capture, makeReport(unit, last, title, color, values, stats, apis, std::move(note)));
+}
 
-void processFile(const std::filesystem::path& filePath, int verbosity, bool fileMetricsFlag, bool globalMetricsFlag, bool printCodeFlag, CodeStatistics& globalStats, int& globalLinesOfCode) {
-    CodeStatistics fileStats;
-    fileStats.parse_file(filePath.string());
-    int fileLinesOfCode = countLinesOfCode(filePath.string());
+// Add the bytes the preprocessor skipped in one unit to the running totals
+void addSkipped(ScanReport& total, std::size_t bytes, std::size_t regions) {
+    total.skippedBytes += bytes;
+    total.skippedRegions += regions;
+}
+
+// Analyse a whole file, profiling its lines when a heatmap is asked for; returns false when
+// the watchdog abandoned it
+bool processFile(const std::filesystem::path& filePath, std::string_view code, const ProgramOptions& options, AnalysisContext& context, CodeStatistics& fileStats, CodeStatistics& globalStats, int& globalLinesOfCode, ScanReport& skipped, ReportWriter* writer, HotspotReport* hotspots, std::size_t unit, CachedUnit* capture, LineProfile* heat = nullptr) {
+    fileStats.reset();
+    if (heat) {
+        heat->begin(&context);
+    }
+    context.parse_buffer(code, fileStats);
+    if (context.cancelled()) {
+        return false;
+    }
+    addSkipped(skipped, context.report().skippedBytes, context.report().skippedRegions);
+    int fileLinesOfCode = countLines(code);
 
     // Calculate metrics
     MetricsCalculator fileMetrics(fileStats, fileLinesOfCode);
-    if (fileMetricsFlag || (!globalMetricsFlag)) {
-        printHeader("File Metrics: " + filePath.filename().string(), GREEN);
-        fileMetrics.report(verbosity, filePath.filename().string(), fileLinesOfCode, fileStats);
+    if (options.fileMetrics || (!options.globalMetrics)) {
+        std::string note = heat ? describeHotLines(*heat, options.heatmapWindow, options.heatRegions) : std::string();
+        submitReport(writer, hotspots, unit, true, "File Metrics: " + filePath.filename().string(), GREEN, fileMetrics, fileStats, capture, !options.apiIndex.empty(), std::move(note));
+    } else if (writer) {
+        writer->skip(unit);
     }
 
     // Update global stats
     globalStats += fileStats;
     globalLinesOfCode += fileLinesOfCode;
+    if (capture) {
+        *capture = {true, std::move(capture->records), fileStats, fileLinesOfCode, context.report()};
+    }
 
-    printDebugInfo("File: " + filePath.filename().string(), fileStats, fileLinesOfCode, printCodeFlag);
+    printDebugInfo("File: " + filePath.filename().string(), fileStats, fileLinesOfCode, options.printCode);
+    return true;
 }
 
-void processFunction(const std::filesystem::path& filePath, int verbosity, bool functionMetricsFlag, bool fileMetricsFlag, bool globalMetricsFlag, bool printCodeFlag, CodeStatistics& globalStats, int& globalLinesOfCode) {
-    CodeStatistics fileStats, functionStats;
+// Analyse each function of a file; returns false when the watchdog abandoned it. The reports
+// of the functions are held until the last one is done, so an abandoned file reports none of
+// them, as it does in a worker process.
+bool processFunction(const std::filesystem::path& filePath, std::string_view code, const ProgramOptions& options, AnalysisContext& context, CodeStatistics& fileStats, CodeStatistics& functionStats, CodeStatistics& globalStats, int& globalLinesOfCode, ScanReport& skipped, ReportWriter* writer, HotspotReport* hotspots, std::size_t unit, CachedUnit* capture, FunctionCache* functionCache = nullptr) {
     int fileLinesOfCode = 0;
+    fileStats.reset();
+
+    // Functions are extracted from the active branches only, so they are parsed without filtering again
+    const Preprocessor* preprocessor = std::exchange(context.options().preprocessor, nullptr);
+    Preprocessor::Result filtered;
+    std::string activeCode;
+    if (preprocessor) {
+        activeCode = preprocessor->strip(code, filtered);
+        code = activeCode;
+    }
 
     // Extract functions
-    auto functions = extractFunctions(filePath.string());
+    ViewStreamBuf codeBuffer;
+    codeBuffer.reset(code);
+    std::istream codeStream(&codeBuffer);
+    auto functions = extractFunctions(codeStream, &context);
 
     if constexpr (DEBUG) {
         std::clog << "Functions: " << std::endl;
@@ -61,81 +173,862 @@ void processFunction(const std::filesystem::path& filePath, int verbosity, bool
     }
 
 
+    std::vector<ReportRecord> reports;
     for (const auto& func : functions) {
         try {
-            // Create and process temporary file
-            std::string tempFilename = createTemporaryFile(func.code, func.name);
-            functionStats.parse_file(tempFilename);
-            int linesOfCodeFunc = countLinesOfCode(tempFilename.c_str());
+            // Process the function code straight from memory, unless it is unchanged since an earlier run
+            ContentKey key;
+            if (!functionCache || !functionCache->find(func.code, key, functionStats)) {
+                context.parse_buffer(func.code, functionStats);
+                if (context.cancelled()) {
+                    functionStats.reset();
+                    break;
+                }
+                if (functionCache) {
+                    functionCache->insert(key, functionStats);
+                }
+            }
+            int linesOfCodeFunc = countLines(func.code);
 
             // Calculate function metrics
             MetricsCalculator metricsFunc(functionStats, linesOfCodeFunc);
-            if (functionMetricsFlag || (!fileMetricsFlag && !globalMetricsFlag)) {
-                printHeader("Function Metrics: " + func.name, RED);
-                metricsFunc.report(verbosity, func.name, linesOfCodeFunc, functionStats);
+            if (options.functionMetrics || (!options.fileMetrics && !options.globalMetrics)) {
+                HalsteadMetrics values = metricsFunc.getMetrics();
+                if (!hotspots || hotspots->admits(false, values, unit)) {
+                    reports.push_back(makeReport(unit, false, "Function Metrics: " + func.name, RED, values, functionStats, !options.apiIndex.empty()));
+                }
             }
 
             // Update stats and print debug info
-            printDebugInfo("Function: " + func.name, functionStats, linesOfCodeFunc, printCodeFlag, func.code);
+            printDebugInfo("Function: " + func.name, functionStats, linesOfCodeFunc, options.printCode, func.code);
             fileStats += functionStats;
             fileLinesOfCode += linesOfCodeFunc;
             functionStats.reset();
-
-            // Delete temporary file
-            deleteTemporaryFile(tempFilename);
         } catch (const std::exception& e) {
             std::cerr << "Error processing function " << func.name << ": " << e.what() << std::endl;
         }
     }
 
+    context.options().preprocessor = preprocessor;
+    if (context.cancelled()) {
+        return false;
+    }
+    for (auto& report : reports) {
+        submitRecord(writer, hotspots, capture, std::move(report));
+    }
+    addSkipped(skipped, filtered.skippedBytes, filtered.skippedRegions);
+
     // Calculate file metrics if needed
     MetricsCalculator metricsFile(fileStats, fileLinesOfCode);
-    if (fileMetricsFlag || (!functionMetricsFlag && !globalMetricsFlag)) {
-        printHeader("File Metrics: " + filePath.filename().string(), GREEN);
-        metricsFile.report(verbosity, filePath.filename().string(), fileLinesOfCode, fileStats);
+    if (options.fileMetrics || (!options.functionMetrics && !options.globalMetrics)) {
+        submitReport(writer, hotspots, unit, true, "File Metrics: " + filePath.filename().string(), GREEN, metricsFile, fileStats, capture, !options.apiIndex.empty());
+    } else if (writer) {
+        writer->skip(unit);
     }
 
     // Update global stats
     globalStats += fileStats;
     globalLinesOfCode += fileLinesOfCode;
+    if (capture) {
+        *capture = {true, std::move(capture->records), fileStats, fileLinesOfCode, {filtered.skippedBytes, filtered.skippedRegions}};
+    }
+    return true;
 }
 
-int main(int argc, char* argv[]) {
-    int verbosity = 1;
-    bool fileMetricsFlag = false;
-    bool functionMetricsFlag = false;
-    bool globalMetricsFlag = false;
-    bool printCodeFlag = false;
+// Replay the results of an earlier file with the same contents
+void replayUnit(const std::filesystem::path& filePath, const CachedUnit& cached, CodeStatistics& globalStats, int& globalLinesOfCode, ScanReport& skipped, ReportWriter& writer, HotspotReport* hotspots, std::size_t unit) {
+    bool closed = false;
+    for (ReportRecord record : cached.records) {
+        record.unit = unit;
+        bool last = record.last;
+        if (last) {
+            record.title = "File Metrics: " + filePath.filename().string();
+        }
+        // Only reports that entered the rankings were kept, and the others cannot enter them now
+        if (hotspots) {
+            hotspots->push(last, std::move(record));
+            continue;
+        }
+        closed = closed || last;
+        writer.submit(std::move(record));
+    }
+    if (!closed) {
+        writer.skip(unit);
+    }
+
+    globalStats += cached.stats;
+    globalLinesOfCode += cached.linesOfCode;
+    addSkipped(skipped, cached.skipped.skippedBytes, cached.skipped.skippedRegions);
+}
 
-    auto filepaths = parseArguments(argc, argv, verbosity, functionMetricsFlag, fileMetricsFlag, globalMetricsFlag, printCodeFlag);
+// State of a worker process, kept across the files it analyses. Tests name a file in
+// C3MS_WORKER_CRASH to have the worker given it die, as it would on a scanner fault.
+struct WorkerState {
+    Watchdog watchdog;
+    CodeStatistics fileStats, functionStats, globalStats;
+    const char* crashOn = std::getenv("C3MS_WORKER_CRASH");
+};
 
-    if (filepaths.empty()) {
-        usage();
-        return EXIT_FAILURE;
+// Analyse a file in a worker process and encode what the parent needs to replay it: the
+// reports and statistics, a skip note from the sniffer, or nothing when time ran out
+void analyseInWorker(const std::filesystem::path& filePath, const ProgramOptions& options, AnalysisContext& context, WorkerState& state, std::size_t unit, WorkerPool::Output& result, LineProfile* heat) {
+    if (state.crashOn && filePath.filename() == state.crashOn) {
+        std::raise(SIGKILL);
     }
+    CachedUnit results;
+    std::string_view code = context.read_file(filePath.string());
+    std::string reason = options.limits.sniff ? sniffInput(code) : std::string();
+    if (!reason.empty()) {
+        results.records.push_back({unit, true, "", nullptr, {}, {}, "Skipped " + filePath.filename().string() + ": " + reason, {}});
+    } else {
+        if (options.limits.timeoutSeconds > 0) {
+            state.watchdog.arm(context, options.limits.timeoutSeconds);
+        }
+        state.globalStats.reset();
+        int linesOfCode = 0;
+        ScanReport skipped;
+        bool completed = options.functionMetrics
+            ? processFunction(filePath, code, options, context, state.fileStats, state.functionStats, state.globalStats, linesOfCode, skipped, nullptr, nullptr, unit, &results)
+            : processFile(filePath, code, options, context, state.fileStats, state.globalStats, linesOfCode, skipped, nullptr, nullptr, unit, &results, heat);
+        state.watchdog.disarm();
+        if (!completed) {
+            results = CachedUnit(); // Reports of the functions done before the budget ran out are dropped
+        }
+    }
+    encodeUnit(results, result);
+}
 
-    CodeStatistics globalStats;
+// Print the arena usage of the statistics reused across the run
+void printMemoryReport(std::ostream& out, const std::vector<std::pair<std::string, const CodeStatistics*>>& arenas) {
+    out << "\nMemory (token table arenas, bytes):\n" << std::string(80, '-') << "\n"
+        << std::left << std::setw(24) << "Statistics" << std::right << std::setw(14) << "High-water"
+        << std::setw(14) << "Reserved" << std::setw(14) << "Heap blocks" << std::setw(14) << "Releases" << "\n";
+    for (const auto& [name, stats] : arenas) {
+        const auto& usage = stats->memoryUsage();
+        out << std::left << std::setw(24) << name << std::right << std::setw(14) << usage.highWater
+            << std::setw(14) << usage.reserved << std::setw(14) << usage.blocks << std::setw(14) << usage.releases << "\n";
+    }
+    out << std::string(80, '-') << "\n";
+}
+
+// Rankings of the files and functions for --top, or nullptr without it
+std::unique_ptr<HotspotReport> makeHotspots(const ProgramOptions& options, const std::vector<std::filesystem::path>& inputs) {
+    HotspotMetric metric;
+    if (options.top == 0 || !parseHotspotMetric(options.topBy, metric)) {
+        return nullptr;
+    }
+    return std::make_unique<HotspotReport>(options.top, metric, inputs);
+}
+
+// Rebuild file and global metrics from a token stream, without scanning any code
+int replayTokens(const ProgramOptions& options) {
+    auto context = ContextPool::global().acquire();
+    std::string_view data = context->read_file(options.replayTokens);
+
+    CodeStatistics globalStats, fileStats;
     int globalLinesOfCode = 0;
+    ReportWriter writer(std::cout, options.verbosity);
+    std::vector<std::filesystem::path> inputs; // Function reports never come from a stream
+    auto hotspots = makeHotspots(options, inputs);
+    std::size_t unit = 0;
+
+    try {
+        TokenStreamReader reader(data);
+        TokenStreamReader::Unit tokens;
+        for (;; ++unit) {
+            fileStats.reset();
+            if (!reader.next(tokens, fileStats)) {
+                break;
+            }
+            if (!tokens.note.empty()) {
+                writer.skip(unit, tokens.note);
+                continue;
+            }
 
-    for (const auto& filePath : filepaths) {
-        if (!std::filesystem::exists(filePath) || !std::filesystem::is_regular_file(filePath)) {
-            std::cerr << "Error: " << filePath << " not accessible or invalid\n";
+            MetricsCalculator fileMetrics(fileStats, tokens.linesOfCode);
+            if (options.fileMetrics || (!options.globalMetrics)) {
+                std::string name = std::filesystem::path(tokens.name).filename().string();
+                submitReport(&writer, hotspots.get(), unit, true, "File Metrics: " + name, GREEN, fileMetrics, fileStats, nullptr);
+            } else {
+                writer.skip(unit);
+            }
+            globalStats += fileStats;
+            globalLinesOfCode += tokens.linesOfCode;
+        }
+    } catch (const std::exception& e) {
+        writer.close();
+        std::cerr << "Error: " << options.replayTokens << ": " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    MetricsCalculator globalMetrics(globalStats, globalLinesOfCode);
+    if (hotspots) {
+        hotspots->submit(writer, unit);
+    }
+    if (options.globalMetrics || !options.fileMetrics) {
+        submitReport(&writer, nullptr, unit, true, "Global Metrics", YELLOW, globalMetrics, globalStats, nullptr);
+    }
+    writer.close();
+    if (options.memoryReport) {
+        printMemoryReport(std::cout, {{"File statistics", &fileStats}, {"Global statistics", &globalStats}});
+    }
+    return EXIT_SUCCESS;
+}
+
+// Check the options of an analysis of the input files against each other; prints the error
+bool checkAnalysisOptions(const ProgramOptions& options) {
+    if (options.sampleFraction < 0 || options.sampleFraction > 1) {
+        std::cerr << "Error: --sample takes a fraction in (0, 1]\n";
+        return false;
+    }
+    // Workers keep their scanners, and the tokens they see, to themselves
+    if (options.workers > 0 && !options.dumpTokens.empty()) {
+        std::cerr << "Error: --dump-tokens cannot be combined with --workers\n";
+        return false;
+    }
+    // Results taken as they finish would reach the sample estimates out of input order
+    if (!options.schedule.empty()) {
+        if (options.schedule != "input" && options.schedule != "cost") {
+            std::cerr << "Error: --schedule takes input or cost\n";
+            return false;
+        }
+        if (options.workers == 0 || options.sampleFraction > 0) {
+            std::cerr << "Error: --schedule needs --workers and cannot be combined with --sample\n";
+            return false;
+        }
+    }
+    // Workers keep their own scanners, and a dump needs the tokens of every function
+    if (!options.functionCache.empty() && (!options.functionMetrics || options.workers > 0 || !options.dumpTokens.empty())) {
+        std::cerr << "Error: --function-cache needs -f and cannot be combined with --workers or --dump-tokens\n";
+        return false;
+    }
+    // Functions are scanned apart from their file, and the scanner feeds a single token sink
+    if (options.heatmapWindow > 0 && (options.functionMetrics || !options.dumpTokens.empty())) {
+        std::cerr << "Error: --heatmap cannot be combined with -f or --dump-tokens\n";
+        return false;
+    }
+    if (!options.timings.empty() && options.schedule.empty()) {
+        std::cerr << "Error: --timings needs --schedule\n";
+        return false;
+    }
+    // A checkpoint holds the global results only
+    if (options.resume && options.checkpoint.empty()) {
+        std::cerr << "Error: --resume needs --checkpoint\n";
+        return false;
+    }
+    if (!options.checkpoint.empty() && (options.sampleFraction > 0 || options.top > 0 || options.rollup || !options.dumpTokens.empty() || options.globalBudget > 0)) {
+        std::cerr << "Error: --checkpoint cannot be combined with --sample, --top, --rollup, --dump-tokens or --global-budget\n";
+        return false;
+    }
+    // Reports left out of the rankings never reach the writer, so they would be missing from the store and the index
+    if ((!options.store.empty() || !options.apiIndex.empty()) && options.top > 0) {
+        std::cerr << "Error: --store and --api-index cannot be combined with --top\n";
+        return false;
+    }
+    return true;
+}
+
+// An analysis of the input files, each one scanned here or in a worker process, with the
+// outputs that were asked for. The members are created by setUp() in the order the run
+// needs: the worker processes are forked before any thread starts.
+class Analysis {
+public:
+    Analysis(const ProgramOptions& options, const std::vector<std::filesystem::path>& filepaths);
+
+    // Analyse every file and write the reports; returns the exit status
+    int run();
+
+private:
+    bool setUp();
+    bool startWorkers();
+    void setUpOutputs();
+    bool admit(std::size_t unit, std::string_view& code);
+    void dispatch(std::size_t unit);
+    void analyse(std::size_t unit, std::string_view code);
+    void skipUnit(std::size_t unit, std::string note, std::uintmax_t size);
+    std::string timeoutNote(std::size_t unit) const;
+    void finishUnit(std::size_t unit, const CodeStatistics& stats, int linesOfCode, std::uintmax_t size);
+    void replay(std::size_t unit, bool taken, std::string_view data, const std::string& failure);
+    void collect(std::size_t unit);
+    bool runScheduled();
+    int finish();
+
+    const ProgramOptions& options_;
+    const std::vector<std::filesystem::path>& filepaths_;
+    const InputLimits& limits_;
+
+    Preprocessor preprocessor_;
+    ContextPool::Lease context_;
+    std::unique_ptr<ChunkedParser> chunker_;
+    CodeStatistics globalStats_;
+    int globalLinesOfCode_ = 0;
+    ScanReport skipped_;
+    CostModel costs_;
+
+    std::unique_ptr<Checkpoint> checkpoint_;
+    std::ofstream dumpFile_;
+    std::unique_ptr<TokenStreamWriter> dump_;
+    std::unique_ptr<LineProfile> heat_;
+    std::unique_ptr<WorkerPool> pool_;
+    std::unique_ptr<Watchdog> watchdog_;
+    std::unique_ptr<FunctionCache> functionCache_;
+    std::unique_ptr<ContentCache> cache_;
+    std::unique_ptr<SampleEstimator> estimator_;
+    SamplePlan plan_;
+    std::unique_ptr<TokenSpill> spill_;
+    std::string spillError_;
+    std::unique_ptr<HotspotReport> hotspots_;
+    std::unique_ptr<DirectoryRollup> rollup_;
+    std::unique_ptr<ResultStoreBuilder> store_;
+    std::unique_ptr<ApiIndexBuilder> apiIndex_;
+    std::unique_ptr<ReportWriter> writer_;
+
+    // Scratch statistics reused across files to keep their allocations
+    CodeStatistics fileStats_, functionStats_;
+
+    // Files analysed by worker processes, collected in input order as they would be analysed
+    // here, or with --schedule all handed out first and collected as they finish
+    std::deque<std::size_t> pending_;
+    std::vector<std::size_t> scheduled_;
+    std::size_t failed_ = 0;
+
+    std::vector<bool> restored_;
+    std::unique_ptr<ReadAhead> readAhead_;
+};
+
+Analysis::Analysis(const ProgramOptions& options, const std::vector<std::filesystem::path>& filepaths)
+    : options_(options), filepaths_(filepaths), limits_(options.limits), context_(ContextPool::global().acquire()) {}
+
+// Set up the scanner and everything the run reports into; prints the error when it cannot
+bool Analysis::setUp() {
+    if (!options_.timings.empty()) {
+        std::string error;
+        if (!costs_.load(options_.timings, error)) {
+            std::cerr << "Error: " << options_.timings << ": " << error << "\n";
+            return false;
+        }
+    }
+
+    // Macros for the conditionals, in command line order
+    for (const auto& definition : options_.defines) {
+        preprocessor_.define(definition);
+    }
+    for (const auto& name : options_.undefines) {
+        preprocessor_.undefine(name);
+    }
+
+    // One context for every file, so the preprocessor setting stays with it
+    if (options_.preprocess) {
+        context_->options().preprocessor = &preprocessor_;
+    }
+
+    // Large files are lexed in parallel chunks, with the results of a serial scan
+    if (options_.lexThreads != 1) {
+        chunker_ = std::make_unique<ChunkedParser>(ChunkedParser::Options{options_.lexThreads, options_.lexChunk});
+        context_->options().chunker = chunker_.get();
+    }
+
+    // Partial global results, saved as the run goes and restored with --resume
+    if (!options_.checkpoint.empty()) {
+        checkpoint_ = std::make_unique<Checkpoint>(options_.checkpoint, checkpointSignature(options_), options_.checkpointInterval);
+        std::string error;
+        if (options_.resume && !checkpoint_->load(globalStats_, globalLinesOfCode_, skipped_, error) && !error.empty()) {
+            std::cerr << "Error: " << error << "\n";
+            return false;
+        }
+    }
+
+    // Classified tokens of every file, for --replay
+    if (!options_.dumpTokens.empty()) {
+        dumpFile_.open(options_.dumpTokens, std::ios::binary | std::ios::trunc);
+        if (!dumpFile_) {
+            std::cerr << "Error: cannot write " << options_.dumpTokens << "\n";
+            return false;
+        }
+        dump_ = std::make_unique<TokenStreamWriter>(dumpFile_);
+        context_->options().sink = dump_.get();
+    }
+
+    // Per-line counts of every file, for --heatmap
+    if (options_.heatmapWindow > 0) {
+        heat_ = std::make_unique<LineProfile>();
+        context_->options().sink = heat_.get();
+    }
+
+    if (options_.workers > 0 && !startWorkers()) {
+        return false;
+    }
+    watchdog_ = std::make_unique<Watchdog>();
+    setUpOutputs();
+    return true;
+}
+
+// Fork the worker processes, before any thread starts, from the state set up so far
+bool Analysis::startWorkers() {
+    auto start = [this]() -> WorkerPool::Task {
+        auto state = std::make_shared<WorkerState>();
+        return [this, state](std::size_t unit, WorkerPool::Output& result) {
+            analyseInWorker(filepaths_[unit], options_, *context_, *state, unit, result, heat_.get());
+        };
+    };
+    try {
+        pool_ = std::make_unique<WorkerPool>(options_.workers, start);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return false;
+    }
+    return true;
+}
+
+// Set up the caches, the sample, the rankings and the writer the results go to
+void Analysis::setUpOutputs() {
+    // Statistics of the functions of earlier runs; a damaged cache is started over
+    if (!options_.functionCache.empty()) {
+        functionCache_ = std::make_unique<FunctionCache>();
+        std::string error;
+        if (!functionCache_->load(options_.functionCache, error)) {
+            std::cerr << "Warning: " << options_.functionCache << ": " << error << "; starting a new cache\n";
+        }
+    }
+
+    // Copies of the same contents are analysed once; a dump needs every file's tokens, and
+    // workers read their own files, so the contents are not seen here
+    cache_ = std::make_unique<ContentCache>(options_.dedup && !dump_ && !pool_ ? filepaths_ : std::vector<std::filesystem::path>{});
+
+    // Files analysed for estimated global metrics, drawn by size stratum
+    if (options_.sampleFraction > 0) {
+        std::vector<std::int64_t> sizes;
+        for (const auto& filePath : filepaths_) {
+            std::error_code error;
+            bool valid = std::filesystem::is_regular_file(filePath, error);
+            auto size = valid ? std::filesystem::file_size(filePath, error) : 0;
+            sizes.push_back(valid && !error ? static_cast<std::int64_t>(size) : -1);
+        }
+        plan_ = planSample(sizes, options_.sampleFraction, options_.seed);
+        estimator_ = std::make_unique<SampleEstimator>(plan_);
+    }
+
+    // Global token tables kept within a memory budget, the tokens over it spilled to disk
+    if (options_.globalBudget > 0) {
+        spill_ = std::make_unique<TokenSpill>(options_.globalBudget, options_.spillDirectory);
+    }
+
+    // Only the highest ranked files and functions are reported with --top
+    hotspots_ = makeHotspots(options_, filepaths_);
+
+    // Per-directory metrics, folded up the tree once every file is done
+    if (options_.rollup) {
+        rollup_ = std::make_unique<DirectoryRollup>();
+    }
+
+    // Reports are formatted and written by a dedicated thread, in input order
+    writer_ = std::make_unique<ReportWriter>(std::cout, options_.verbosity);
+
+    // Rows of the result store, taken from the reports as they are written
+    if (!options_.store.empty()) {
+        store_ = std::make_unique<ResultStoreBuilder>(filepaths_);
+    }
+    // Files and functions of each API token, from the same reports
+    if (!options_.apiIndex.empty()) {
+        apiIndex_ = std::make_unique<ApiIndexBuilder>(filepaths_);
+    }
+    if (store_ || apiIndex_) {
+        writer_->observe([this](const ReportRecord& record) {
+            if (store_) {
+                store_->add(record);
+            }
+            if (apiIndex_) {
+                apiIndex_->add(record);
+            }
+        });
+    }
+
+    // Files restored from the checkpoint, known up front so they are not read ahead
+    restored_.assign(filepaths_.size(), false);
+    if (checkpoint_) {
+        for (std::size_t unit = 0; unit < filepaths_.size(); ++unit) {
+            restored_[unit] = checkpoint_->completed(filepaths_[unit]);
+        }
+    }
+
+    // Files are read on I/O threads ahead of the scanner; workers read their own
+    if (options_.readAhead > 0 && !pool_) {
+        std::vector<std::filesystem::path> scanned;
+        for (std::size_t unit = 0; unit < filepaths_.size(); ++unit) {
+            if (!restored_[unit] && (!estimator_ || plan_.chosen[unit])) {
+                scanned.push_back(filepaths_[unit]);
+            }
+        }
+        readAhead_ = std::make_unique<ReadAhead>(std::move(scanned), options_.readAhead, options_.ioThreads, limits_.maxBytes);
+    }
+}
+
+int Analysis::run() {
+    if (!setUp()) {
+        return EXIT_FAILURE;
+    }
+    for (std::size_t unit = 0; unit < filepaths_.size(); ++unit) {
+        if (!spillError_.empty()) {
+            break; // Reported by finish()
+        }
+        std::string_view code;
+        if (!admit(unit, code)) {
             continue;
         }
-        
-        if (functionMetricsFlag) {
-            processFunction(filePath, verbosity, functionMetricsFlag, fileMetricsFlag, globalMetricsFlag, printCodeFlag, globalStats, globalLinesOfCode);
+        if (pool_) {
+            dispatch(unit);
         } else {
-            processFile(filePath, verbosity, fileMetricsFlag, globalMetricsFlag, printCodeFlag, globalStats, globalLinesOfCode);
+            analyse(unit, code);
         }
     }
+    for (; !pending_.empty(); pending_.pop_front()) {
+        collect(pending_.front());
+    }
+    if (pool_ && !options_.schedule.empty() && !runScheduled()) {
+        return EXIT_FAILURE;
+    }
+    return finish();
+}
 
-    MetricsCalculator globalMetrics(globalStats, globalLinesOfCode);
+// Decide whether a file is analysed, reading it unless workers do; a file that is not has
+// been accounted for
+bool Analysis::admit(std::size_t unit, std::string_view& code) {
+    const auto& filePath = filepaths_[unit];
+    if (restored_[unit]) {
+        writer_->skip(unit);
+        cache_->done(unit);
+        return false;
+    }
+    // A file removed or made unreadable since the run started is reported like a missing one
+    std::error_code error;
+    bool valid = std::filesystem::is_regular_file(filePath, error);
+    std::uintmax_t size = valid ? std::filesystem::file_size(filePath, error) : 0;
+    if (!valid || error) {
+        std::cerr << "Error: " << filePath << " not accessible or invalid\n";
+        writer_->skip(unit);
+        return false;
+    }
+    if (estimator_ && !plan_.chosen[unit]) {
+        writer_->skip(unit);
+        cache_->done(unit);
+        return false;
+    }
+
+    // Size budget and sniffing, before any scanning; workers read and sniff their own files
+    std::string reason;
+    if (limits_.maxBytes > 0 && size > limits_.maxBytes) {
+        reason = "larger than " + std::to_string(limits_.maxBytes) + " bytes";
+    } else if (!pool_) {
+        code = readAhead_ ? readAhead_->take(filePath) : context_->read_file(filePath.string());
+        if (limits_.sniff) {
+            reason = sniffInput(code);
+        }
+    }
+    if (!reason.empty()) {
+        skipUnit(unit, "Skipped " + filePath.filename().string() + ": " + reason, size);
+        return false;
+    }
+    return true;
+}
+
+// Hand a file to the workers; two units per worker keep them busy while the oldest one is collected
+void Analysis::dispatch(std::size_t unit) {
+    if (!options_.schedule.empty()) {
+        scheduled_.push_back(unit);
+        return;
+    }
+    pool_->submit(unit);
+    pending_.push_back(unit);
+    while (pending_.size() > 2 * pool_->size()) {
+        collect(pending_.front());
+        pending_.pop_front();
+    }
+}
+
+// Analyse a file here, replaying a copy or keeping the results of a file that may have copies
+void Analysis::analyse(std::size_t unit, std::string_view code) {
+    const auto& filePath = filepaths_[unit];
+    ContentKey key;
+    CachedUnit results;
+    CachedUnit* capture = nullptr;
+    if (cache_->candidate(unit)) {
+        key = hashContent(code);
+        capture = &results;
+    }
+    const CachedUnit* cached = capture ? cache_->find(key, code, unit) : nullptr;
+
+    int linesBefore = globalLinesOfCode_;
+    bool completed = cached && cached->completed;
+    if (completed) {
+        replayUnit(filePath, *cached, globalStats_, globalLinesOfCode_, skipped_, *writer_, hotspots_.get(), unit);
+    } else if (!cached) {
+        if (limits_.timeoutSeconds > 0) {
+            watchdog_->arm(*context_, limits_.timeoutSeconds);
+        }
+        if (dump_) {
+            dump_->beginUnit(filePath.string(), &*context_);
+        }
+        completed = options_.functionMetrics
+            ? processFunction(filePath, code, options_, *context_, fileStats_, functionStats_, globalStats_, globalLinesOfCode_, skipped_, writer_.get(), hotspots_.get(), unit, capture, functionCache_.get())
+            : processFile(filePath, code, options_, *context_, fileStats_, globalStats_, globalLinesOfCode_, skipped_, writer_.get(), hotspots_.get(), unit, capture, heat_.get());
+        watchdog_->disarm();
+        if (dump_) {
+            if (completed) {
+                dump_->endUnit(fileStats_.getError(), countLines(code));
+            } else {
+                dump_->abortUnit();
+            }
+        }
+
+        if (capture) {
+            results.completed = completed;
+            cache_->insert(key, unit, std::move(results));
+        }
+    }
+
+    if (completed) {
+        finishUnit(unit, cached ? cached->stats : fileStats_, globalLinesOfCode_ - linesBefore, code.size());
+    } else {
+        skipUnit(unit, timeoutNote(unit), code.size());
+    }
+}
+
+// A file that is not analysed, or not to the end: its note takes the place of its reports
+void Analysis::skipUnit(std::size_t unit, std::string note, std::uintmax_t size) {
+    if (dump_) {
+        dump_->skipUnit(filepaths_[unit].string(), note);
+    }
+    writer_->skip(unit, std::move(note));
+    cache_->done(unit);
+    if (estimator_) {
+        estimator_->exclude(unit, size);
+    }
+    if (checkpoint_) {
+        checkpoint_->done(filepaths_[unit], globalStats_, globalLinesOfCode_, skipped_);
+    }
+}
+
+// The note of a file abandoned by the watchdog
+std::string Analysis::timeoutNote(std::size_t unit) const {
+    std::ostringstream note;
+    note << "Skipped " << filepaths_[unit].filename().string() << ": exceeded the time budget of " << limits_.timeoutSeconds << " s";
+    return note.str();
+}
+
+// A file whose results are in the global ones; before done(), which may drop the cached results
+void Analysis::finishUnit(std::size_t unit, const CodeStatistics& stats, int linesOfCode, std::uintmax_t size) {
+    if (rollup_) {
+        rollup_->add(filepaths_[unit], stats, linesOfCode);
+    }
+    if (estimator_) {
+        estimator_->add(unit, stats, linesOfCode, size);
+    }
+    cache_->done(unit);
+    if (checkpoint_) {
+        checkpoint_->done(filepaths_[unit], globalStats_, globalLinesOfCode_, skipped_);
+    }
+    if (spill_ && spillError_.empty()) {
+        spill_->check(globalStats_, spillError_);
+    }
+}
+
+// Replay the result a worker encoded for a file, or note why there is none
+void Analysis::replay(std::size_t unit, bool taken, std::string_view data, const std::string& failure) {
+    const auto& filePath = filepaths_[unit];
+    std::error_code error;
+    auto size = std::filesystem::file_size(filePath, error);
+    CachedUnit results;
+    if (!taken || !decodeUnit(data, results)) {
+        ++failed_;
+        skipUnit(unit, "Failed " + filePath.filename().string() + ": " + failure, size);
+    } else if (!results.completed) {
+        skipUnit(unit, results.records.empty() ? timeoutNote(unit) : results.records.front().note, size);
+    } else {
+        int linesBefore = globalLinesOfCode_;
+        replayUnit(filePath, results, globalStats_, globalLinesOfCode_, skipped_, *writer_, hotspots_.get(), unit);
+        finishUnit(unit, results.stats, globalLinesOfCode_ - linesBefore, size);
+    }
+}
+
+// Wait for the worker result of a file and replay it
+void Analysis::collect(std::size_t unit) {
+    std::string_view data;
+    std::string failure = "the result of its worker is malformed";
+    bool taken = pool_->take(unit, data, failure);
+    replay(unit, taken, data, failure);
+}
+
+// Hand out every file with --schedule and replay the results as they finish; returns false
+// when the timings cannot be saved
+bool Analysis::runScheduled() {
+    std::size_t timed = 0;
+    if (options_.schedule == "cost") {
+        pool_->assign(scheduled_, costs_.estimate(filepaths_, scheduled_, timed));
+    } else {
+        for (std::size_t unit : scheduled_) {
+            pool_->submit(unit);
+        }
+    }
+    while (pool_->outstanding() > 0) {
+        std::size_t unit = 0;
+        std::string_view data;
+        std::string failure = "the result of its worker is malformed";
+        bool taken = pool_->takeNext(unit, data, failure);
+        if (unit == WorkerPool::NoUnit) {
+            break;
+        }
+        replay(unit, taken, data, failure);
+    }
+    const auto report = pool_->report();
+    std::clog << "Schedule: " << report.units << " files (" << timed << " timed) on " << pool_->size() << " workers in "
+              << std::fixed << std::setprecision(3) << report.seconds << " s, idle " << report.idleSeconds << " s, "
+              << report.tailSeconds << " s of it after their last file; " << report.steals << " stolen\n";
+    if (!options_.timings.empty()) {
+        for (const auto& [unit, seconds] : pool_->timings()) {
+            costs_.record(filepaths_[unit], seconds);
+        }
+        std::string error;
+        if (!costs_.save(options_.timings, error)) {
+            std::cerr << "Error: cannot write " << options_.timings << ": " << error << "\n";
+            return false;
+        }
+    }
+    return true;
+}
 
-    if (globalMetricsFlag || (!fileMetricsFlag && !functionMetricsFlag)) {
-        printHeader("Global Metrics", YELLOW);
-        globalMetrics.report(verbosity, "Global", globalLinesOfCode, globalStats);
+// Write the global results and the reports at the end of the run, and save the outputs
+int Analysis::finish() {
+    if (pool_ && (failed_ > 0 || pool_->restarts() > 0)) {
+        std::clog << "Workers: " << failed_ << " files failed, " << pool_->restarts() << " workers restarted\n";
+    }
+    if (readAhead_) {
+        const auto& report = readAhead_->report();
+        std::clog << "Read-ahead: waited " << std::fixed << std::setprecision(3) << report.waitSeconds << " s on I/O for "
+                  << report.waits << " of " << report.files << " files\n";
     }
 
+    // Unique counts of the spilled tokens come from merging their runs
+    MetricsCalculator globalMetrics(globalStats_, globalLinesOfCode_);
+    StatisticsSummary globalSummary = summarize(globalStats_);
+    if (spill_ && spill_->spilled() && spillError_.empty() && spill_->merge(globalStats_, globalSummary, spillError_)) {
+        globalMetrics = MetricsCalculator(globalSummary.uniqueOperators, globalSummary.uniqueOperands, globalSummary.operators, globalSummary.operands,
+                                          globalSummary.counts[static_cast<std::size_t>(CodeStatistics::StatsCategory::CONDITION)], globalLinesOfCode_);
+        const auto& report = spill_->report();
+        std::clog << "Spill: " << report.tokens << " tokens in " << report.runs << " runs (" << report.bytes << " bytes), merged in "
+                  << report.passes << (report.passes == 1 ? " pass\n" : " passes\n");
+    }
+    if (!spillError_.empty()) {
+        std::cerr << "Error: " << spillError_ << "\n";
+        return EXIT_FAILURE;
+    }
+
+    SampleEstimate estimate;
+    if (estimator_) {
+        estimate = estimator_->estimate();
+    }
+    if (hotspots_) {
+        hotspots_->submit(*writer_, filepaths_.size());
+    }
+    if (rollup_) {
+        rollup_->report(*writer_, filepaths_.size());
+    }
+    if (options_.globalMetrics || (!options_.fileMetrics && !options_.functionMetrics)) {
+        if (estimator_) {
+            std::string title = "Estimated Global Metrics (" + std::to_string(estimate.sampled) + " of "
+                              + std::to_string(estimate.population) + " files sampled)";
+            writer_->submit({filepaths_.size(), true, title, &YELLOW, estimate.metrics, estimate.summary, {}, {}});
+        } else {
+            writer_->submit({filepaths_.size(), true, "Global Metrics", &YELLOW, globalMetrics.getMetrics(), globalSummary, {}, {}});
+        }
+    }
+    writer_->close();
+    if (estimator_) {
+        std::cout << "\n";
+        writeIntervals(std::cout, estimate);
+    }
+    if (dump_) {
+        dump_->flush();
+    }
+    if (checkpoint_) {
+        checkpoint_->remove();
+    }
+    if (store_) {
+        std::string error;
+        if (!store_->save(options_.store, error)) {
+            std::cerr << "Error: cannot write " << options_.store << ": " << error << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+    if (functionCache_) {
+        std::string error;
+        if (!functionCache_->save(options_.functionCache, error)) {
+            std::cerr << "Error: cannot write " << options_.functionCache << ": " << error << "\n";
+            return EXIT_FAILURE;
+        }
+        const auto& report = functionCache_->report();
+        std::clog << "Function cache: reused " << report.hits << " functions (" << report.hitBytes << " bytes), lexed "
+                  << report.misses << " (" << report.missBytes << " bytes); " << report.entries << " entries kept, "
+                  << report.dropped << " dropped\n";
+    }
+    if (apiIndex_) {
+        std::string error;
+        if (!apiIndex_->save(options_.apiIndex, error)) {
+            std::cerr << "Error: cannot write " << options_.apiIndex << ": " << error << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (options_.listDuplicates) {
+        cache_->listDuplicates(std::cout, filepaths_);
+    }
+    if (options_.memoryReport) {
+        printMemoryReport(std::cout, {{"File statistics", &fileStats_}, {"Function statistics", &functionStats_}, {"Global statistics", &globalStats_}});
+    }
+    if (options_.preprocess) {
+        std::cout << "\nPreprocessor: skipped " << skipped_.skippedBytes << " bytes in "
+                  << skipped_.skippedRegions << " inactive regions\n";
+    }
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
+
+int main(int argc, char* argv[]) {
+    ProgramOptions options;
+
+    auto filepaths = parseArguments(argc, argv, options);
+
+    // Token streams hold whole files, so they cannot give function metrics
+    if (options.functionMetrics && (!options.dumpTokens.empty() || !options.replayTokens.empty())) {
+        std::cerr << "Error: --dump-tokens and --replay cannot be combined with -f\n";
+        return EXIT_FAILURE;
+    }
+    HotspotMetric metric;
+    if (!parseHotspotMetric(options.topBy, metric)) {
+        std::cerr << "Error: --by takes effort, cyclomatic, volume or bugs\n";
+        return EXIT_FAILURE;
+    }
+    if (!options.replayTokens.empty()) {
+        return replayTokens(options);
+    }
+    if (!options.history.empty()) {
+        return runHistory(options);
+    }
+    if (!options.query.empty()) {
+        return runQuery(options);
+    }
+    if (!options.apiQuery.empty()) {
+        return runApiQuery(options);
+    }
+
+    if (filepaths.empty()) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    if (options.clones) {
+        return runClones(filepaths, options);
+    }
+    if (!checkAnalysisOptions(options)) {
+        return EXIT_FAILURE;
+    }
+    Analysis analysis(options, filepaths);
+    return analysis.run();
+}
@@ -0,0 +1,272 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+// Writes a synthetic corpus of C++, oneTBB, SYCL and AVX sources for regression and
+// throughput tests. The corpus depends only on the seed and the sizes: the generator
+// draws from std::mt19937_64 without library distributions, whose results vary between
+// standard libraries.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+const char* const Nouns[] = {"pixel", "filter", "row", "col", "tile", "sum", "weight", "offset", "frame", "bank",
+                             "index", "count", "value", "block", "item", "range", "grid", "mask", "lane", "width"};
+const char* const Verbs[] = {"apply", "compute", "reduce", "scan", "merge", "update", "load", "store", "blend", "sort"};
+
+class Generator {
+public:
+    explicit Generator(std::uint64_t seed) : rng_(seed) {}
+
+    // One translation unit of roughly the given size, in the given style
+    std::string unit(int flavour, std::size_t bytes) {
+        out_.clear();
+        header(flavour);
+        while (out_.size() < bytes) {
+            switch (flavour) {
+                case 0: plainFunction(); break;
+                case 1: tbbFunction(); break;
+                case 2: syclFunction(); break;
+                default: avxFunction(); break;
+            }
+        }
+        return out_;
+    }
+
+private:
+    std::uint64_t pick(std::uint64_t n) { return rng_() % n; }
+
+    std::string name() {
+        std::string result = Nouns[pick(std::size(Nouns))];
+        if (pick(2)) {
+            result += "_";
+            result += Nouns[pick(std::size(Nouns))];
+        }
+        return result;
+    }
+
+    std::string function() {
+        return std::string(Verbs[pick(std::size(Verbs))]) + "_" + Nouns[pick(std::size(Nouns))] + "_" + std::to_string(serial_++);
+    }
+
+    std::string constant() {
+        switch (pick(4)) {
+            case 0: return std::to_string(pick(16));
+            case 1: return std::to_string(pick(100000));
+            case 2: return std::to_string(pick(1000)) + "." + std::to_string(pick(100)) + "f";
+            default: return "0x" + std::to_string(pick(10)) + "f";
+        }
+    }
+
+    std::string expression(int depth = 0) {
+        static const char* const Operators[] = {" + ", " - ", " * ", " / ", " % ", " & ", " | ", " << ", " >> "};
+        if (depth > 2 || pick(3) == 0) {
+            return pick(3) ? name() : constant();
+        }
+        std::string lhs = expression(depth + 1);
+        std::string rhs = expression(depth + 1);
+        std::string result = lhs + Operators[pick(std::size(Operators))] + rhs;
+        return pick(4) ? result : "(" + result + ")";
+    }
+
+    std::string condition() {
+        static const char* const Comparisons[] = {" < ", " <= ", " > ", " >= ", " == ", " != "};
+        std::string result = name() + Comparisons[pick(std::size(Comparisons))] + expression(1);
+        return pick(4) ? result : result + (pick(2) ? " && " : " || ") + name() + " != " + constant();
+    }
+
+    void line(int indent, const std::string& text) {
+        out_.append(static_cast<std::size_t>(indent) * 4, ' ');
+        out_ += text;
+        out_ += '\n';
+    }
+
+    // Nested loops, branches and assignments
+    void block(int indent, int depth) {
+        int statements = 2 + static_cast<int>(pick(5));
+        for (int s = 0; s < statements; ++s) {
+            std::uint64_t kind = depth > 2 ? pick(3) : pick(8);
+            if (kind < 3) {
+                line(indent, name() + (pick(2) ? " += " : " = ") + expression() + ";");
+            } else if (kind < 5) {
+                std::string i = std::string(1, static_cast<char>('i' + depth));
+                line(indent, "for (int " + i + " = 0; " + i + " < " + name() + "; ++" + i + ") {");
+                block(indent + 1, depth + 1);
+                line(indent, "}");
+            } else if (kind < 7) {
+                line(indent, "if (" + condition() + ") {");
+                block(indent + 1, depth + 1);
+                if (pick(2)) {
+                    line(indent, "} else {");
+                    block(indent + 1, depth + 1);
+                }
+                line(indent, "}");
+            } else {
+                line(indent, "switch (" + name() + " % 4) {");
+                for (int c = 0; c < 3; ++c) {
+                    line(indent + 1, "case " + std::to_string(c) + ":");
+                    line(indent + 2, name() + " = " + expression() + ";");
+                    line(indent + 2, "break;");
+                }
+                line(indent + 1, "default:");
+                line(indent + 2, "break;");
+                line(indent, "}");
+            }
+        }
+    }
+
+    void header(int flavour) {
+        static const char* const Includes[] = {
+            "#include <vector>\n#include <algorithm>\n#include <cmath>\n",
+            "#include \"oneapi/tbb.h\"\n\nusing namespace oneapi::tbb;\n",
+            "#include <sycl/sycl.hpp>\n",
+            "#include <immintrin.h>\n#include <cstdlib>\n"};
+        out_ += "// Synthetic source written by c3ms_corpus for regression tests\n";
+        out_ += Includes[flavour];
+        out_ += '\n';
+    }
+
+    void plainFunction() {
+        std::string type = pick(2) ? "int" : "float";
+        line(0, "template <typename T>");
+        line(0, type + " " + function() + "(std::vector<T>& " + name() + ", const int " + name() + ", int " + name() + ") {");
+        line(1, type + " " + name() + " = " + constant() + ";");
+        block(1, 0);
+        line(1, "std::sort(" + name() + ".begin(), " + name() + ".end());");
+        line(1, "return " + expression() + ";");
+        line(0, "}");
+        line(0, "");
+    }
+
+    void tbbFunction() {
+        line(0, "void " + function() + "(float* a, size_t n) {");
+        if (pick(2)) {
+            line(1, "parallel_for(blocked_range<size_t>(0, n),");
+            line(2, "[=](const blocked_range<size_t>& r) {");
+            line(3, "for (size_t i = r.begin(); i != r.end(); ++i) {");
+            line(4, "a[i] = " + expression() + ";");
+            block(4, 1);
+            line(3, "}");
+            line(2, "}");
+            line(1, ");");
+        } else {
+            line(1, "float total = parallel_reduce(blocked_range<size_t>(0, n), 0.0f,");
+            line(2, "[=](const blocked_range<size_t>& r, float " + name() + ") {");
+            block(3, 1);
+            line(3, "return " + expression() + ";");
+            line(2, "}, std::plus<float>());");
+            line(1, "a[0] = total;");
+        }
+        line(0, "}");
+        line(0, "");
+    }
+
+    void syclFunction() {
+        line(0, "sycl::event " + function() + "(float* ptra, float* out_data, int width, sycl::queue& Q) {");
+        line(1, "auto t_event = Q.submit([&](sycl::handler& h) {");
+        line(2, "sycl::local_accessor<float> local_a(" + constant() + ", h);");
+        line(2, "h.parallel_for(sycl::range<2>(width, width), [=](sycl::item<2> item) {");
+        line(3, "int i = item.get_id(0);");
+        line(3, "int j = item.get_id(1);");
+        line(3, "float sum = 0.0f;");
+        block(3, 1);
+        line(3, "sum = sycl::mad(ptra[i * width + j], " + expression() + ", sum);");
+        line(3, "out_data[i * width + j] = sycl::sqrt(sum);");
+        line(2, "});");
+        line(1, "});");
+        line(1, "return t_event;");
+        line(0, "}");
+        line(0, "");
+    }
+
+    void avxFunction() {
+        line(0, "void " + function() + "(float* fr_data, float* fb_array, float* out, const int width, const int n_filters) {");
+        line(1, "__m256 temp_sum = _mm256_set1_ps(0.0f);");
+        line(1, "for (int fi = 0; fi < n_filters; fi += 8) {");
+        int lanes = 2 + static_cast<int>(pick(6));
+        for (int k = 0; k < lanes; ++k) {
+            std::string cache = "image_cache" + std::to_string(k);
+            line(2, "__m256 " + cache + " = _mm256_broadcast_ss(&fr_data[" + expression(2) + "]);");
+            line(2, "__m256 curr_filter" + std::to_string(k) + " = _mm256_load_ps(&fb_array[fi]);");
+            line(2, "temp_sum = _mm256_add_ps(_mm256_mul_ps(" + cache + ", curr_filter" + std::to_string(k) + "), temp_sum);");
+        }
+        line(2, "__m256 cpm = _mm256_cmp_ps(temp_sum, _mm256_load_ps(out), _CMP_GT_OS);");
+        line(2, "int r = _mm256_movemask_ps(cpm);");
+        line(2, "if (r & (1 << " + std::to_string(pick(8)) + ")) {");
+        block(3, 2);
+        line(2, "}");
+        line(1, "}");
+        line(1, "_mm256_store_ps(out, temp_sum);");
+        line(0, "}");
+        line(0, "");
+    }
+
+    std::mt19937_64 rng_;
+    std::string out_;
+    std::uint64_t serial_ = 0;
+};
+
+void usage() {
+    std::cerr << "Usage: c3ms_corpus --out DIR [--size MB] [--file-size KB] [--seed N]\n"
+              << "Writes about MB megabytes of C++, oneTBB, SYCL and AVX sources to DIR.\n";
+    std::exit(EXIT_FAILURE);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::filesystem::path out;
+    double megabytes = 16;
+    std::size_t fileBytes = 256 << 10;
+    std::uint64_t seed = 1;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--out" && i + 1 < argc) {
+            out = argv[++i];
+        } else if (arg == "--size" && i + 1 < argc) {
+            megabytes = std::stod(argv[++i]);
+        } else if (arg == "--file-size" && i + 1 < argc) {
+            fileBytes = std::stoull(argv[++i]) << 10;
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = std::stoull(argv[++i]);
+        } else {
+            usage();
+        }
+    }
+    if (out.empty() || megabytes <= 0 || fileBytes == 0) {
+        usage();
+    }
+
+    // Start from an empty directory, so a smaller corpus leaves no stale files
+    std::filesystem::remove_all(out);
+    std::filesystem::create_directories(out);
+
+    static const char* const Flavours[] = {"cpp", "tbb", "sycl", "avx"};
+    Generator generator(seed);
+    const auto total = static_cast<std::uint64_t>(megabytes * (1 << 20));
+    std::uint64_t written = 0;
+    for (std::size_t file = 0; written < total; ++file) {
+        int flavour = static_cast<int>(file % std::size(Flavours));
+        std::string code = generator.unit(flavour, std::min<std::uint64_t>(fileBytes, total - written));
+
+        char fileName[64];
+        std::snprintf(fileName, sizeof(fileName), "%06zu-%s.cpp", file, Flavours[flavour]);
+        std::ofstream stream(out / fileName, std::ios::binary);
+        if (!stream.write(code.data(), static_cast<std::streamsize>(code.size()))) {
+            std::cerr << "Error: cannot write " << (out / fileName) << "\n";
+            return EXIT_FAILURE;
+        }
+        written += code.size();
+    }
+    std::cout << "Wrote " << written << " bytes to " << out << "\n";
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,67 @@
+# Runs C3MS on a sample or a corpus directory twice, as it is and with the options of a
+# variant, and checks that both runs report the same.
+#
+#   cmake -DC3MS=<binary> -DARGS="<options>" -DVARIANT="<options>" -DINPUT=<file or directory>
+#         -DWORK=<directory> [-DCRASH=<file name>] -P RunCompare.cmake
+#
+# Modes that only change how the work is done, such as chunked lexing, worker processes or
+# reading ahead, are held to the serial run this way without a golden file.
+#
+# With CRASH the variant runs with C3MS_WORKER_CRASH naming one file of the input, so the
+# worker given it dies. That file must be reported as failed, a new worker must take over,
+# and everything else must match a serial run without the file.
+
+if(IS_DIRECTORY "${INPUT}")
+  file(GLOB inputs "${INPUT}/*.cpp")
+  list(SORT inputs)
+else()
+  set(inputs "${INPUT}")
+endif()
+if(NOT inputs)
+  message(FATAL_ERROR "No sources in ${INPUT}")
+endif()
+separate_arguments(args UNIX_COMMAND "${ARGS}")
+separate_arguments(variant UNIX_COMMAND "${VARIANT}")
+
+function(run_c3ms output errors files)
+  execute_process(
+    COMMAND "${C3MS}" ${ARGN} ${files}
+    OUTPUT_VARIABLE out
+    ERROR_VARIABLE err
+    RESULT_VARIABLE result
+  )
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "C3MS ${ARGN} exited with ${result}:\n${err}")
+  endif()
+  set(${output} "${out}" PARENT_SCOPE)
+  set(${errors} "${err}" PARENT_SCOPE)
+endfunction()
+
+set(serialInputs ${inputs})
+if(CRASH)
+  string(REPLACE "." "\\." pattern "${CRASH}")
+  list(FILTER serialInputs EXCLUDE REGEX "/${pattern}$")
+endif()
+run_c3ms(serial unused "${serialInputs}" ${args})
+if(CRASH)
+  set(ENV{C3MS_WORKER_CRASH} "${CRASH}")
+endif()
+run_c3ms(varied errors "${inputs}" ${args} ${variant})
+
+if(CRASH)
+  set(note "Failed ${pattern}: the worker analysing it was killed by signal 9 [^\n]*\n")
+  if(NOT varied MATCHES "${note}")
+    message(FATAL_ERROR "${CRASH} was not reported as failed by a killed worker")
+  endif()
+  if(NOT errors MATCHES "Workers: 1 files failed, 1 workers restarted")
+    message(FATAL_ERROR "Expected one failed file and one restarted worker:\n${errors}")
+  endif()
+  string(REGEX REPLACE "${note}" "" varied "${varied}")
+endif()
+
+if(NOT varied STREQUAL serial)
+  file(MAKE_DIRECTORY "${WORK}")
+  file(WRITE "${WORK}/serial.txt" "${serial}")
+  file(WRITE "${WORK}/variant.txt" "${varied}")
+  message(FATAL_ERROR "Output with ${VARIANT} differs from the serial run; compare ${WORK}/serial.txt with ${WORK}/variant.txt")
+endif()
@@ -0,0 +1,57 @@
+# Runs C3MS -f with a function cache over a sample, changes only the layout of one of its
+# functions and checks that the cached run reports what a run without the cache does.
+#
+#   cmake -DC3MS=<binary> -DWORK=<directory> -P RunFunctionCache.cmake
+#
+# The scanner keeps the condition of an if constexpr as it is written, so a cache that left
+# the layout out of its key would report the condition of the first run.
+
+file(REMOVE_RECURSE "${WORK}")
+file(MAKE_DIRECTORY "${WORK}")
+set(sample "${WORK}/sample.cpp")
+set(cache "${WORK}/functions.cache")
+
+function(write_sample condition)
+  file(WRITE "${sample}" "template <int N>
+int scaled(int x) {
+    if constexpr ${condition} {
+        return x * N;
+    }
+    return x;
+}
+
+int sum(int a, int b) {
+    return a + b;
+}
+")
+endfunction()
+
+function(run_c3ms output errors)
+  execute_process(
+    COMMAND "${C3MS}" -f -v 3 ${ARGN} "${sample}"
+    OUTPUT_VARIABLE out
+    ERROR_VARIABLE err
+    RESULT_VARIABLE result
+  )
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "C3MS exited with ${result}:\n${err}")
+  endif()
+  set(${output} "${out}" PARENT_SCOPE)
+  set(${errors} "${err}" PARENT_SCOPE)
+endfunction()
+
+write_sample("(N > 0)")
+run_c3ms(first errors --function-cache "${cache}")
+
+write_sample("(N  >   0)")
+run_c3ms(cached errors --function-cache "${cache}")
+run_c3ms(fresh unused)
+
+if(NOT cached STREQUAL fresh)
+  file(WRITE "${WORK}/cached.txt" "${cached}")
+  file(WRITE "${WORK}/fresh.txt" "${fresh}")
+  message(FATAL_ERROR "A layout change was served from the cache; compare ${WORK}/cached.txt with ${WORK}/fresh.txt")
+endif()
+if(NOT errors MATCHES "reused 1 functions .* lexed 1 ")
+  message(FATAL_ERROR "Expected the unchanged function to be reused and the edited one lexed:\n${errors}")
+endif()
@@ -0,0 +1,48 @@
+# Runs C3MS on a sample or a corpus directory and compares its output with a golden file.
+#
+#   cmake -DC3MS=<binary> -DARGS="<options>" -DINPUT=<file or directory> -DGOLDEN=<file>
+#         [-DUPDATE=ON [-DTOOLCHAIN=<text>]] -P RunGolden.cmake
+#
+# With UPDATE the golden file is rewritten instead, and the toolchain that built C3MS is noted
+# in toolchain.txt next to it. A missing golden file fails the test, so a
+# tree without its goldens cannot pass by checking nothing.
+
+if(IS_DIRECTORY "${INPUT}")
+  file(GLOB inputs "${INPUT}/*.cpp")
+  list(SORT inputs)
+else()
+  set(inputs "${INPUT}")
+endif()
+separate_arguments(args UNIX_COMMAND "${ARGS}")
+
+execute_process(
+  COMMAND "${C3MS}" ${args} ${inputs}
+  OUTPUT_VARIABLE output
+  ERROR_VARIABLE errors
+  RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "C3MS exited with ${result}:\n${errors}")
+endif()
+
+if(UPDATE)
+  file(WRITE "${GOLDEN}" "${output}")
+  if(TOOLCHAIN)
+    get_filename_component(directory "${GOLDEN}" DIRECTORY)
+    file(WRITE "${directory}/toolchain.txt" "${TOOLCHAIN}\n")
+  endif()
+  message(STATUS "Updated ${GOLDEN}")
+  return()
+endif()
+
+if(NOT EXISTS "${GOLDEN}")
+  message(FATAL_ERROR "No golden file ${GOLDEN}; run the update_golden target and commit it")
+endif()
+
+file(READ "${GOLDEN}" expected)
+if(NOT output STREQUAL expected)
+  get_filename_component(name "${GOLDEN}" NAME_WE)
+  set(actual "${CMAKE_CURRENT_BINARY_DIR}/${name}.actual.txt")
+  file(WRITE "${actual}" "${output}")
+  message(FATAL_ERROR "Output differs from ${GOLDEN}\nActual output written to ${actual}")
+endif()
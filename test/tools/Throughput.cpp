@@ -0,0 +1,135 @@
+/* Copyright 2023 Campos-Ferrer, Cristian. Universidad de Málaga */
+
+// Measures the end-to-end throughput of C3MS on a corpus and compares it with a stored
+// baseline. The best of several runs is kept, to reduce noise from the machine.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Quotes an argument for the POSIX shell
+std::string quote(const std::string& text) {
+    std::string result = "'";
+    for (char c : text) {
+        result += c == '\'' ? std::string("'\\''") : std::string(1, c);
+    }
+    return result + "'";
+}
+
+// Reads the first number of a baseline file, skipping '#' comments; 0 when there is none
+double readBaseline(const std::filesystem::path& path) {
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line[0] != '#') {
+            return std::stod(line);
+        }
+    }
+    return 0;
+}
+
+void usage() {
+    std::cerr << "Usage: c3ms_throughput --c3ms PATH --corpus DIR --baseline FILE [--record] [--toolchain TEXT] [--tolerance FRACTION] [--runs N]\n";
+    std::exit(EXIT_FAILURE);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string c3ms;
+    std::filesystem::path corpus, baselinePath;
+    std::string toolchain;
+    bool record = false;
+    double tolerance = 0.25;
+    int runs = 3;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--c3ms" && i + 1 < argc) {
+            c3ms = argv[++i];
+        } else if (arg == "--corpus" && i + 1 < argc) {
+            corpus = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            baselinePath = argv[++i];
+        } else if (arg == "--record") {
+            record = true;
+        } else if (arg == "--toolchain" && i + 1 < argc) {
+            toolchain = argv[++i];
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            tolerance = std::stod(argv[++i]);
+        } else if (arg == "--runs" && i + 1 < argc) {
+            runs = std::max(1, std::stoi(argv[++i]));
+        } else {
+            usage();
+        }
+    }
+    if (c3ms.empty() || corpus.empty() || baselinePath.empty()) {
+        usage();
+    }
+
+    // Every file of the corpus in one run; budgets, sniffing and deduplication are off so
+    // the scanner sees every byte
+    std::vector<std::filesystem::path> files;
+    std::uintmax_t bytes = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(corpus)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".cpp") {
+            files.push_back(entry.path());
+            bytes += entry.file_size();
+        }
+    }
+    if (files.empty()) {
+        std::cerr << "Error: no sources in " << corpus << "\n";
+        return EXIT_FAILURE;
+    }
+    std::sort(files.begin(), files.end());
+    std::string command = quote(c3ms) + " -g --no-dedup";
+    for (const auto& file : files) {
+        command += " " + quote(file.string());
+    }
+    command += " > /dev/null";
+
+    double best = 0;
+    for (int run = 0; run < runs; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        if (std::system(command.c_str()) != 0) {
+            std::cerr << "Error: C3MS failed on the corpus\n";
+            return EXIT_FAILURE;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::max(best, static_cast<double>(bytes) / (1 << 20) / elapsed.count());
+    }
+    std::cout << "Throughput: " << best << " MB/s over " << files.size() << " files, " << bytes << " bytes\n";
+
+    if (record) {
+        std::filesystem::create_directories(baselinePath.parent_path());
+        std::ofstream file(baselinePath);
+        file << "# End-to-end MB/s of C3MS -g on the throughput corpus, best of " << runs << " runs\n";
+        if (!toolchain.empty()) {
+            file << "# Built with " << toolchain << "\n";
+        }
+        file << best << "\n";
+        std::cout << "Recorded baseline in " << baselinePath << "\n";
+        return file ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    double baseline = readBaseline(baselinePath);
+    if (baseline <= 0) {
+        std::cerr << "Error: no throughput baseline in " << baselinePath << "; run the update_baselines target and commit it\n";
+        return EXIT_FAILURE;
+    }
+    double floor = baseline * (1 - tolerance);
+    std::cout << "Baseline: " << baseline << " MB/s, lowest accepted " << floor << " MB/s\n";
+    if (best < floor) {
+        std::cerr << "Throughput regression: " << best << " MB/s is below " << floor << " MB/s\n";
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}